@@ -0,0 +1,460 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+/*
+ * Throughput benchmark of the fusion pipeline.
+ *
+ * Each subsystem is timed in isolation over a grid of run counts, topics
+ * and depths, on synthetic runs built in memory. The best of `-r`
+ * repetitions is reported as one tab separated line per subsystem, variant
+ * and scenario, so the output of two commits can be compared with
+ * `tools/bench_compare.py`.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "polyfuse.h"
+
+#define DEFAULT_RUNS "2,8"
+#define DEFAULT_TOPICS "50,200"
+#define DEFAULT_DEPTHS "100,1000"
+#define DEFAULT_REPS 3
+#define DEFAULT_SUBSYSTEMS "read,normalize,accumulate,pq,topk,present"
+
+static const struct {
+    const char *name;
+    enum fusetype type;
+} methods[] = {
+    {"borda", TBORDA},
+    {"combanz", TCOMBANZ},
+    {"combmax", TCOMBMAX},
+    {"combmed", TCOMBMED},
+    {"combmin", TCOMBMIN},
+    {"combmnz", TCOMBMNZ},
+    {"combsum", TCOMBSUM},
+    {"isr", TISR},
+    {"logisr", TLOGISR},
+    {"rbc", TRBC},
+    {"rrf", TRRF},
+    {"condorcet", TCONDORCET},
+    {"mc4", TMC4},
+};
+#define NMETHODS (sizeof(methods) / sizeof(methods[0]))
+
+static const struct {
+    const char *name;
+    enum trec_norm norm;
+} norms[] = {
+    {"minmax", TNORM_MINMAX},
+    {"sum", TNORM_SUM},
+    {"minsum", TNORM_MINSUM},
+    {"std", TNORM_ZMUV},
+    {"cdf", TNORM_CDF},
+    {"iqr", TNORM_IQR},
+    {"trim", TNORM_TRIM},
+};
+#define NNORMS (sizeof(norms) / sizeof(norms[0]))
+
+struct scenario {
+    size_t nruns;
+    size_t ntopics;
+    size_t depth;
+};
+
+/*
+ * Runs of a scenario, with the original scores so normalization can be
+ * undone between repetitions.
+ */
+struct bench {
+    struct scenario sc;
+    struct trec_run **runs;
+    pf_score_t **scores;
+    size_t entries;
+    size_t reps;
+};
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+report(const char *subsystem, const char *variant, const struct scenario *sc,
+    size_t entries, double best)
+{
+    printf("%s\t%s\t%zu\t%zu\t%zu\t%zu\t%.6f\t%.1f\t%.0f\n", subsystem,
+        variant, sc->nruns, sc->ntopics, sc->depth, entries, best,
+        best * 1e9 / entries, entries / best);
+}
+
+/*
+ * Build a run of `ntopics` x `depth` entries. Documents are drawn from a pool
+ * twice the depth so that runs partially overlap.
+ */
+static struct trec_run *
+synth_run(unsigned int seed, size_t ntopics, size_t depth)
+{
+    struct trec_run *r = trec_create();
+    char buf[32];
+
+    srand(seed);
+    r->alloc = ntopics * depth;
+    r->ary = brealloc(r->ary, sizeof(struct trec_entry) * r->alloc);
+    r->topics.alloc = ntopics;
+    r->topics.ary = brealloc(r->topics.ary, sizeof(int) * ntopics);
+    for (size_t t = 0; t < ntopics; t++) {
+        int qid = 301 + t;
+        r->topics.ary[r->topics.len++] = qid;
+        for (size_t i = 0; i < depth; i++) {
+            struct trec_entry *e = &r->ary[r->len++];
+            snprintf(buf, sizeof(buf), "DOC-%d-%d", qid,
+                (int)(rand() % (2 * depth)));
+            e->qid = qid;
+            e->docno = strdup(buf);
+            e->rank = i + 1;
+            e->score = (pf_score_t)(depth - i) / depth;
+            e->name = strdup("bench");
+        }
+    }
+    r->max_rank = depth;
+
+    return r;
+}
+
+static void
+restore_scores(struct bench *b)
+{
+    for (size_t i = 0; i < b->sc.nruns; i++) {
+        for (size_t j = 0; j < b->runs[i]->len; j++) {
+            b->runs[i]->ary[j].score = b->scores[i][j];
+        }
+    }
+}
+
+/*
+ * Set up a context to fuse the runs of the scenario with `type`.
+ */
+static struct pf_ctx *
+fuse_ctx(struct bench *b, enum fusetype type)
+{
+    struct pf_ctx *ctx = pf_ctx_create();
+
+    pf_set_fusion(ctx, type);
+    pf_set_rrf_k(ctx, 60);
+    pf_init(ctx, &b->runs[0]->topics);
+    pf_weight_alloc(ctx, 0.8, b->sc.depth);
+
+    return ctx;
+}
+
+/*
+ * `trec_read` of run files written to temporary files.
+ */
+static void
+bench_read(struct bench *b)
+{
+    FILE **fp = bmalloc(sizeof(FILE *) * b->sc.nruns);
+    double best = 0.0;
+
+    for (size_t i = 0; i < b->sc.nruns; i++) {
+        const struct trec_run *r = b->runs[i];
+        if (!(fp[i] = tmpfile())) {
+            perror("tmpfile");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t j = 0; j < r->len; j++) {
+            const struct trec_entry *e = &r->ary[j];
+            fprintf(fp[i], "%d Q0 %s %d %.9Lf %s\n", e->qid, e->docno,
+                e->rank, (long double)e->score, e->name);
+        }
+    }
+
+    for (size_t rep = 0; rep < b->reps; rep++) {
+        double elapsed = 0.0;
+        for (size_t i = 0; i < b->sc.nruns; i++) {
+            struct trec_run *r = trec_create();
+            rewind(fp[i]);
+            double start = now();
+            trec_read(r, fp[i]);
+            elapsed += now() - start;
+            trec_destroy(r);
+        }
+        if (0 == rep || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    report("read", "-", &b->sc, b->entries, best);
+
+    for (size_t i = 0; i < b->sc.nruns; i++) {
+        fclose(fp[i]);
+    }
+    free(fp);
+}
+
+static void
+bench_normalize(struct bench *b)
+{
+    for (size_t n = 0; n < NNORMS; n++) {
+        double best = 0.0;
+        for (size_t rep = 0; rep < b->reps; rep++) {
+            restore_scores(b);
+            double start = now();
+            for (size_t i = 0; i < b->sc.nruns; i++) {
+                trec_normalize(b->runs[i], norms[n].norm);
+            }
+            double elapsed = now() - start;
+            if (0 == rep || elapsed < best) {
+                best = elapsed;
+            }
+        }
+        report("normalize", norms[n].name, &b->sc, b->entries, best);
+    }
+    restore_scores(b);
+}
+
+static void
+bench_accumulate(struct bench *b)
+{
+    for (size_t m = 0; m < NMETHODS; m++) {
+        double best = 0.0;
+        for (size_t rep = 0; rep < b->reps; rep++) {
+            struct pf_ctx *ctx = fuse_ctx(b, methods[m].type);
+            double start = now();
+            for (size_t i = 0; i < b->sc.nruns; i++) {
+                pf_accumulate(ctx, b->runs[i]);
+            }
+            double elapsed = now() - start;
+            if (0 == rep || elapsed < best) {
+                best = elapsed;
+            }
+            pf_ctx_destroy(ctx);
+        }
+        report("accumulate", methods[m].name, &b->sc, b->entries, best);
+    }
+}
+
+/*
+ * Selection of the top `depth` of every topic's candidates, which are taken
+ * from the entries of all runs, with `pq` and with `pf_topk`.
+ */
+static void
+bench_select(struct bench *b, bool topk)
+{
+    size_t n = b->entries;
+    char **docno = bmalloc(sizeof(char *) * n);
+    pf_score_t *score = bmalloc(sizeof(pf_score_t) * n);
+    size_t per_topic = b->sc.nruns * b->sc.depth;
+    struct dbl_entry res;
+    struct pf_topk tk = {0};
+    double best = 0.0;
+
+    /* candidates grouped by topic, as they would leave the accumulators */
+    for (size_t t = 0, k = 0; t < b->sc.ntopics; t++) {
+        for (size_t i = 0; i < b->sc.nruns; i++) {
+            for (size_t j = 0; j < b->sc.depth; j++) {
+                struct trec_entry *e = &b->runs[i]->ary[t * b->sc.depth + j];
+                docno[k] = e->docno;
+                score[k++] = e->score * (i + 1);
+            }
+        }
+    }
+
+    for (size_t rep = 0; rep < b->reps; rep++) {
+        double start = now();
+        for (size_t t = 0; t < b->sc.ntopics; t++) {
+            size_t off = t * per_topic;
+            if (topk) {
+                pf_topk_reset(&tk, b->sc.depth, b->sc.depth);
+                for (size_t k = 0; k < per_topic; k++) {
+                    pf_topk_push(&tk, score[off + k], docno[off + k]);
+                }
+                pf_topk_finish(&tk);
+            } else {
+                struct pq *pq = pq_create(b->sc.depth);
+                for (size_t k = 0; k < per_topic; k++) {
+                    pq_insert(pq, docno[off + k], score[off + k], 0);
+                }
+                while (pq_remove(pq, &res)) {
+                }
+                pq_destroy(pq);
+            }
+        }
+        double elapsed = now() - start;
+        if (0 == rep || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    report(topk ? "topk" : "pq", "-", &b->sc, n, best);
+
+    pf_topk_free(&tk);
+    free(score);
+    free(docno);
+}
+
+/*
+ * `pf_present` of fused CombSUM and RRF runs to /dev/null.
+ */
+static void
+bench_present(struct bench *b)
+{
+    static const enum fusetype types[] = {TCOMBSUM, TRRF};
+    FILE *out = fopen("/dev/null", "w");
+
+    if (!out) {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t m = 0; m < sizeof(types) / sizeof(types[0]); m++) {
+        struct pf_ctx *ctx = fuse_ctx(b, types[m]);
+        double best = 0.0;
+        for (size_t i = 0; i < b->sc.nruns; i++) {
+            pf_accumulate(ctx, b->runs[i]);
+        }
+        for (size_t rep = 0; rep < b->reps; rep++) {
+            double start = now();
+            pf_present(ctx, out, "bench", b->sc.depth, false);
+            double elapsed = now() - start;
+            if (0 == rep || elapsed < best) {
+                best = elapsed;
+            }
+        }
+        pf_ctx_destroy(ctx);
+        report("present", fusetype_str[types[m]], &b->sc, b->entries, best);
+    }
+    fclose(out);
+}
+
+static size_t
+parse_list(const char *s, size_t *out, size_t max)
+{
+    long double *v;
+    size_t n = parse_ldbl_list(s, &v);
+
+    if (n > max) {
+        err_exit("too many values in '%s'", s);
+    }
+    for (size_t i = 0; i < n; i++) {
+        out[i] = v[i];
+    }
+    free(v);
+
+    return n;
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+        "usage: pf_bench [options]\n"
+        "\noptions:\n"
+        "  -R list      numbers of runs (default: " DEFAULT_RUNS ")\n"
+        "  -T list      numbers of topics (default: " DEFAULT_TOPICS ")\n"
+        "  -D list      run depths (default: " DEFAULT_DEPTHS ")\n"
+        "  -r num       repetitions, the best is reported (default: 3)\n"
+        "  -s list      subsystems (default: " DEFAULT_SUBSYSTEMS ")\n\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    size_t nruns[16], ntopics[16], depths[16];
+    size_t lr, lt, ld, reps = DEFAULT_REPS;
+    const char *runs_str = DEFAULT_RUNS, *topics_str = DEFAULT_TOPICS;
+    const char *depths_str = DEFAULT_DEPTHS, *subsys = DEFAULT_SUBSYSTEMS;
+    int ch;
+
+    while ((ch = getopt(argc, argv, "R:T:D:r:s:")) != -1) {
+        switch (ch) {
+        case 'R':
+            runs_str = optarg;
+            break;
+        case 'T':
+            topics_str = optarg;
+            break;
+        case 'D':
+            depths_str = optarg;
+            break;
+        case 'r':
+            reps = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            subsys = optarg;
+            break;
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    lr = parse_list(runs_str, nruns, 16);
+    lt = parse_list(topics_str, ntopics, 16);
+    ld = parse_list(depths_str, depths, 16);
+    if (reps < 1) {
+        reps = 1;
+    }
+
+    printf("subsystem\tvariant\truns\ttopics\tdepth\tentries\tseconds\t"
+           "ns_per_entry\tentries_per_sec\n");
+    for (size_t t = 0; t < lt; t++) {
+        for (size_t d = 0; d < ld; d++) {
+            for (size_t r = 0; r < lr; r++) {
+                struct bench b = {{nruns[r], ntopics[t], depths[d]}, NULL,
+                    NULL, 0, reps};
+                b.runs = bmalloc(sizeof(struct trec_run *) * b.sc.nruns);
+                b.scores = bmalloc(sizeof(pf_score_t *) * b.sc.nruns);
+                for (size_t i = 0; i < b.sc.nruns; i++) {
+                    b.runs[i] = synth_run(i + 1, b.sc.ntopics, b.sc.depth);
+                    b.scores[i] =
+                        bmalloc(sizeof(pf_score_t) * b.runs[i]->len);
+                    for (size_t j = 0; j < b.runs[i]->len; j++) {
+                        b.scores[i][j] = b.runs[i]->ary[j].score;
+                    }
+                    b.entries += b.runs[i]->len;
+                }
+
+                if (strstr(subsys, "read")) {
+                    bench_read(&b);
+                }
+                if (strstr(subsys, "normalize")) {
+                    bench_normalize(&b);
+                }
+                if (strstr(subsys, "accumulate")) {
+                    bench_accumulate(&b);
+                }
+                if (strstr(subsys, "pq")) {
+                    bench_select(&b, false);
+                }
+                if (strstr(subsys, "topk")) {
+                    bench_select(&b, true);
+                }
+                if (strstr(subsys, "present")) {
+                    bench_present(&b);
+                }
+                fflush(stdout);
+
+                for (size_t i = 0; i < b.sc.nruns; i++) {
+                    trec_destroy(b.runs[i]);
+                    free(b.scores[i]);
+                }
+                free(b.runs);
+                free(b.scores);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+/*
+ * Latency benchmark of `pf_small_fuse`.
+ *
+ * Every call is timed on its own over a grid of list counts and hits per
+ * list, and the percentiles are reported as one tab separated line per
+ * method and scenario.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pf_small.h"
+#include "util.h"
+
+#define DEFAULT_LISTS "3,8"
+#define DEFAULT_HITS "10,100"
+#define DEFAULT_K 10
+#define DEFAULT_ITERS 100000
+#define MAX_LISTS 64
+/* distinct result sets cycled through, so caches see varied input */
+#define NSETS 64
+
+static const struct {
+    const char *name;
+    enum fusetype type;
+} methods[] = {
+    {"borda", TBORDA},
+    {"combmed", TCOMBMED},
+    {"combmnz", TCOMBMNZ},
+    {"combsum", TCOMBSUM},
+    {"rbc", TRBC},
+    {"rrf", TRRF},
+};
+#define NMETHODS (sizeof(methods) / sizeof(methods[0]))
+
+static double
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int
+dbl_cmp(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Fill `nlists` lists of `nhits` distinct hits, drawn from a pool of at least
+ * twice as many documents so lists overlap.
+ */
+static void
+fill_lists(struct pf_small_hit *hits, struct pf_small_list *lists,
+    size_t nlists, size_t nhits, unsigned int *seed)
+{
+    uint64_t pool = 1;
+
+    while (pool < 2 * nhits) {
+        pool <<= 1;
+    }
+    for (size_t i = 0; i < nlists; i++) {
+        struct pf_small_hit *h = hits + i * nhits;
+        /* an odd multiplier permutes the power of two pool */
+        uint64_t a = rand_r(seed) | 1, b = rand_r(seed);
+        pf_score_t score = 10.0;
+        for (size_t j = 0; j < nhits; j++) {
+            h[j].doc = (a * j + b) & (pool - 1);
+            h[j].rank = j + 1;
+            score -= (rand_r(seed) % 1000) / 1000.0;
+            h[j].score = score;
+        }
+        lists[i] = (struct pf_small_list){h, nhits, 1.0};
+    }
+}
+
+static void
+bench(size_t nlists, size_t nhits, size_t k, size_t iters)
+{
+    struct pf_small_hit *hits =
+        bmalloc(sizeof(struct pf_small_hit) * NSETS * nlists * nhits);
+    struct pf_small_list *lists =
+        bmalloc(sizeof(struct pf_small_list) * NSETS * nlists);
+    struct pf_small_result *out = bmalloc(sizeof(struct pf_small_result) * k);
+    double *lat = bmalloc(sizeof(double) * iters);
+    unsigned int seed = 1;
+    volatile size_t sink = 0;
+
+    for (size_t s = 0; s < NSETS; s++) {
+        fill_lists(hits + s * nlists * nhits, lists + s * nlists, nlists,
+            nhits, &seed);
+    }
+
+    for (size_t m = 0; m < NMETHODS; m++) {
+        struct pf_small_params p = {methods[m].type, 60, 0.8};
+        for (size_t i = 0; i < iters; i++) {
+            const struct pf_small_list *l = lists + (i % NSETS) * nlists;
+            double start = now_ns();
+            sink += pf_small_fuse(&p, l, nlists, out, k);
+            lat[i] = now_ns() - start;
+        }
+        qsort(lat, iters, sizeof(double), dbl_cmp);
+        printf("%s\t%zu\t%zu\t%zu\t%.0f\t%.0f\t%.0f\n", methods[m].name,
+            nlists, nhits, k, lat[iters / 2], lat[iters * 99 / 100],
+            lat[iters - 1]);
+    }
+    (void)sink;
+
+    free(lat);
+    free(out);
+    free(lists);
+    free(hits);
+}
+
+static size_t
+parse_list(const char *s, size_t *out, size_t max)
+{
+    long double *v;
+    size_t n = parse_ldbl_list(s, &v);
+
+    if (n > max) {
+        err_exit("too many values in '%s'", s);
+    }
+    for (size_t i = 0; i < n; i++) {
+        out[i] = v[i];
+    }
+    free(v);
+
+    return n;
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+        "usage: pf_small_bench [options]\n"
+        "\noptions:\n"
+        "  -l list      lists fused per call (default: " DEFAULT_LISTS ")\n"
+        "  -n list      hits per list (default: " DEFAULT_HITS ")\n"
+        "  -k num       results kept (default: 10)\n"
+        "  -i num       calls timed per method (default: 100000)\n\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    size_t nlists[16], nhits[16], nl, nh;
+    const char *lists_str = DEFAULT_LISTS, *hits_str = DEFAULT_HITS;
+    size_t k = DEFAULT_K, iters = DEFAULT_ITERS;
+    int ch;
+
+    while ((ch = getopt(argc, argv, "l:n:k:i:")) != -1) {
+        switch (ch) {
+        case 'l':
+            lists_str = optarg;
+            break;
+        case 'n':
+            hits_str = optarg;
+            break;
+        case 'k':
+            k = strtoul(optarg, NULL, 10);
+            break;
+        case 'i':
+            iters = strtoul(optarg, NULL, 10);
+            break;
+        case '?':
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    nl = parse_list(lists_str, nlists, 16);
+    nh = parse_list(hits_str, nhits, 16);
+    if (k < 1 || iters < 1) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    printf("method\tlists\thits\tk\tp50_ns\tp99_ns\tmax_ns\n");
+    for (size_t i = 0; i < nl; i++) {
+        if (nlists[i] < 1 || nlists[i] > MAX_LISTS) {
+            continue;
+        }
+        for (size_t j = 0; j < nh; j++) {
+            if (nhits[j] > 0) {
+                bench(nlists[i], nhits[j], k, iters);
+            }
+        }
+    }
+
+    return 0;
+}
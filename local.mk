@@ -0,0 +1,3 @@
+CPPUTEST_PATH=/tmp/cpputest
+CXXFLAGS += -I$(CPPUTEST_PATH)/include
+CXXFLAGS += -Wno-narrowing
@@ -0,0 +1,35 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#ifndef CMD_H
+#define CMD_H
+
+/*
+ * Subcommands of `polyfuse`. Each receives the arguments following the
+ * program name, so `argv[0]` is the subcommand itself.
+ */
+int
+cmd_batch(int argc, char **argv);
+
+int
+cmd_gen(int argc, char **argv);
+
+int
+cmd_learn(int argc, char **argv);
+
+int
+cmd_multi(int argc, char **argv);
+
+int
+cmd_serve(int argc, char **argv);
+
+int
+cmd_sweep(int argc, char **argv);
+
+#endif /* CMD_H */
@@ -0,0 +1,242 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+/*
+ * `polyfuse batch`: run the fusion jobs of a manifest on a thread pool.
+ *
+ * Each line of the manifest is a job of four tab separated fields:
+ *
+ *     method  params  runs  output
+ *
+ * `params` are the `key=value` pairs of `polyfuse serve` requests (`k`,
+ * `phi`, `norm`, `depth`, `ties`, `id`, `weights`, `topics`) separated by
+ * spaces, or `-` for none. `runs` are separated by commas or spaces. Blank
+ * lines and lines starting with `#` are skipped.
+ *
+ * Every distinct run, and normalization of it, is read once and shared by
+ * all jobs that use it.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cmd.h"
+#include "pf_serve.h"
+#include "util.h"
+
+struct batch_job {
+    size_t line;
+    struct pf_serve_req req;
+    char *output;
+};
+
+struct batch {
+    const char *path;
+    struct batch_job *jobs;
+    size_t njobs;
+    size_t next;
+    size_t failed;
+    struct pf_cache cache;
+    pthread_mutex_t lock;
+};
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+        "usage: polyfuse batch [options] jobs.tsv\n"
+        "\noptions:\n"
+        "  -j threads   jobs run at once (default: online CPUs)\n"
+        "  -m MiB       memory budget of parsed runs (default: unlimited)\n"
+        "\neach line of jobs.tsv is a job of tab separated fields:\n"
+        "  method  params  runs  output\n"
+        "e.g.\n"
+        "  rrf  k=60 depth=100  a.run,b.run  out/rrf.run\n\n");
+}
+
+/*
+ * Parse a manifest line into `job`. Returns 0 for a line without a job.
+ */
+static int
+parse_job(struct batch_job *job, char *line, const char *path, size_t lineno)
+{
+    char *field[4], *save = NULL, *p;
+    char err[512];
+    size_t n = 0, len;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    if ('\0' == line[strspn(line, " \t")] || '#' == line[0]) {
+        return 0;
+    }
+    for (char *tok = strtok_r(line, "\t", &save); tok && n < 4;
+         tok = strtok_r(NULL, "\t", &save)) {
+        field[n++] = tok;
+    }
+    if (4 != n || strtok_r(NULL, "\t", &save)) {
+        err_exit("%s:%zu: expected 4 tab separated fields", path, lineno);
+    }
+    for (p = field[2]; *p; p++) {
+        if (' ' == *p) {
+            *p = ',';
+        }
+    }
+
+    len = strlen(field[0]) + strlen(field[1]) + strlen(field[2]) + 32;
+    char *msg = bmalloc(len);
+    snprintf(msg, len, "fuse method=%s %s runs=%s", field[0],
+        strcmp(field[1], "-") ? field[1] : "", field[2]);
+    if (pf_serve_parse(&job->req, msg, strlen(msg), err, sizeof(err)) < 0) {
+        err_exit("%s:%zu: %s", path, lineno, err);
+    }
+    free(msg);
+    job->line = lineno;
+    job->output = strdup(field[3]);
+
+    return 1;
+}
+
+static void
+read_jobs(struct batch *b)
+{
+    FILE *fp = fopen(b->path, "r");
+    size_t alloc = 16, lineno = 0, cap = 0;
+    char *line = NULL;
+
+    if (!fp) {
+        perror(b->path);
+        exit(EXIT_FAILURE);
+    }
+    b->jobs = bmalloc(sizeof(struct batch_job) * alloc);
+    while (getline(&line, &cap, fp) > 0) {
+        if (b->njobs == alloc) {
+            alloc *= 2;
+            b->jobs = brealloc(b->jobs, sizeof(struct batch_job) * alloc);
+        }
+        b->njobs += parse_job(&b->jobs[b->njobs], line, b->path, ++lineno);
+    }
+    free(line);
+    fclose(fp);
+}
+
+static int
+run_job(struct batch *b, const struct batch_job *job)
+{
+    struct pf_writer w;
+    char err[512];
+    FILE *fp;
+    int ret;
+
+    if (!(fp = fopen(job->output, "w"))) {
+        fprintf(stderr, "%s:%zu: %s: %s\n", b->path, job->line, job->output,
+            strerror(errno));
+        return -1;
+    }
+    pf_writer_init(&w, fp);
+    ret = pf_cache_fuse(&b->cache, &job->req, &w, err, sizeof(err));
+    pf_writer_free(&w);
+    fclose(fp);
+    if (ret < 0) {
+        fprintf(stderr, "%s:%zu: %s\n", b->path, job->line, err);
+        unlink(job->output);
+    }
+
+    return ret;
+}
+
+static void *
+batch_worker(void *arg)
+{
+    struct batch *b = arg;
+
+    for (;;) {
+        size_t i;
+        pthread_mutex_lock(&b->lock);
+        i = b->next++;
+        pthread_mutex_unlock(&b->lock);
+        if (i >= b->njobs) {
+            break;
+        }
+        if (run_job(b, &b->jobs[i]) < 0) {
+            pthread_mutex_lock(&b->lock);
+            b->failed++;
+            pthread_mutex_unlock(&b->lock);
+        }
+    }
+
+    return NULL;
+}
+
+int
+cmd_batch(int argc, char **argv)
+{
+    long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t budget = SIZE_MAX;
+    struct batch b;
+    int ch;
+
+    while ((ch = getopt(argc, argv, "j:m:")) != -1) {
+        switch (ch) {
+        case 'j':
+            nthreads = strtol(optarg, NULL, 10);
+            break;
+        case 'm':
+            budget = strtoul(optarg, NULL, 10) << 20;
+            break;
+        case '?':
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind + 1 != argc) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&b, 0, sizeof(b));
+    b.path = argv[optind];
+    read_jobs(&b);
+    pf_cache_init(&b.cache, budget);
+    pthread_mutex_init(&b.lock, NULL);
+
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+    if ((size_t)nthreads > b.njobs) {
+        nthreads = b.njobs ? b.njobs : 1;
+    }
+    pthread_t *tid = bmalloc(sizeof(pthread_t) * nthreads);
+    for (long i = 0; i < nthreads; i++) {
+        if (pthread_create(&tid[i], NULL, batch_worker, &b)) {
+            err_exit("unable to create thread");
+        }
+    }
+    for (long i = 0; i < nthreads; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    free(tid);
+
+    if (b.failed) {
+        fprintf(stderr, "%zu of %zu jobs failed\n", b.failed, b.njobs);
+    }
+    for (size_t i = 0; i < b.njobs; i++) {
+        pf_serve_req_free(&b.jobs[i].req);
+        free(b.jobs[i].output);
+    }
+    free(b.jobs);
+    pf_cache_free(&b.cache);
+    pthread_mutex_destroy(&b.lock);
+
+    return b.failed ? EXIT_FAILURE : 0;
+}
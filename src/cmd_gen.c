@@ -0,0 +1,189 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+/*
+ * `polyfuse gen`: write synthetic runs for load testing.
+ *
+ * Runs are generated from a seed and are identical from one invocation to
+ * the next, whatever the number of threads writing them.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cmd.h"
+#include "pf_gen.h"
+#include "util.h"
+
+#define DEFAULT_RUNS 4
+#define DEFAULT_TOPICS 50
+#define DEFAULT_DEPTH 1000
+#define DEFAULT_DOCNO_LEN 10
+
+struct gen_task {
+    const struct pf_gen *g;
+    const char *outdir;
+    size_t first;
+    size_t stride;
+};
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+        "usage: polyfuse gen [options]\n"
+        "\noptions:\n"
+        "  -o dir       output directory (default: gen_runs)\n"
+        "  -r num       number of runs (default: 4)\n"
+        "  -T num       number of topics (default: 50)\n"
+        "  -d depth     documents per topic (default: 1000)\n"
+        "  -P num       documents in the pool of a topic (default: 2 * depth)\n"
+        "  -z num       zipf exponent of document popularity, higher values\n"
+        "               give more overlap between runs (default: 1.0)\n"
+        "  -S dist      score distribution: linear, uniform, normal or exp\n"
+        "               (default: normal)\n"
+        "  -f format    docno format: numeric or clueweb (default: numeric)\n"
+        "  -l len       digits of numeric docnos (default: 10)\n"
+        "  -x           write the topics of each run in a random order\n"
+        "  -s seed      random seed (default: 1)\n"
+        "  -j threads   threads writing runs (default: online CPUs)\n\n");
+}
+
+static void *
+gen_worker(void *arg)
+{
+    struct gen_task *task = arg;
+    char path[FILENAME_MAX];
+
+    for (size_t i = task->first; i < task->g->opts.nruns; i += task->stride) {
+        struct pf_writer w;
+        FILE *fp;
+        snprintf(path, sizeof(path), "%s/run%zu.run", task->outdir, i + 1);
+        if (!(fp = fopen(path, "w"))) {
+            perror("fopen");
+            exit(EXIT_FAILURE);
+        }
+        pf_writer_init(&w, fp);
+        pf_gen_run(task->g, i, &w);
+        pf_writer_free(&w);
+        fclose(fp);
+    }
+
+    return NULL;
+}
+
+int
+cmd_gen(int argc, char **argv)
+{
+    struct pf_gen_opts opts = {DEFAULT_RUNS, DEFAULT_TOPICS, DEFAULT_DEPTH, 0,
+        1.0, PF_GEN_SCORE_NORMAL, PF_GEN_DOCNO_NUMERIC, DEFAULT_DOCNO_LEN,
+        false, 1};
+    const char *outdir = "gen_runs";
+    long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    struct pf_gen g;
+    int ch;
+
+    while ((ch = getopt(argc, argv, "o:r:T:d:P:z:S:f:l:xs:j:")) != -1) {
+        switch (ch) {
+        case 'o':
+            outdir = optarg;
+            break;
+        case 'r':
+            opts.nruns = strtoul(optarg, NULL, 10);
+            break;
+        case 'T':
+            opts.ntopics = strtoul(optarg, NULL, 10);
+            break;
+        case 'd':
+            opts.depth = strtoul(optarg, NULL, 10);
+            break;
+        case 'P':
+            opts.pool = strtoul(optarg, NULL, 10);
+            break;
+        case 'z':
+            opts.zipf = strtod(optarg, NULL);
+            break;
+        case 'S':
+            opts.score = pf_gen_score_parse(optarg);
+            if (PF_GEN_SCORE_NONE == opts.score) {
+                err_exit("unknown score distribution '%s'", optarg);
+            }
+            break;
+        case 'f':
+            opts.docno = pf_gen_docno_parse(optarg);
+            if (PF_GEN_DOCNO_NONE == opts.docno) {
+                err_exit("unknown docno format '%s'", optarg);
+            }
+            break;
+        case 'l':
+            opts.docno_len = strtoul(optarg, NULL, 10);
+            break;
+        case 'x':
+            opts.shuffle_topics = true;
+            break;
+        case 's':
+            opts.seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'j':
+            nthreads = strtol(optarg, NULL, 10);
+            break;
+        case '?':
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind != argc) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+    if (opts.nruns < 1 || opts.ntopics < 1 || opts.depth < 1) {
+        err_exit("runs, topics and depth must be positive");
+    }
+    if (opts.docno_len > 20) {
+        err_exit("docnos are at most 20 digits");
+    }
+    if (0 == opts.pool) {
+        opts.pool = 2 * opts.depth;
+    }
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+    if ((size_t)nthreads > opts.nruns) {
+        nthreads = opts.nruns;
+    }
+    if (mkdir(outdir, 0755) < 0 && EEXIST != errno) {
+        perror("mkdir");
+        exit(EXIT_FAILURE);
+    }
+
+    pf_gen_init(&g, &opts);
+
+    struct gen_task *task = bmalloc(sizeof(struct gen_task) * nthreads);
+    pthread_t *tid = bmalloc(sizeof(pthread_t) * nthreads);
+    for (long i = 0; i < nthreads; i++) {
+        task[i] = (struct gen_task){&g, outdir, i, nthreads};
+        if (pthread_create(&tid[i], NULL, gen_worker, &task[i])) {
+            err_exit("unable to create thread");
+        }
+    }
+    for (long i = 0; i < nthreads; i++) {
+        pthread_join(tid[i], NULL);
+    }
+
+    free(tid);
+    free(task);
+    pf_gen_free(&g);
+
+    return 0;
+}
@@ -0,0 +1,251 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+/*
+ * `polyfuse learn`: learn the weights of the runs for a fusion method
+ * against qrels, with k-fold cross-validation over the topics.
+ *
+ * The learned weights are written to stdout as a list that can be passed to
+ * `-w`, and the cross-validated metric is reported on stderr.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cmd.h"
+#include "fusetype.h"
+#include "pf_learn.h"
+#include "pf_runset.h"
+#include "trec.h"
+
+#define DEFAULT_FOLDS 5
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+        "usage: polyfuse learn [options] run1 run2 [run3 ...]\n"
+        "\noptions:\n"
+        "  -m method    additive fusion method (default: combsum)\n"
+        "  -q qrels     relevance judgments (required)\n"
+        "  -M metric    metric to maximize: map, ndcg, P, recip_rank or\n"
+        "               recall (default: map)\n"
+        "  -d depth     rank depth of the evaluated runs\n"
+        "  -t           prevent ties\n"
+        "  -f folds     folds of cross-validation, 1 to skip (default: 5)\n"
+        "  -i passes    maximum passes of coordinate ascent (default: 20)\n"
+        "  -j threads   threads evaluating topics (default: online CPUs)\n"
+        "  -n norm      score normalization for combanz, combmnz, combsum\n"
+        "  -p num       rbc user persistence in the range (0.0,1.0)\n"
+        "  -k num       rrf constant to control outlier rankings\n\n");
+}
+
+static void
+print_weights(FILE *stream, const long double *w, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        fprintf(stream, "%s%.21Lg", i ? "," : "", w[i]);
+    }
+    fprintf(stream, "\n");
+}
+
+int
+cmd_learn(int argc, char **argv)
+{
+    struct pf_params params = {TCOMBSUM, 60, 0.8, NULL, false};
+    enum pf_metric metric = PF_METRIC_MAP;
+    enum trec_norm fnorm = TNORM_NONE;
+    const char *metric_str = "map";
+    const char *qrels_path = NULL;
+    size_t depth = 0, folds = DEFAULT_FOLDS, passes = PF_LEARN_PASSES;
+    long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    bool prevent_ties = false;
+    struct pf_qrels *qrels;
+    struct pf_runset *rs = NULL;
+    struct pf_learn l;
+    long double *w;
+    bool *topics;
+    size_t *fold, njudged = 0;
+    int ch;
+
+    while ((ch = getopt(argc, argv, "m:q:M:d:tf:i:j:n:p:k:")) != -1) {
+        switch (ch) {
+        case 'm':
+            params.type = fusetype_parse(optarg);
+            break;
+        case 'q':
+            qrels_path = optarg;
+            break;
+        case 'M':
+            metric_str = optarg;
+            metric = pf_metric_parse(optarg);
+            if (PF_METRIC_NONE == metric) {
+                err_exit("unknown metric '%s'", optarg);
+            }
+            break;
+        case 'd':
+            depth = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            prevent_ties = true;
+            break;
+        case 'f':
+            folds = strtoul(optarg, NULL, 10);
+            break;
+        case 'i':
+            passes = strtoul(optarg, NULL, 10);
+            break;
+        case 'j':
+            nthreads = strtol(optarg, NULL, 10);
+            break;
+        case 'n':
+            fnorm = trec_norm_parse(optarg);
+            if (TNORM_NONE == fnorm) {
+                err_exit("unknown normalization '%s'\n\nvalid normalizations "
+                         "are:\n minmax, sum, minsum, std, cdf, iqr, trim",
+                    optarg);
+            }
+            break;
+        case 'p':
+            params.phi = strtod(optarg, NULL);
+            break;
+        case 'k':
+            params.rrf_k = strtol(optarg, NULL, 10);
+            break;
+        case '?':
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (argc - optind < 2) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+    if (!qrels_path) {
+        err_exit("qrels must be given with `-q`");
+    }
+    if (folds < 1) {
+        err_exit("`folds` is 0");
+    }
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+
+    FILE *fp = fopen(qrels_path, "r");
+    if (!fp) {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+    qrels = pf_qrels_read(fp);
+    fclose(fp);
+
+    for (int i = optind; i < argc; i++) {
+        if (!(fp = fopen(argv[i], "r"))) {
+            perror("fopen");
+            exit(EXIT_FAILURE);
+        }
+        struct trec_run *r = trec_create();
+        trec_read(r, fp);
+        if (fusetype_is_score_based(params.type)) {
+            trec_normalize(r, fnorm);
+        }
+        if (!rs) {
+            rs = pf_runset_create(&r->topics);
+        }
+        pf_runset_add(rs, r);
+        trec_destroy(r);
+        fclose(fp);
+    }
+
+    pf_learn_init(&l, rs, qrels, &params);
+    l.metric = metric;
+    l.passes = passes;
+    l.nthreads = nthreads;
+    l.prevent_ties = prevent_ties;
+    if (depth > 0) {
+        l.depth = depth;
+    }
+
+    fprintf(stderr, "# fusion: %s\n", fusetype_str[params.type]);
+    fprintf(stderr, "# metric: %s\n", metric_str);
+    fprintf(stderr, "# depth: %zu\n", l.depth);
+    fprintf(stderr, "# folds: %zu\n", folds);
+
+    /*
+     * Judged topics are dealt out to the folds in order.
+     */
+    w = bmalloc(sizeof(long double) * rs->nruns);
+    topics = bmalloc(sizeof(bool) * (rs->ntopics + 1));
+    fold = bmalloc(sizeof(size_t) * (rs->ntopics + 1));
+    for (size_t t = 0; t < rs->ntopics; t++) {
+        if (l.judged[t]) {
+            fold[t] = njudged++ % folds;
+        }
+    }
+    if (0 == njudged) {
+        err_exit("no topic of the runs is judged");
+    }
+    if (folds > njudged) {
+        err_exit("%zu folds for %zu judged topics", folds, njudged);
+    }
+
+    if (folds > 1) {
+        long double cv = 0.0;
+        for (size_t f = 0; f < folds; f++) {
+            long double train, test;
+            size_t ntest = 0;
+            for (size_t i = 0; i < rs->nruns; i++) {
+                w[i] = 1.0;
+            }
+            for (size_t t = 0; t < rs->ntopics; t++) {
+                topics[t] = l.judged[t] && fold[t] != f;
+            }
+            train = pf_learn_fit(&l, topics, w);
+            for (size_t t = 0; t < rs->ntopics; t++) {
+                topics[t] = l.judged[t] && fold[t] == f;
+                ntest += topics[t];
+            }
+            test = pf_learn_eval(&l, topics, w);
+            cv += test * ntest;
+            fprintf(stderr, "# fold %zu: train %s %.4Lf test %s %.4Lf, ",
+                f + 1, metric_str, train, metric_str, test);
+            print_weights(stderr, w, rs->nruns);
+        }
+        fprintf(stderr, "# cross-validated %s: %.4Lf\n", metric_str,
+            cv / njudged);
+    }
+
+    /*
+     * The reported weights are learned on all judged topics.
+     */
+    for (size_t t = 0; t < rs->ntopics; t++) {
+        topics[t] = true;
+    }
+    for (size_t i = 0; i < rs->nruns; i++) {
+        w[i] = 1.0;
+    }
+    fprintf(stderr, "# uniform %s: %.4Lf\n", metric_str,
+        pf_learn_eval(&l, topics, w));
+    fprintf(stderr, "# learned %s: %.4Lf\n", metric_str,
+        pf_learn_fit(&l, topics, w));
+    print_weights(stdout, w, rs->nruns);
+
+    pf_learn_free(&l);
+    pf_runset_destroy(rs);
+    pf_qrels_destroy(qrels);
+    free(fold);
+    free(topics);
+    free(w);
+
+    return 0;
+}
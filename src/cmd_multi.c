@@ -0,0 +1,217 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+/*
+ * `polyfuse multi`: read the runs once and write a fused run for each of
+ * several fusion methods.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cmd.h"
+#include "fusetype.h"
+#include "pf_runset.h"
+#include "pf_stats.h"
+#include "pf_trace.h"
+#include "trec.h"
+
+#define DEFAULT_DEPTH 1000
+#define DEFAULT_METHODS                                                   \
+    "borda,combanz,combmax,combmed,combmin,combmnz,combsum,isr,logisr,rbc," \
+    "rrf,condorcet,mc4"
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+        "usage: polyfuse multi [options] run1 run2 [run3 ...]\n"
+        "\noptions:\n"
+        "  -m list      comma separated fusion methods (default: all)\n"
+        "  -o dir       output directory, one <method>.run per method\n"
+        "  -d depth     rank depth of output\n"
+        "  -t           prevent ties\n"
+        "  -q qrels     evaluate each fused run, metrics go to stdout\n"
+        "  -e           only evaluate, do not write the fused runs\n"
+        "  -n norm      score normalization for combanz, ..., combsum\n"
+        "  -p num       rbc user persistence in the range (0.0,1.0)\n"
+        "  -k num       rrf constant to control outlier rankings\n"
+        "  -w list      comma separated weights of the runs, combmed,\n"
+        "               condorcet and mc4 are not weighted\n"
+        "  -E           stop reading runs once the top documents of borda,\n"
+        "               isr, logisr, rbc and rrf are settled\n\n");
+}
+
+int
+cmd_multi(int argc, char **argv)
+{
+    enum fusetype types[TMC4];
+    size_t ntypes;
+    const char *methods = DEFAULT_METHODS;
+    const char *outdir = ".";
+    struct pf_params params = {TNONE, 60, 0.8, NULL, false};
+    enum trec_norm fnorm = TNORM_NONE;
+    size_t depth = DEFAULT_DEPTH;
+    bool prevent_ties = false;
+    bool eval_only = false;
+    const char *qrels_path = NULL;
+    struct pf_qrels *qrels = NULL;
+    struct pf_runset *rs = NULL;
+    long double *weights = NULL;
+    size_t nweights = 0;
+    int ch;
+
+    while ((ch = getopt(argc, argv, "m:o:d:tn:p:k:q:ew:E")) != -1) {
+        switch (ch) {
+        case 'm':
+            methods = optarg;
+            break;
+        case 'o':
+            outdir = optarg;
+            break;
+        case 'd':
+            depth = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            prevent_ties = true;
+            break;
+        case 'n':
+            fnorm = trec_norm_parse(optarg);
+            if (TNORM_NONE == fnorm) {
+                err_exit("unknown normalization '%s'\n\nvalid normalizations "
+                         "are:\n minmax, sum, minsum, std, cdf, iqr, trim",
+                    optarg);
+            }
+            break;
+        case 'p':
+            params.phi = strtod(optarg, NULL);
+            break;
+        case 'k':
+            params.rrf_k = strtol(optarg, NULL, 10);
+            break;
+        case 'q':
+            qrels_path = optarg;
+            break;
+        case 'e':
+            eval_only = true;
+            break;
+        case 'w':
+            free(weights);
+            nweights = parse_ldbl_list(optarg, &weights);
+            break;
+        case 'E':
+            params.early = true;
+            break;
+        case '?':
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (argc - optind < 2) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+    ntypes = fusetype_parse_list(methods, types, TMC4);
+    if (weights && nweights != (size_t)(argc - optind)) {
+        err_exit("%zu run weights given for %d runs", nweights, argc - optind);
+    }
+    params.weights = weights;
+    if (eval_only && !qrels_path) {
+        err_exit("`-e` requires qrels given with `-q`");
+    }
+    if (qrels_path) {
+        FILE *fp = fopen(qrels_path, "r");
+        if (!fp) {
+            perror("fopen");
+            exit(EXIT_FAILURE);
+        }
+        qrels = pf_qrels_read(fp);
+        fclose(fp);
+    }
+    if (!eval_only && mkdir(outdir, 0755) < 0 && EEXIST != errno) {
+        perror("mkdir");
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "# depth: %ld\n", depth);
+    fprintf(stderr, "# fusion: %s\n", methods);
+    fprintf(stderr, "# phi: %Lf\n", params.phi);
+    fprintf(stderr, "# k: %ld\n", params.rrf_k);
+    fprintf(stderr, "# normalization: %s\n", trec_norm_str[fnorm]);
+
+    for (int i = optind; i < argc; i++) {
+        FILE *fp = fopen(argv[i], "r");
+        if (!fp) {
+            perror("fopen");
+            exit(EXIT_FAILURE);
+        }
+        PF_TRACE2(file_open, (intptr_t)argv[i], fileno(fp));
+        struct trec_run *r = trec_create();
+        PF_STATS_ENTER(prev, PF_PHASE_PARSE);
+        trec_read(r, fp);
+        /*
+         * Rank based methods ignore scores, so a single normalized copy
+         * serves every method.
+         */
+        PF_STATS_SWITCH(PF_PHASE_NORMALIZE);
+        trec_normalize(r, fnorm);
+        PF_STATS_SWITCH(PF_PHASE_ACCUMULATE);
+        if (!rs) {
+            rs = pf_runset_create(&r->topics);
+        }
+        pf_runset_add(rs, r);
+        PF_STATS_LEAVE(prev);
+        trec_destroy(r);
+        PF_TRACE1(file_close, fileno(fp));
+        fclose(fp);
+    }
+
+    if (params.early) {
+        pf_runset_index(rs);
+    }
+
+    for (size_t i = 0; i < ntypes; i++) {
+        char path[FILENAME_MAX], runid[64];
+        const char *name = fusetype_str[types[i]];
+        struct pf_eval ev;
+        FILE *out = NULL;
+        snprintf(path, sizeof(path), "%s/%s.run", outdir, name);
+        snprintf(runid, sizeof(runid), "polyfuse-%s", name);
+        if (!eval_only && !(out = fopen(path, "w"))) {
+            perror("fopen");
+            exit(EXIT_FAILURE);
+        }
+        if (qrels) {
+            pf_eval_init(&ev, qrels, PF_EVAL_CUTOFF);
+        }
+        params.type = types[i];
+        PF_STATS_ENTER(prev, PF_PHASE_PRESENT);
+        pf_runset_present(out, rs, &params, runid, depth, prevent_ties,
+            qrels ? &ev : NULL);
+        PF_STATS_LEAVE(prev);
+        if (out) {
+            fclose(out);
+        }
+        if (qrels) {
+            printf("# %s\n", runid);
+            pf_eval_report(&ev, stdout);
+        }
+    }
+    pf_runset_destroy(rs);
+    pf_qrels_destroy(qrels);
+    free(weights);
+
+    return 0;
+}
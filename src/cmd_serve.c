@@ -0,0 +1,427 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+/*
+ * `polyfuse serve`: answer fusion requests over a Unix domain socket, with
+ * runs kept in memory between requests.
+ *
+ * A request is a 4 byte big endian length followed by the request text of
+ * `pf_serve_parse`. The response is a 4 byte big endian status, 0 or 1 for
+ * an error, and a 4 byte big endian length followed by the fused run, the
+ * counters or the error message. A connection may carry any number of
+ * requests.
+ *
+ * The main thread accepts connections and polls those waiting for their
+ * next request. Each complete request is queued for the workers, and its
+ * connection polled again once the response is written, so idle clients
+ * hold no worker.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cmd.h"
+#include "pf_serve.h"
+#include "util.h"
+
+#define DEFAULT_SOCKET "polyfuse.sock"
+#define DEFAULT_BUDGET 1024
+#define DEFAULT_WORKERS 4
+/* requests read but not yet taken by a worker */
+#define QUEUE_MAX 128
+#define MSG_MAX (1 << 20)
+
+/*
+ * A connection and the request being read from it. A connection is `busy`
+ * while a worker answers its request, and is not polled meanwhile.
+ */
+struct conn {
+    int fd;
+    bool busy;
+    unsigned char hdr[4];
+    uint32_t len;
+    size_t got;
+    char *msg;
+};
+
+struct conn_req {
+    int fd;
+    char *msg;
+    uint32_t len;
+};
+
+struct req_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t nonempty;
+    pthread_cond_t nonfull;
+    struct conn_req req[QUEUE_MAX];
+    size_t head;
+    size_t len;
+};
+
+static struct pf_server srv;
+static struct req_queue queue = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+    PTHREAD_COND_INITIALIZER, {{0}}, 0, 0};
+/* workers hand connections back to the main thread through this pipe */
+static int done[2];
+static volatile sig_atomic_t stop = 0;
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+        "usage: polyfuse serve [options] [run1 run2 ...]\n"
+        "\noptions:\n"
+        "  -s path      socket path (default: polyfuse.sock)\n"
+        "  -m MiB       memory budget of resident runs (default: 1024)\n"
+        "  -j threads   requests served at once (default: 4)\n"
+        "\nruns given are read at startup.\n\n");
+}
+
+static void
+on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+static int
+write_full(int fd, const void *buf, size_t n)
+{
+    const char *p = buf;
+
+    while (n) {
+        ssize_t r = write(fd, p, n);
+        if (r < 0 && EINTR == errno) {
+            continue;
+        } else if (r < 0) {
+            return -1;
+        }
+        p += r;
+        n -= r;
+    }
+
+    return 0;
+}
+
+static void
+put_be32(unsigned char *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/*
+ * Answer one request and hand its connection back, or close it if the
+ * response could not be written.
+ */
+static void
+serve_req(struct pf_writer *out, const struct conn_req *req)
+{
+    unsigned char hdr[8];
+    int status, fd = req->fd;
+
+    out->len = 0;
+    status = pf_server_request(&srv, req->msg, req->len, out);
+    put_be32(hdr, status < 0);
+    put_be32(hdr + 4, out->len);
+    if (write_full(req->fd, hdr, 8) < 0 ||
+        write_full(req->fd, out->buf, out->len) < 0) {
+        /* the main thread closes it */
+        fd = -1 - fd;
+    }
+    if (write_full(done[1], &fd, sizeof(fd)) < 0) {
+        err_exit("unable to hand back a connection");
+    }
+}
+
+static void *
+worker(void *arg)
+{
+    struct pf_writer out;
+
+    (void)arg;
+    pf_writer_init_mem(&out);
+    for (;;) {
+        struct conn_req req;
+        pthread_mutex_lock(&queue.lock);
+        while (0 == queue.len) {
+            pthread_cond_wait(&queue.nonempty, &queue.lock);
+        }
+        req = queue.req[queue.head];
+        queue.head = (queue.head + 1) % QUEUE_MAX;
+        queue.len--;
+        pthread_cond_signal(&queue.nonfull);
+        pthread_mutex_unlock(&queue.lock);
+        pf_server_queue(&srv, -1);
+
+        serve_req(&out, &req);
+        free(req.msg);
+    }
+    pf_writer_free(&out);
+
+    return NULL;
+}
+
+static void
+enqueue(int fd, char *msg, uint32_t len)
+{
+    pthread_mutex_lock(&queue.lock);
+    while (QUEUE_MAX == queue.len) {
+        pthread_cond_wait(&queue.nonfull, &queue.lock);
+    }
+    queue.req[(queue.head + queue.len) % QUEUE_MAX] =
+        (struct conn_req){fd, msg, len};
+    queue.len++;
+    pf_server_queue(&srv, 1);
+    pthread_cond_signal(&queue.nonempty);
+    pthread_mutex_unlock(&queue.lock);
+}
+
+/*
+ * Read what `c` has ready without blocking, and queue its request once it
+ * is complete. Returns -1 if the connection is to be closed.
+ */
+static int
+conn_read(struct conn *c)
+{
+    ssize_t r;
+
+    if (c->got < 4) {
+        r = recv(c->fd, c->hdr + c->got, 4 - c->got, MSG_DONTWAIT);
+    } else {
+        r = recv(c->fd, c->msg + c->got - 4, c->len - (c->got - 4),
+            MSG_DONTWAIT);
+    }
+    if (r < 0 && (EINTR == errno || EAGAIN == errno ||
+                     EWOULDBLOCK == errno)) {
+        return 0;
+    } else if (r <= 0) {
+        return -1;
+    }
+    c->got += r;
+    if (4 == c->got) {
+        c->len = (uint32_t)c->hdr[0] << 24 | c->hdr[1] << 16 |
+                 c->hdr[2] << 8 | c->hdr[3];
+        if (c->len > MSG_MAX) {
+            return -1;
+        }
+        c->msg = bmalloc(c->len + 1);
+    }
+    if (c->got >= 4 && c->got - 4 == c->len) {
+        c->busy = true;
+        enqueue(c->fd, c->msg, c->len);
+        c->msg = NULL;
+        c->got = 0;
+    }
+
+    return 0;
+}
+
+static void
+conn_close(struct conn *conns, size_t *nconns, size_t i)
+{
+    close(conns[i].fd);
+    free(conns[i].msg);
+    conns[i] = conns[--*nconns];
+}
+
+/*
+ * Take back the connections whose responses the workers wrote.
+ */
+static void
+conn_done(struct conn *conns, size_t *nconns)
+{
+    int fd;
+
+    while (read(done[0], &fd, sizeof(fd)) == sizeof(fd)) {
+        bool failed = fd < 0;
+        if (failed) {
+            fd = -1 - fd;
+        }
+        for (size_t i = 0; i < *nconns; i++) {
+            if (conns[i].fd == fd) {
+                conns[i].busy = false;
+                if (failed) {
+                    conn_close(conns, nconns, i);
+                }
+                break;
+            }
+        }
+    }
+}
+
+static int
+listen_on(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        err_exit("socket path '%s' is too long", path);
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        exit(EXIT_FAILURE);
+    }
+    if (listen(fd, QUEUE_MAX) < 0) {
+        perror("listen");
+        exit(EXIT_FAILURE);
+    }
+
+    return fd;
+}
+
+int
+cmd_serve(int argc, char **argv)
+{
+    const char *path = DEFAULT_SOCKET;
+    size_t budget = DEFAULT_BUDGET;
+    long nworkers = DEFAULT_WORKERS;
+    struct conn *conns = NULL;
+    struct pollfd *pfd = NULL;
+    size_t nconns = 0, alloc = 0;
+    struct sigaction sa;
+    char err[512];
+    int ch, lfd;
+
+    while ((ch = getopt(argc, argv, "s:m:j:")) != -1) {
+        switch (ch) {
+        case 's':
+            path = optarg;
+            break;
+        case 'm':
+            budget = strtoul(optarg, NULL, 10);
+            break;
+        case 'j':
+            nworkers = strtol(optarg, NULL, 10);
+            break;
+        case '?':
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (nworkers < 1) {
+        nworkers = 1;
+    }
+
+    pf_server_init(&srv, budget << 20);
+    for (int i = optind; i < argc; i++) {
+        struct pf_cache_entry *e;
+        if (!(e = pf_cache_get(&srv.cache, argv[i], TNORM_NONE, err,
+                  sizeof(err)))) {
+            err_exit("%s", err);
+        }
+        pf_cache_put(&srv.cache, e);
+    }
+
+    /* no SA_RESTART, so a signal interrupts `accept` */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    lfd = listen_on(path);
+    if (pipe(done) < 0 || fcntl(done[0], F_SETFL, O_NONBLOCK) < 0) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    for (long i = 0; i < nworkers; i++) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, worker, NULL)) {
+            err_exit("unable to create thread");
+        }
+        pthread_detach(tid);
+    }
+
+    while (!stop) {
+        size_t npoll = 2;
+        pfd = brealloc(pfd, sizeof(struct pollfd) * (nconns + 2));
+        pfd[0] = (struct pollfd){lfd, POLLIN, 0};
+        pfd[1] = (struct pollfd){done[0], POLLIN, 0};
+        for (size_t i = 0; i < nconns; i++) {
+            if (!conns[i].busy) {
+                pfd[npoll++] = (struct pollfd){conns[i].fd, POLLIN, 0};
+            }
+        }
+        if (poll(pfd, npoll, -1) < 0) {
+            if (EINTR != errno) {
+                perror("poll");
+                break;
+            }
+            continue;
+        }
+        /* reading first, as a connection handed back may be closed */
+        for (size_t k = 2; k < npoll; k++) {
+            if (!pfd[k].revents) {
+                continue;
+            }
+            for (size_t i = 0; i < nconns; i++) {
+                if (conns[i].fd == pfd[k].fd) {
+                    if (conn_read(&conns[i]) < 0) {
+                        conn_close(conns, &nconns, i);
+                    }
+                    break;
+                }
+            }
+        }
+        if (pfd[1].revents) {
+            conn_done(conns, &nconns);
+        }
+        if (pfd[0].revents) {
+            int fd = accept(lfd, NULL, NULL);
+            if (fd < 0) {
+                if (EINTR != errno && ECONNABORTED != errno) {
+                    perror("accept");
+                    break;
+                }
+                continue;
+            }
+            if (nconns == alloc) {
+                alloc = alloc ? alloc * 2 : 16;
+                conns = brealloc(conns, sizeof(struct conn) * alloc);
+            }
+            conns[nconns++] = (struct conn){fd, false, {0}, 0, 0, NULL};
+        }
+    }
+
+    /* connections still open are dropped with the process */
+    close(lfd);
+    unlink(path);
+    free(pfd);
+    free(conns);
+
+    return 0;
+}
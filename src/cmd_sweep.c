@@ -0,0 +1,379 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+/*
+ * `polyfuse sweep`: fuse a grid of methods, RRF `k`, RBC `phi`, score
+ * normalizations and output depths from runs that are parsed only once.
+ *
+ * Each parameter point is fused once from the postings of a run set and its
+ * ranking is written at every output depth.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cmd.h"
+#include "fusetype.h"
+#include "pf_runset.h"
+#include "polyfuse.h"
+#include "trec.h"
+
+#define DEFAULT_METHODS                                                   \
+    "borda,combanz,combmax,combmed,combmin,combmnz,combsum,isr,logisr,rbc," \
+    "rrf,condorcet,mc4"
+#define DEFAULT_DEPTHS "100,1000"
+#define DEFAULT_NORMS "minmax,std,sum,minsum"
+#define DEFAULT_PHIS "0.0,0.1,0.2,0.3,0.4,0.5,0.6,0.7,0.8,0.9,1.0"
+#define DEFAULT_KS "10,60,100,600"
+
+/*
+ * A comma separated option split into its tokens, which also label the
+ * output files.
+ */
+struct sweep_list {
+    char **str;
+    size_t len;
+};
+
+struct sweep {
+    const char *outdir;
+    struct sweep_list depths;
+    bool prevent_ties;
+    bool eval_only;
+    struct pf_qrels *qrels;
+    struct pf_topk tk;
+};
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+        "usage: polyfuse sweep [options] run1 run2 [run3 ...]\n"
+        "\noptions:\n"
+        "  -m list      fusion methods (default: all)\n"
+        "  -o dir       output directory (default: fusion_output)\n"
+        "  -d list      rank depths of output (default: " DEFAULT_DEPTHS ")\n"
+        "  -t           prevent ties\n"
+        "  -n list      score normalizations for combanz, ..., combsum\n"
+        "               (default: " DEFAULT_NORMS ")\n"
+        "  -p list      rbc user persistence values\n"
+        "               (default: " DEFAULT_PHIS ")\n"
+        "  -k list      rrf constants (default: " DEFAULT_KS ")\n"
+        "  -q qrels     evaluate each point, metrics go to stdout\n"
+        "  -e           only evaluate, do not write the fused runs\n\n");
+}
+
+static struct sweep_list
+split_list(const char *s)
+{
+    struct sweep_list l = {NULL, 0};
+    char *save = NULL, *dup = strdup(s);
+    size_t alloc = 1;
+
+    for (const char *p = s; *p; p++) {
+        alloc += ',' == *p;
+    }
+    l.str = bmalloc(sizeof(char *) * alloc);
+    for (char *tok = strtok_r(dup, ",", &save); tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        l.str[l.len++] = strdup(tok);
+    }
+    free(dup);
+
+    if (0 == l.len) {
+        err_exit("empty list '%s'", s);
+    }
+
+    return l;
+}
+
+static void
+free_list(struct sweep_list *l)
+{
+    for (size_t i = 0; i < l->len; i++) {
+        free(l->str[i]);
+    }
+    free(l->str);
+}
+
+static FILE *
+open_output(const char *outdir, const char *name)
+{
+    char path[FILENAME_MAX];
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/%s.run", outdir, name);
+    if (!(fp = fopen(path, "w"))) {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+
+    return fp;
+}
+
+/*
+ * Fuse one parameter point and write it at every depth. `label` is the
+ * parameter suffix of the output file names.
+ */
+static void
+sweep_point(struct sweep *sw, const struct pf_runset *rs,
+    const struct pf_params *params, const char *label)
+{
+    const char *name = fusetype_str[params->type];
+    size_t ndepths = sw->depths.len;
+    FILE **out = bmalloc(sizeof(FILE *) * ndepths);
+    struct pf_writer *w = bmalloc(sizeof(struct pf_writer) * ndepths);
+    struct pf_eval *ev = bmalloc(sizeof(struct pf_eval) * ndepths);
+    size_t *depth = bmalloc(sizeof(size_t) * ndepths);
+    size_t max_depth = 0;
+    char runid[64];
+    char (*fname)[256] = bmalloc(sizeof(*fname) * ndepths);
+
+    for (size_t i = 0; i < ndepths; i++) {
+        snprintf(fname[i], sizeof(fname[i]), "%s_depth:%s%s", name,
+            sw->depths.str[i], label);
+        out[i] = sw->eval_only ? NULL : open_output(sw->outdir, fname[i]);
+        if (out[i]) {
+            pf_writer_init(&w[i], out[i]);
+        }
+        if (sw->qrels) {
+            pf_eval_init(&ev[i], sw->qrels, PF_EVAL_CUTOFF);
+        }
+        depth[i] = strtoul(sw->depths.str[i], NULL, 10);
+        if (depth[i] < 1) {
+            err_exit("`depth` is 0");
+        }
+        if (depth[i] > rs->max_rank) {
+            depth[i] = rs->max_rank;
+        }
+        if (depth[i] > max_depth) {
+            max_depth = depth[i];
+        }
+    }
+    snprintf(runid, sizeof(runid), "polyfuse-%s", name);
+
+    for (size_t t = 0; t < rs->ntopics; t++) {
+        int qid = rs->topics[t].qid;
+        pf_runset_rank(rs, t, params, max_depth, &sw->tk);
+        for (size_t i = 0; i < ndepths; i++) {
+            if (sw->qrels) {
+                pf_eval_topic(
+                    &ev[i], qid, &sw->tk, depth[i], sw->prevent_ties);
+            }
+            if (out[i]) {
+                pf_present_topic(&w[i], qid, &sw->tk, depth[i], runid,
+                    sw->prevent_ties);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < ndepths; i++) {
+        if (out[i]) {
+            pf_writer_free(&w[i]);
+            fclose(out[i]);
+        }
+        if (sw->qrels) {
+            printf("# %s\n", fname[i]);
+            pf_eval_report(&ev[i], stdout);
+        }
+    }
+    free(fname);
+    free(depth);
+    free(ev);
+    free(w);
+    free(out);
+}
+
+int
+cmd_sweep(int argc, char **argv)
+{
+    enum fusetype types[TMC4];
+    size_t ntypes;
+    const char *methods = DEFAULT_METHODS;
+    struct sweep_list norms, phis, ks;
+    const char *norm_str = DEFAULT_NORMS, *phi_str = DEFAULT_PHIS;
+    const char *k_str = DEFAULT_KS, *depth_str = DEFAULT_DEPTHS;
+    struct sweep sw = {"fusion_output", {NULL, 0}, false, false, NULL, {0}};
+    const char *qrels_path = NULL;
+    struct trec_run **runs;
+    pf_score_t **raw;
+    size_t nruns;
+    bool need_norm = false;
+    int ch;
+
+    while ((ch = getopt(argc, argv, "m:o:d:tn:p:k:q:e")) != -1) {
+        switch (ch) {
+        case 'm':
+            methods = optarg;
+            break;
+        case 'o':
+            sw.outdir = optarg;
+            break;
+        case 'd':
+            depth_str = optarg;
+            break;
+        case 't':
+            sw.prevent_ties = true;
+            break;
+        case 'n':
+            norm_str = optarg;
+            break;
+        case 'p':
+            phi_str = optarg;
+            break;
+        case 'k':
+            k_str = optarg;
+            break;
+        case 'q':
+            qrels_path = optarg;
+            break;
+        case 'e':
+            sw.eval_only = true;
+            break;
+        case '?':
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (argc - optind < 2) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    ntypes = fusetype_parse_list(methods, types, TMC4);
+    sw.depths = split_list(depth_str);
+    norms = split_list(norm_str);
+    phis = split_list(phi_str);
+    ks = split_list(k_str);
+    for (size_t i = 0; i < norms.len; i++) {
+        if (TNORM_NONE == trec_norm_parse(norms.str[i])) {
+            err_exit("unknown normalization '%s'\n\nvalid normalizations "
+                     "are:\n minmax, sum, minsum, std, cdf, iqr, trim",
+                norms.str[i]);
+        }
+    }
+    for (size_t i = 0; i < ntypes; i++) {
+        need_norm |= fusetype_is_score_based(types[i]);
+    }
+    if (sw.eval_only && !qrels_path) {
+        err_exit("`-e` requires qrels given with `-q`");
+    }
+    if (qrels_path) {
+        FILE *fp = fopen(qrels_path, "r");
+        if (!fp) {
+            perror("fopen");
+            exit(EXIT_FAILURE);
+        }
+        sw.qrels = pf_qrels_read(fp);
+        fclose(fp);
+    }
+    if (!sw.eval_only && mkdir(sw.outdir, 0755) < 0 && EEXIST != errno) {
+        perror("mkdir");
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "# depth: %s\n", depth_str);
+    fprintf(stderr, "# fusion: %s\n", methods);
+    fprintf(stderr, "# phi: %s\n", phi_str);
+    fprintf(stderr, "# k: %s\n", k_str);
+    fprintf(stderr, "# normalization: %s\n", norm_str);
+
+    /*
+     * Parse every run once, keeping the raw scores so each normalization
+     * starts from the original values.
+     */
+    nruns = argc - optind;
+    runs = bmalloc(sizeof(struct trec_run *) * nruns);
+    raw = bmalloc(sizeof(pf_score_t *) * nruns);
+    for (size_t i = 0; i < nruns; i++) {
+        FILE *fp = fopen(argv[optind + i], "r");
+        if (!fp) {
+            perror("fopen");
+            exit(EXIT_FAILURE);
+        }
+        runs[i] = trec_create();
+        trec_read(runs[i], fp);
+        fclose(fp);
+        raw[i] = bmalloc(sizeof(pf_score_t) * (runs[i]->len + 1));
+        for (size_t j = 0; j < runs[i]->len; j++) {
+            raw[i][j] = runs[i]->ary[j].score;
+        }
+    }
+
+    /*
+     * Rank based methods do not depend on scores, so they share the run set
+     * built from the raw scores.
+     */
+    struct pf_runset *rs = pf_runset_create(&runs[0]->topics);
+    for (size_t i = 0; i < nruns; i++) {
+        pf_runset_add(rs, runs[i]);
+    }
+
+    for (size_t m = 0; m < ntypes; m++) {
+        struct pf_params params = {types[m], 60, 0.8, NULL, false};
+        char label[64];
+        if (TRRF == types[m]) {
+            for (size_t i = 0; i < ks.len; i++) {
+                params.rrf_k = strtol(ks.str[i], NULL, 10);
+                snprintf(label, sizeof(label), "_k:%s", ks.str[i]);
+                sweep_point(&sw, rs, &params, label);
+            }
+        } else if (TRBC == types[m]) {
+            for (size_t i = 0; i < phis.len; i++) {
+                params.phi = strtod(phis.str[i], NULL);
+                snprintf(label, sizeof(label), "_p:%s", phis.str[i]);
+                sweep_point(&sw, rs, &params, label);
+            }
+        } else if (!fusetype_is_score_based(types[m])) {
+            sweep_point(&sw, rs, &params, "");
+        }
+    }
+
+    for (size_t n = 0; need_norm && n < norms.len; n++) {
+        struct pf_runset *nrs = pf_runset_create(&runs[0]->topics);
+        for (size_t i = 0; i < nruns; i++) {
+            for (size_t j = 0; j < runs[i]->len; j++) {
+                runs[i]->ary[j].score = raw[i][j];
+            }
+            trec_normalize(runs[i], trec_norm_parse(norms.str[n]));
+            pf_runset_add(nrs, runs[i]);
+        }
+        for (size_t m = 0; m < ntypes; m++) {
+            if (fusetype_is_score_based(types[m])) {
+                struct pf_params params = {types[m], 60, 0.8, NULL, false};
+                char label[64];
+                snprintf(label, sizeof(label), "_norm:%s", norms.str[n]);
+                sweep_point(&sw, nrs, &params, label);
+            }
+        }
+        pf_runset_destroy(nrs);
+    }
+
+    pf_runset_destroy(rs);
+    pf_qrels_destroy(sw.qrels);
+    for (size_t i = 0; i < nruns; i++) {
+        trec_destroy(runs[i]);
+        free(raw[i]);
+    }
+    free(runs);
+    free(raw);
+    pf_topk_free(&sw.tk);
+    free_list(&sw.depths);
+    free_list(&norms);
+    free_list(&phis);
+    free_list(&ks);
+
+    return 0;
+}
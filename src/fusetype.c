@@ -0,0 +1,120 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fusetype.h"
+#include "util.h"
+
+const char *fusetype_str[] = {
+    "", /* TNONE */
+    "combanz",
+    "combmax",
+    "combmed",
+    "combmin",
+    "combmnz",
+    "combsum",
+    "rbc",
+    "rrf",
+    "borda",
+    "isr",
+    "logisr",
+    "condorcet",
+    "mc4",
+};
+
+/*
+ * Map a fusion method name to its type. Returns `TNONE` if unknown.
+ */
+enum fusetype
+fusetype_parse(const char *s)
+{
+    for (size_t i = TNONE + 1; i <= TMC4; i++) {
+        if (0 == strcmp(fusetype_str[i], s)) {
+            return (enum fusetype)i;
+        }
+    }
+
+    return TNONE;
+}
+
+/*
+ * Parse a comma separated list of fusion methods into `types`. Exits on an
+ * unknown method. Returns the number of methods.
+ */
+size_t
+fusetype_parse_list(const char *list, enum fusetype *types, size_t max)
+{
+    char *save = NULL, *dup = strdup(list);
+    size_t n = 0;
+
+    for (char *tok = strtok_r(dup, ",", &save); tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        enum fusetype type = fusetype_parse(tok);
+        if (TNONE == type) {
+            err_exit("unknown fusion command '%s'", tok);
+        }
+        if (n == max) {
+            err_exit("too many fusion methods");
+        }
+        types[n++] = type;
+    }
+    free(dup);
+
+    return n;
+}
+
+bool
+fusetype_is_score_based(enum fusetype type)
+{
+    switch (type) {
+    case TCOMBANZ:
+    case TCOMBMAX:
+    case TCOMBMED:
+    case TCOMBMIN:
+    case TCOMBMNZ:
+    case TCOMBSUM:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+ * Whether `type` sums the contributions of runs, rather than taking their
+ * minimum, maximum or median.
+ */
+bool
+fusetype_is_sum(enum fusetype type)
+{
+    switch (type) {
+    case TBORDA:
+    case TCOMBANZ:
+    case TCOMBMNZ:
+    case TCOMBSUM:
+    case TISR:
+    case TLOGISR:
+    case TRBC:
+    case TRRF:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+ * Whether `type` compares documents pairwise by their ranks in every run,
+ * which needs all runs at once and takes no run weights.
+ */
+bool
+fusetype_is_pairwise(enum fusetype type)
+{
+    return TCONDORCET == type || TMC4 == type;
+}
@@ -10,6 +10,9 @@
 #ifndef FUSETYPE_H
 #define FUSETYPE_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 enum fusetype {
     TNONE = 0,
     TCOMBANZ,
@@ -23,6 +26,26 @@ enum fusetype {
     TBORDA,
     TISR,
     TLOGISR,
+    TCONDORCET,
+    TMC4,
 };
 
+// the indices must align with `enum fusetype` entries
+extern const char *fusetype_str[];
+
+enum fusetype
+fusetype_parse(const char *s);
+
+size_t
+fusetype_parse_list(const char *list, enum fusetype *types, size_t max);
+
+bool
+fusetype_is_score_based(enum fusetype type);
+
+bool
+fusetype_is_sum(enum fusetype type);
+
+bool
+fusetype_is_pairwise(enum fusetype type);
+
 #endif /* FUSETYPE_H */
@@ -14,7 +14,13 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "cmd.h"
 #include "fusetype.h"
+#include "pf_mc4.h"
+#include "pf_prefetch.h"
+#include "pf_spill.h"
+#include "pf_stats.h"
+#include "pf_trace.h"
 #include "polyfuse.h"
 #include "trec.h"
 
@@ -26,22 +32,36 @@
 #define FCOMBMIN "combmin"
 #define FCOMBMNZ "combmnz"
 #define FCOMBSUM "combsum"
+#define FCONDORCET "condorcet"
 #define FISR "isr"
 #define FLOGISR "logisr"
+#define FMC4 "mc4"
 #define FRBC "rbc"
 #define FRRF "rrf"
-#define CMDSTR_LEN 8
+#define CMDSTR_LEN 16
 #define AVAILCMDS                                                          \
     "  borda, combanz, combmax, combmed, combmin, combmnz, combsum, isr, " \
-    "logisr, rbc, rrf",
+    "logisr, rbc, rrf, condorcet, mc4",
 
 static enum fusetype cmd = TNONE;
 static char cmd_str[CMDSTR_LEN] = {0};
 static long double phi = 0.8;
 static long rrf_k = 60;
+static double mc4_tol = PF_MC4_TOL;
+static size_t mc4_iters = PF_MC4_ITERS;
+static long nthreads = 0;
 static enum trec_norm fnorm = TNORM_NONE;
+static enum trec_norm_scope norm_scope = TNORM_RUN;
 static size_t depth = DEFAULT_DEPTH;
 static bool prevent_ties = false;
+static bool eval_only = false;
+static bool uqv = false;
+static size_t group = 0;
+static bool reproducible = false;
+static const char *qrels_path = NULL;
+static long double *run_weights = NULL;
+static size_t nweights = 0;
+static struct pf_prefetch *prefetch = NULL;
 char *runid = NULL;
 // the indices must align with `enum fusetype` entries
 const char *default_runid[] = {
@@ -57,6 +77,8 @@ const char *default_runid[] = {
     "polyfuse-borda",
     "polyfuse-isr",
     "polyfuse-logisr",
+    "polyfuse-condorcet",
+    "polyfuse-mc4",
 };
 
 static int
@@ -68,79 +90,360 @@ usage(void);
 static void
 present_args();
 
-static enum trec_norm
-strtonorm(const char *s);
+static int
+fuse(int argc, char **argv);
 
+/*
+ * Remove `--stats` and `--stats=json` from the arguments, wherever they
+ * are, and start collecting statistics. Returns the new `argc`.
+ */
+static int
+parse_stats(int argc, char **argv)
+{
+    int n = 1;
+
+    for (int i = 1; i < argc; i++) {
+        bool text = 0 == strcmp(argv[i], "--stats");
+        bool json = 0 == strcmp(argv[i], "--stats=json");
+        if (!text && !json) {
+            argv[n++] = argv[i];
+            continue;
+        }
+#ifdef PF_STATS
+        pf_stats_enable(json);
+#else
+        err_exit("polyfuse was built without statistics, rebuild with "
+                 "`make STATS=1`");
+#endif
+    }
+    argv[n] = NULL;
+
+    return n;
+}
+
+/*
+ * Open the next run, which `prefetch` has been reading ahead.
+ */
 static FILE *
 next_file(int argc, char **argv)
 {
     FILE *fp = NULL;
+    const char *path;
 
     if (argc < 1) {
         return fp;
     }
-    if (!(fp = fopen(argv[optind++], "r"))) {
-        perror("fopen");
-        exit(EXIT_FAILURE);
-    }
+    path = argv[optind++];
+    fp = pf_prefetch_next(prefetch);
+    PF_TRACE2(file_open, (intptr_t)path, fileno(fp));
 
     return fp;
 }
 
-static bool
-is_score_based(enum fusetype type)
+int
+main(int argc, char **argv)
 {
-    switch (type) {
-    case TCOMBANZ:
-    case TCOMBMAX:
-    case TCOMBMED:
-    case TCOMBMIN:
-    case TCOMBMNZ:
-    case TCOMBSUM:
-        return true;
-    default:
-        return false;
+    int ret;
+
+    argc = parse_stats(argc, argv);
+    if (argc > 1 && 0 == strcmp(argv[1], "batch")) {
+        ret = cmd_batch(argc - 1, argv + 1);
+    } else if (argc > 1 && 0 == strcmp(argv[1], "gen")) {
+        ret = cmd_gen(argc - 1, argv + 1);
+    } else if (argc > 1 && 0 == strcmp(argv[1], "learn")) {
+        ret = cmd_learn(argc - 1, argv + 1);
+    } else if (argc > 1 && 0 == strcmp(argv[1], "multi")) {
+        ret = cmd_multi(argc - 1, argv + 1);
+    } else if (argc > 1 && 0 == strcmp(argv[1], "serve")) {
+        ret = cmd_serve(argc - 1, argv + 1);
+    } else if (argc > 1 && 0 == strcmp(argv[1], "sweep")) {
+        ret = cmd_sweep(argc - 1, argv + 1);
+    } else {
+        ret = fuse(argc, argv);
     }
+#ifdef PF_STATS
+    pf_stats_report(stderr);
+#endif
+
+    return ret;
 }
 
-int
-main(int argc, char **argv)
+/*
+ * Fuse the runs named by `argv`, each a single list per topic. With `-g`
+ * every `group` runs are fused apart and spilled to disk, then merged.
+ */
+static void
+fuse_runs(int left, char **argv, struct pf_eval *ev)
 {
-    int left;
-    bool first = true;
+    struct trec_topic topics = {0};
+    struct pf_spill spill;
+    struct pf_ctx *ctx = NULL;
+    size_t max_rank = 0;
     FILE *fp;
 
-    left = parse_opt(argc, argv);
-    present_args();
-
-    for (size_t i = left; (fp = next_file(i, argv)) != NULL; i--) {
+    pf_spill_init(&spill, cmd);
+    for (size_t i = left, n = 0; (fp = next_file(i, argv)) != NULL; i--, n++) {
         struct trec_run *r = trec_create();
-        trec_read(r, fp);
-        if (is_score_based(cmd)) {
+        /*
+         * Score based fusion measures are normalized while parsing.
+         */
+        PF_STATS_ENTER(prev, PF_PHASE_PARSE);
+        trec_read_norm(r, fp, fnorm, norm_scope);
+        PF_STATS_LEAVE(prev);
+        if (!topics.ary) {
             /*
-             * Normalize score based fusion measures.
+             * All run files are assumed to have the same topics and are taken
+             * from the first file given on the commandline.
              */
-            trec_normalize(r, fnorm);
+            topics.len = topics.alloc = r->topics.len;
+            topics.ary = bmalloc(sizeof(int) * (topics.len + 1));
+            memcpy(topics.ary, r->topics.ary, sizeof(int) * topics.len);
         }
-        if (first) {
+        if (!ctx) {
             /*
-             * All run files are assumed to have the same topics and are taken
-             * from the first file given on the commandline.
+             * A group starts with the RBC depth of the runs before it, as
+             * `pf_accumulate` skips ranks deeper than that.
              */
-            pf_set_fusion(cmd);
-            pf_set_rrf_k(rrf_k);
-            pf_init(&r->topics);
-            first = false;
+            ctx = pf_ctx_create();
+            pf_set_fusion(ctx, cmd);
+            pf_set_rrf_k(ctx, rrf_k);
+            pf_set_reproducible(ctx, reproducible);
+            pf_set_mc4(ctx, mc4_tol, mc4_iters);
+            pf_set_threads(ctx, nthreads);
+            pf_init(ctx, &topics);
+            pf_weight_alloc(ctx, phi, max_rank);
         }
 
-        pf_weight_alloc(phi, r->max_rank);
-        pf_accumulate(r);
+        pf_weight_alloc(ctx, phi, r->max_rank);
+        if (r->max_rank > max_rank) {
+            max_rank = r->max_rank;
+        }
+        if (run_weights) {
+            pf_set_run_weight(ctx, run_weights[n]);
+        }
+        PF_STATS_ENTER(acc_prev, PF_PHASE_ACCUMULATE);
+        pf_accumulate(ctx, r);
+        PF_STATS_LEAVE(acc_prev);
         trec_destroy(r);
+        PF_TRACE1(file_close, fileno(fp));
         fclose(fp);
+
+        if (group && 0 == (n + 1) % group) {
+            pf_spill_add(&spill, ctx);
+            pf_ctx_destroy(ctx);
+            ctx = NULL;
+        }
     }
 
-    pf_present(stdout, runid, depth, prevent_ties);
-    pf_destory();
+    if (group) {
+        struct pf_writer w;
+        if (ctx) {
+            pf_spill_add(&spill, ctx);
+            pf_ctx_destroy(ctx);
+        }
+        ctx = pf_ctx_create();
+        pf_set_fusion(ctx, cmd);
+        pf_init(ctx, &topics);
+        pf_weight_alloc(ctx, phi, max_rank);
+        if (ev) {
+            pf_set_eval(ctx, ev);
+        }
+        PF_STATS_ENTER(prev, PF_PHASE_PRESENT);
+        pf_writer_init(&w, stdout);
+        pf_spill_present(
+            &spill, ctx, eval_only ? NULL : &w, runid, depth, prevent_ties);
+        PF_STATS_SWITCH(PF_PHASE_WRITE);
+        pf_writer_free(&w);
+        PF_STATS_LEAVE(prev);
+    } else {
+        if (ev) {
+            pf_set_eval(ctx, ev);
+        }
+        PF_STATS_ENTER(prev, PF_PHASE_PRESENT);
+        pf_present(ctx, eval_only ? NULL : stdout, runid, depth, prevent_ties);
+        PF_STATS_LEAVE(prev);
+    }
+    pf_ctx_destroy(ctx);
+    pf_spill_free(&spill);
+    free(topics.ary);
+}
+
+/*
+ * The ranking of one query variant in a run read with `trec_read_uqv`.
+ */
+struct uqv_list {
+    size_t run;
+    struct trec_run view;
+};
+
+static int
+int_cmp(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Order lists by base topic, then by run and position in the run.
+ */
+static int
+uqv_list_cmp(const void *a, const void *b)
+{
+    const struct uqv_list *x = a, *y = b;
+    int cmp = int_cmp(&x->view.ary->qid, &y->view.ary->qid);
+
+    if (0 == cmp) {
+        cmp = (x->run > y->run) - (x->run < y->run);
+    }
+    if (0 == cmp) {
+        cmp = (x->view.ary > y->view.ary) - (x->view.ary < y->view.ary);
+    }
+
+    return cmp;
+}
+
+/*
+ * Fuse runs of query variants with `-u`. The ranking of every variant is a
+ * run of its own within its base topic: it is normalized alone, Borda
+ * counts over its length and RBC weights reach its depth. Each base topic
+ * is fused apart and written in topic order, as `uqvconvert/uqvpolyfuse.sh`
+ * did with a file per variant and a process per topic. Topics are taken
+ * from the first run.
+ */
+static void
+fuse_uqv(int left, char **argv, struct pf_eval *ev)
+{
+    struct trec_run **runs = bmalloc(sizeof(struct trec_run *) * left);
+    struct uqv_list *lists = NULL;
+    size_t nruns = 0, nlists = 0, alloc = 0, ntopics;
+    int *topics;
+    FILE *fp;
+
+    for (size_t i = left; (fp = next_file(i, argv)) != NULL; i--, nruns++) {
+        struct trec_run *r = runs[nruns] = trec_create();
+        PF_STATS_ENTER(prev, PF_PHASE_PARSE);
+        trec_read_uqv(r, fp);
+        PF_STATS_LEAVE(prev);
+        PF_TRACE1(file_close, fileno(fp));
+        fclose(fp);
+        for (size_t j = 0; j < r->len; j++) {
+            if (1 == r->ary[j].rank) {
+                if (nlists == alloc) {
+                    alloc = alloc ? alloc * 2 : 64;
+                    lists = brealloc(lists, sizeof(struct uqv_list) * alloc);
+                }
+                memset(&lists[nlists], 0, sizeof(struct uqv_list));
+                lists[nlists].run = nruns;
+                lists[nlists++].view.ary = &r->ary[j];
+            }
+            lists[nlists - 1].view.len++;
+        }
+    }
+
+    for (size_t i = 0; i < nlists; i++) {
+        struct trec_run *view = &lists[i].view;
+        view->alloc = view->max_rank = view->len;
+        if (fusetype_is_score_based(cmd)) {
+            PF_STATS_ENTER(norm_prev, PF_PHASE_NORMALIZE);
+            trec_normalize(view, fnorm);
+            PF_STATS_LEAVE(norm_prev);
+        }
+    }
+    qsort(lists, nlists, sizeof(struct uqv_list), uqv_list_cmp);
+
+    ntopics = runs[0]->topics.len;
+    topics = bmalloc(sizeof(int) * (ntopics + 1));
+    memcpy(topics, runs[0]->topics.ary, sizeof(int) * ntopics);
+    qsort(topics, ntopics, sizeof(int), int_cmp);
+
+    for (size_t i = 0, j; i < nlists; i = j) {
+        int qid = lists[i].view.ary->qid;
+        struct trec_topic topic = {&qid, 1, 1};
+        struct pf_ctx *ctx;
+
+        for (j = i; j < nlists && lists[j].view.ary->qid == qid; j++) {
+        }
+        if (!bsearch(&qid, topics, ntopics, sizeof(int), int_cmp)) {
+            continue;
+        }
+
+        ctx = pf_ctx_create();
+        pf_set_fusion(ctx, cmd);
+        pf_set_rrf_k(ctx, rrf_k);
+        pf_set_reproducible(ctx, reproducible);
+        pf_set_mc4(ctx, mc4_tol, mc4_iters);
+        pf_set_threads(ctx, nthreads);
+        pf_init(ctx, &topic);
+        for (size_t k = i; k < j; k++) {
+            pf_weight_alloc(ctx, phi, lists[k].view.max_rank);
+            if (run_weights) {
+                pf_set_run_weight(ctx, run_weights[lists[k].run]);
+            }
+            PF_STATS_ENTER(acc_prev, PF_PHASE_ACCUMULATE);
+            pf_accumulate(ctx, &lists[k].view);
+            PF_STATS_LEAVE(acc_prev);
+        }
+        if (ev) {
+            pf_set_eval(ctx, ev);
+        }
+        PF_STATS_ENTER(prev, PF_PHASE_PRESENT);
+        pf_present(ctx, eval_only ? NULL : stdout, runid, depth, prevent_ties);
+        PF_STATS_LEAVE(prev);
+        pf_ctx_destroy(ctx);
+    }
+
+    for (size_t i = 0; i < nruns; i++) {
+        trec_destroy(runs[i]);
+    }
+    free(runs);
+    free(lists);
+    free(topics);
+}
+
+/*
+ * Fuse runs with the method named by the first argument.
+ */
+static int
+fuse(int argc, char **argv)
+{
+    int left;
+    FILE *fp;
+    struct pf_qrels *qrels = NULL;
+    struct pf_eval ev;
+
+    left = parse_opt(argc, argv);
+    present_args();
+
+    if (qrels_path) {
+        /*
+         * Evaluate the fused run. Metrics go to stdout in place of the run
+         * with `-e`, otherwise to stderr.
+         */
+        FILE *out = eval_only ? stdout : stderr;
+        if (!(fp = fopen(qrels_path, "r"))) {
+            perror("fopen");
+            exit(EXIT_FAILURE);
+        }
+        qrels = pf_qrels_read(fp);
+        fclose(fp);
+        pf_eval_init(&ev, qrels, PF_EVAL_CUTOFF);
+        ev.topic_out = out;
+    }
+
+    /* runs are read ahead while the previous ones are parsed and fused */
+    prefetch = pf_prefetch_create(argv + optind, left);
+    if (uqv) {
+        fuse_uqv(left, argv, qrels ? &ev : NULL);
+    } else {
+        fuse_runs(left, argv, qrels ? &ev : NULL);
+    }
+    pf_prefetch_destroy(prefetch);
+    if (qrels) {
+        pf_eval_report(&ev, eval_only ? stdout : stderr);
+        pf_qrels_destroy(qrels);
+    }
+    free(run_weights);
     free(runid);
 
     return 0;
@@ -190,12 +493,19 @@ parse_opt(int argc, char **argv)
                    strncmp(argv[optind], FCOMBSUM, strlen(argv[optind]))) {
             cmd = TCOMBSUM;
             strncpy(cmd_str, FCOMBSUM, CMDSTR_LEN);
+        } else if (0 == strncmp(
+                              argv[optind], FCONDORCET, strlen(argv[optind]))) {
+            cmd = TCONDORCET;
+            strncpy(cmd_str, FCONDORCET, CMDSTR_LEN);
         } else if (0 == strncmp(argv[optind], FISR, strlen(argv[optind]))) {
             cmd = TISR;
             strncpy(cmd_str, FISR, CMDSTR_LEN);
         } else if (0 == strncmp(argv[optind], FLOGISR, strlen(argv[optind]))) {
             cmd = TLOGISR;
             strncpy(cmd_str, FLOGISR, CMDSTR_LEN);
+        } else if (0 == strncmp(argv[optind], FMC4, strlen(argv[optind]))) {
+            cmd = TMC4;
+            strncpy(cmd_str, FMC4, CMDSTR_LEN);
         } else if (0 == strncmp(argv[optind], FRBC, strlen(argv[optind]))) {
             cmd = TRBC;
             strncpy(cmd_str, FRBC, CMDSTR_LEN);
@@ -214,15 +524,15 @@ parse_opt(int argc, char **argv)
         optind++;
     }
 
-    char opt_str[8] = {0};
+    char opt_str[32] = "td:r:eq:g:uw:R";
     if (TRBC == cmd) {
-        strcpy(opt_str, "td:r:p:");
+        strcat(opt_str, "p:");
     } else if (TRRF == cmd) {
-        strcpy(opt_str, "td:r:k:");
-    } else if (is_score_based(cmd)) {
-        strcpy(opt_str, "td:r:n:");
-    } else {
-        strcpy(opt_str, "td:r:");
+        strcat(opt_str, "k:");
+    } else if (TMC4 == cmd) {
+        strcat(opt_str, "c:i:j:");
+    } else if (fusetype_is_score_based(cmd)) {
+        strcat(opt_str, "n:T");
     }
 
     while ((ch = getopt(argc, argv, opt_str)) != -1) {
@@ -236,20 +546,51 @@ parse_opt(int argc, char **argv)
         case 'r':
             runid = strdup(optarg);
             break;
+        case 'e':
+            eval_only = true;
+            break;
+        case 'q':
+            qrels_path = optarg;
+            break;
+        case 'g':
+            group = strtoul(optarg, NULL, 10);
+            break;
+        case 'u':
+            uqv = true;
+            break;
+        case 'R':
+            reproducible = true;
+            break;
+        case 'w':
+            free(run_weights);
+            nweights = parse_ldbl_list(optarg, &run_weights);
+            break;
         case 'k':
             rrf_k = strtol(optarg, NULL, 10);
             break;
         case 'n':
-            fnorm = strtonorm(optarg);
+            fnorm = trec_norm_parse(optarg);
             if (TNORM_NONE == fnorm) {
                 err_exit("unknown normalization '%s'\n\nvalid normalizations "
-                         "are:\n minmax, sum, minsum, std",
+                         "are:\n minmax, sum, minsum, std, cdf, iqr, trim",
                     optarg);
             }
             break;
+        case 'T':
+            norm_scope = TNORM_TOPIC;
+            break;
         case 'p':
             phi = strtod(optarg, NULL);
             break;
+        case 'c':
+            mc4_tol = strtod(optarg, NULL);
+            break;
+        case 'i':
+            mc4_iters = strtoul(optarg, NULL, 10);
+            break;
+        case 'j':
+            nthreads = strtol(optarg, NULL, 10);
+            break;
         case '?':
         default:
             usage();
@@ -267,6 +608,28 @@ parse_opt(int argc, char **argv)
         runid = strdup(default_runid[cmd]);
     }
 
+    if (group && uqv) {
+        err_exit("`-g` does not apply to query variants with `-u`");
+    }
+
+    if (eval_only && !qrels_path) {
+        err_exit("`-e` requires qrels given with `-q`");
+    }
+
+    if (run_weights && (TCOMBMED == cmd || fusetype_is_pairwise(cmd))) {
+        err_exit("%s does not take run weights", cmd_str);
+    }
+    if (group && fusetype_is_pairwise(cmd)) {
+        err_exit("`-g` does not apply to %s, which needs every run", cmd_str);
+    }
+    if (nthreads < 1) {
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = nthreads < 1 ? 1 : nthreads;
+    }
+    if (run_weights && nweights != (size_t)argc) {
+        err_exit("%zu run weights given for %d runs", nweights, argc);
+    }
+
     return argc;
 }
 
@@ -279,12 +642,29 @@ usage(void)
     fprintf(stderr,
         "usage: polyfuse [-v] [-h] "
         "<fusion> [options] run1 run2 [run3 ...]\n"
+        "       polyfuse batch [options] jobs.tsv\n"
+        "       polyfuse gen [options]\n"
+        "       polyfuse learn [options] run1 run2 [run3 ...]\n"
+        "       polyfuse multi [options] run1 run2 [run3 ...]\n"
+        "       polyfuse serve [options] [run1 run2 ...]\n"
+        "       polyfuse sweep [options] run1 run2 [run3 ...]\n"
         "\noptions:\n"
         "  -d depth     rank depth of output\n"
+        "  -e           only evaluate, do not write the fused run\n"
+        "  -g num       fuse groups of num runs apart, spill them to disk\n"
+        "               and merge them, to bound memory\n"
+        "  -q qrels     evaluate the fused run against qrels\n"
         "  -t           prevent ties\n"
         "  -h           display this message\n"
         "  -r runid     set run identifier\n"
+        "  -R           sum scores in fixed point, the same bits in any run\n"
+        "               order or grouping\n"
+        "  --stats      report timing and counters to stderr, as JSON with\n"
+        "               --stats=json\n"
+        "  -u           runs hold query variants (301-1), each fused as a\n"
+        "               list of its base topic\n"
         "  -v           display version and exit\n"
+        "  -w list      comma separated weights of the runs\n"
         "\nfusion commands:\n"
         "  borda        Borda count\n"
         "  combanz      CombANZ\n"
@@ -293,21 +673,40 @@ usage(void)
         "  combmin      CombMIN\n"
         "  combmnz      CombMNZ\n"
         "  combsum      CombSUM\n"
+        "  condorcet    Condorcet-fuse, by majority of pairwise preferences\n"
         "  isr          Inverse square rank\n"
         "  logisr       Logarithmic inverse square rank\n"
+        "  mc4          MC4, a Markov chain over pairwise majorities\n"
         "  rbc          Rank-biased centroids\n"
         "  rrf          Recipocal rank fusion\n"
+        "\nsubcommands:\n"
+        "  batch        run the fusion jobs of a manifest, sharing runs\n"
+        "  gen          write synthetic runs for load testing\n"
+        "  learn        learn run weights against qrels\n"
+        "  multi        fuse with several methods in one pass\n"
+        "  serve        answer fusion requests over a Unix socket\n"
+        "  sweep        fuse a grid of methods and parameters in one pass\n"
         "\nnormalization options:\n"
         "  minmax       min-max scaler\n"
         "  std          zero mean and unit variance\n"
         "  sum          sum normalization\n"
         "  minsum       min-sum scaler\n"
+        "  cdf          share of scores at or below, from a quantile sketch\n"
+        "  iqr          median and interquartile range scaler\n"
+        "  trim         min-max scaler on the 5th and 95th percentiles\n"
         "\nscore-based fusion options (combanz, ..., combsum):\n"
         "  -n norm      perform score normalization before fusion\n"
+        "  -T           normalize each topic on its own, not the whole run\n"
+        "               (lists of query variants always are)\n"
         "\nrbc options:\n"
         "  -p num       user persistence in the range (0.0,1.0)\n"
         "\nrrf options:\n"
-        "  -k num       constant to control outlier rankings\n\n");
+        "  -k num       constant to control outlier rankings\n"
+        "\nmc4 options:\n"
+        "  -c tol       stop once an iteration moves less than tol of the\n"
+        "               probability mass (default: 1e-9)\n"
+        "  -i num       most iterations for a topic (default: 1000)\n"
+        "  -j threads   threads sharing the topics (default: online CPUs)\n\n");
 }
 
 static void
@@ -320,26 +719,11 @@ present_args()
         fprintf(stderr, "# phi: %Lf\n", phi);
     } else if (TRRF == cmd) {
         fprintf(stderr, "# k: %ld\n", rrf_k);
-    } else if (is_score_based(cmd)) {
-        fprintf(stderr, "# normalization: %s\n", trec_norm_str[fnorm]);
-    }
-}
-
-static enum trec_norm
-strtonorm(const char *s)
-{
-    const char *opts[] = {"minmax", "minsum", "sum", "std"};
-    enum trec_norm norm = TNORM_NONE;
-
-    if (strncmp(opts[0], s, strlen(opts[0])) == 0) {
-        norm = TNORM_MINMAX;
-    } else if (strncmp(opts[1], s, strlen(opts[1])) == 0) {
-        norm = TNORM_MINSUM;
-    } else if (strncmp(opts[2], s, strlen(opts[2])) == 0) {
-        norm = TNORM_SUM;
-    } else if (strncmp(opts[3], s, strlen(opts[3])) == 0) {
-        norm = TNORM_ZMUV;
+    } else if (TMC4 == cmd) {
+        fprintf(stderr, "# tolerance: %g\n", mc4_tol);
+        fprintf(stderr, "# iterations: %zu\n", mc4_iters);
+    } else if (fusetype_is_score_based(cmd)) {
+        fprintf(stderr, "# normalization: %s%s\n", trec_norm_str[fnorm],
+            TNORM_TOPIC == norm_scope ? " per topic" : "");
     }
-
-    return norm;
 }
@@ -8,6 +8,9 @@
  */
 
 #include "pf_accum.h"
+#include "pf_condorcet.h"
+#include "pf_stats.h"
+#include "pf_trace.h"
 
 #define LOAD_FACTOR 0.75
 #define HASH(s, ht) (str_hash(s) % ht->capacity)
@@ -19,11 +22,11 @@ accum_rehash(struct accum *htable);
 /*
  * `list_entry` internal array handling
  */
-#define LDBL_MIN_CAPACITY 32
-#define LDBL_TYPE_SIZE (sizeof(long double))
+#define SCORE_MIN_CAPACITY 32
+#define SCORE_TYPE_SIZE (sizeof(pf_score_t))
 
-struct ldbl_arr {
-    long double *data;
+struct score_arr {
+    pf_score_t *data;
     size_t size;
     size_t capacity;
 };
@@ -32,32 +35,32 @@ struct ldbl_arr {
  * Allocate more memory to the array if required.
  */
 static void
-ldbl_arr_alloc(struct ldbl_arr *arr)
+score_arr_alloc(struct score_arr *arr)
 {
     if (arr) {
         if (0 == arr->capacity) {
-            arr->capacity = LDBL_MIN_CAPACITY;
-            arr->data = bmalloc(LDBL_TYPE_SIZE * arr->capacity);
+            arr->capacity = SCORE_MIN_CAPACITY;
+            arr->data = bmalloc(SCORE_TYPE_SIZE * arr->capacity);
         } else if (arr->size == arr->capacity) {
             arr->capacity *= 2;
-            arr->data = brealloc(arr->data, LDBL_TYPE_SIZE * arr->capacity);
+            arr->data = brealloc(arr->data, SCORE_TYPE_SIZE * arr->capacity);
         }
     }
 }
 
-static struct ldbl_arr *
-ldbl_arr_create()
+static struct score_arr *
+score_arr_create()
 {
-    struct ldbl_arr *ary;
+    struct score_arr *ary;
 
-    ary = (struct ldbl_arr *)bmalloc(sizeof(struct ldbl_arr));
-    ldbl_arr_alloc(ary);
+    ary = (struct score_arr *)bmalloc(sizeof(struct score_arr));
+    score_arr_alloc(ary);
 
     return ary;
 }
 
 static void
-ldbl_arr_destroy(struct ldbl_arr *arr)
+score_arr_destroy(struct score_arr *arr)
 {
     arr->capacity = 0;
     arr->size = 0;
@@ -65,7 +68,7 @@ ldbl_arr_destroy(struct ldbl_arr *arr)
 }
 
 static void
-ldbl_arr_insert(struct ldbl_arr *arr, const long double val)
+score_arr_insert(struct score_arr *arr, const pf_score_t val)
 {
     if (arr) {
         if (0 == arr->size) {
@@ -73,17 +76,14 @@ ldbl_arr_insert(struct ldbl_arr *arr, const long double val)
             return;
         }
 
-        ldbl_arr_alloc(arr);
+        score_arr_alloc(arr);
 
-        // if `val` is largest, insert at end, i.e. `arr->size`.
+        // keep the array in ascending order
         size_t idx = arr->size, n = 0;
-        for (size_t i = arr->size - 1; (int)i >= 0; i--) {
-            if (val < arr->data[i]) {
-                idx = i;
-                break;
-            }
+        while (idx > 0 && val < arr->data[idx - 1]) {
+            --idx;
         }
-        n = (arr->size - idx) * LDBL_TYPE_SIZE;
+        n = (arr->size - idx) * SCORE_TYPE_SIZE;
         if (n > 0) {
             memmove(arr->data + idx + 1, arr->data + idx, n);
         }
@@ -93,22 +93,6 @@ ldbl_arr_insert(struct ldbl_arr *arr, const long double val)
 }
 /* end `list_entry` internal array handling */
 
-/*
- * Map strings to unsigned integers.
- */
-static unsigned long
-str_hash(const char *str)
-{
-    char c;
-    unsigned long hash = 2081;
-
-    while ((c = *str++)) {
-        hash = hash ^ (c + (hash << 6) + (hash >> 2));
-    }
-
-    return hash;
-}
-
 /*
  * Get a low prime for linear probing.
  *
@@ -138,7 +122,7 @@ get_prime(size_t n)
 }
 
 /*
- * Create `long double` accumulator.
+ * Create `pf_score_t` accumulator.
  */
 struct accum *
 accum_dbl_create(const size_t capacity)
@@ -156,7 +140,7 @@ accum_dbl_create(const size_t capacity)
 }
 
 /*
- * Free `long double` accumulator.
+ * Free `pf_score_t` accumulator.
  */
 void
 accum_dbl_free(struct accum_dbl *acc)
@@ -172,21 +156,17 @@ accum_dbl_free(struct accum_dbl *acc)
 }
 
 /*
- * `accum_dbl` accumulator operations (internal).
+ * Find the entry for `docno`, inserting an empty entry if it is not present.
+ * A new entry has a `count` of zero, which the combine operators in
+ * `pf_accum.h` use to detect the first update.
  */
-enum accum_op { OP_NONE, OP_ADD, OP_LESS, OP_GREATER };
-
-/*
- * Update an element in the hash table.
- */
-static unsigned long
-accum_dbl_modify_(struct accum **htable, const char *docno, long double score,
-    const enum accum_op op)
+struct dbl_entry *
+accum_dbl_slot(struct accum **htable, const char *docno)
 {
     unsigned long key;
-    unsigned long start_pos;
     struct accum_dbl *current;
     struct dbl_entry *entry;
+    size_t probes = 0;
 
     if (NEED_REHASH((*htable))) {
         *htable = accum_rehash(*htable);
@@ -194,71 +174,157 @@ accum_dbl_modify_(struct accum **htable, const char *docno, long double score,
     current = (struct accum_dbl *)(*htable);
 
     key = HASH(docno, current);
-    start_pos = key;
-    do {
+    /* assume table never gets full */
+    for (;;) {
         entry = &current->data[key];
         if (!entry->is_set) {
             entry->docno = strdup(docno);
-            entry->val = score;
+            entry->val = 0;
             entry->is_set = true;
-            entry->count = 1;
+            entry->count = 0;
             ++current->size;
             break;
-        } else if (0 == strncmp(entry->docno, docno, strlen(entry->docno))) {
-            switch (op) {
-            case OP_LESS:
-                if (score < entry->val) {
-                    entry->val = score;
-                }
-                break;
-            case OP_GREATER:
-                if (score > entry->val) {
-                    entry->val = score;
-                }
-                break;
-            case OP_ADD:
-            default:
-                entry->val += score;
-                break;
-            }
-            entry->count++;
+        } else if (0 == strcmp(entry->docno, docno)) {
             break;
         }
         ++key;
         key %= current->capacity;
-    } while (key != start_pos);
+        ++probes;
+    }
+    PF_STATS_PROBE(PF_HIST_ACCUM_SLOT, probes);
 
-    return key;
+    return entry;
+}
+
+/*
+ * Find the entry for `docno`. Returns `NULL` if it is not present.
+ */
+struct dbl_entry *
+accum_dbl_find(const struct accum *htable, const char *docno)
+{
+    const struct accum_dbl *current = (const struct accum_dbl *)htable;
+    unsigned long key = HASH(docno, current);
+
+    while (current->data[key].is_set) {
+        if (0 == strcmp(current->data[key].docno, docno)) {
+            return &current->data[key];
+        }
+        ++key;
+        key %= current->capacity;
+    }
+
+    return NULL;
 }
 
 /*
  * Set accumulator only if `score` is less than the current value.
  */
 unsigned long
-accum_dbl_less(struct accum **htable, const char *docno, long double score)
+accum_dbl_less(struct accum **htable, const char *docno, pf_score_t score)
 {
-    /* struct accum_dbl **dbltab = (struct accum_dbl **)htable; */
-    return accum_dbl_modify_(htable, docno, score, OP_LESS);
+    struct dbl_entry *entry = accum_dbl_slot(htable, docno);
+
+    accum_op_less(entry, score);
+
+    return entry - ((struct accum_dbl *)*htable)->data;
 }
 
 /*
  * Set accumulator only if `score` is greater than the current value.
  */
 unsigned long
-accum_dbl_greater(struct accum **htable, const char *docno, long double score)
+accum_dbl_greater(struct accum **htable, const char *docno, pf_score_t score)
 {
-    /* struct accum_dbl **dbltab = (struct accum_dbl **)htable; */
-    return accum_dbl_modify_(htable, docno, score, OP_GREATER);
+    struct dbl_entry *entry = accum_dbl_slot(htable, docno);
+
+    accum_op_greater(entry, score);
+
+    return entry - ((struct accum_dbl *)*htable)->data;
 }
 
 /*
  * Accumulate value.
  */
 unsigned long
-accum_dbl_update(struct accum **htable, const char *docno, long double score)
+accum_dbl_update(struct accum **htable, const char *docno, pf_score_t score)
 {
-    /* struct accum_dbl **dbltab = (struct accum_dbl **)htable; */
-    return accum_dbl_modify_(htable, docno, score, OP_ADD);
+    struct dbl_entry *entry = accum_dbl_slot(htable, docno);
+
+    accum_op_add(entry, score);
+
+    return entry - ((struct accum_dbl *)*htable)->data;
+}
+
+/*
+ * Create fixed point accumulator.
+ */
+struct accum *
+accum_fixed_create(const size_t capacity)
+{
+    struct accum_fixed *tab;
+
+    tab = bmalloc(sizeof(*tab));
+    tab->type = ACCUM_FIXED;
+    tab->capacity = get_prime(capacity);
+    tab->size = 0;
+    tab->is_set = false;
+    tab->data = bmalloc(sizeof(struct fixed_entry) * tab->capacity);
+
+    return (struct accum *)tab;
+}
+
+/*
+ * Free fixed point accumulator.
+ */
+void
+accum_fixed_free(struct accum_fixed *acc)
+{
+    for (size_t i = 0; i < acc->capacity; i++) {
+        if (acc->data[i].is_set) {
+            free(acc->data[i].docno);
+        }
+    }
+    free(acc->data);
+    free(acc);
+}
+
+/*
+ * Find the entry for `docno`, inserting a zero entry if it is not present.
+ */
+struct fixed_entry *
+accum_fixed_slot(struct accum **htable, const char *docno)
+{
+    unsigned long key;
+    struct accum_fixed *current;
+    struct fixed_entry *entry;
+    size_t probes = 0;
+
+    if (NEED_REHASH((*htable))) {
+        *htable = accum_rehash(*htable);
+    }
+    current = (struct accum_fixed *)(*htable);
+
+    key = HASH(docno, current);
+    /* assume table never gets full */
+    for (;;) {
+        entry = &current->data[key];
+        if (!entry->is_set) {
+            entry->docno = strdup(docno);
+            entry->val = 0;
+            entry->is_set = true;
+            entry->count = 0;
+            ++current->size;
+            break;
+        } else if (0 == strcmp(entry->docno, docno)) {
+            break;
+        }
+        ++key;
+        key %= current->capacity;
+        ++probes;
+    }
+    PF_STATS_PROBE(PF_HIST_ACCUM_SLOT, probes);
+
+    return entry;
 }
 
 /*
@@ -288,7 +354,7 @@ accum_list_free(struct accum_list *acc)
     for (size_t i = 0; i < tab->capacity; i++) {
         if (tab->data[i].is_set) {
             free(tab->data[i].docno);
-            ldbl_arr_destroy(tab->data[i].ary);
+            score_arr_destroy(tab->data[i].ary);
             free(tab->data[i].ary);
         }
     }
@@ -299,38 +365,44 @@ accum_list_free(struct accum_list *acc)
 /*
  * Find the median value.
  */
-long double
+pf_score_t
 accum_list_median(const struct list_entry *l)
 {
-    long double m = 0.0;
+    pf_score_t m = 0.0;
     size_t idx;
 
+    idx = l->ary->size >> 1;
     if (l->ary->size % 2 == 0) {
-        idx = l->ary->size >> 1;
-        m = l->ary->data[idx];
-        m += l->ary->data[idx + 1];
+        m = l->ary->data[idx - 1];
+        m += l->ary->data[idx];
         m /= 2;
     } else {
-        idx = l->ary->size >> 1;
-        m = l->ary->data[idx + 1];
+        m = l->ary->data[idx];
     }
 
     return m;
 }
 
-#define ACCUM_LIST_SZ (sizeof(struct list_entry))
+/*
+ * The values of a list entry, in ascending order.
+ */
+const pf_score_t *
+accum_list_values(const struct list_entry *l, size_t *n)
+{
+    *n = l->ary->size;
+
+    return l->ary->data;
+}
 
 /*
  * Append an item to the list accumulator.
  */
 unsigned long
-accum_list_append(struct accum **htable, const char *docno, long double score)
+accum_list_append(struct accum **htable, const char *docno, pf_score_t score)
 {
     unsigned long key;
-    unsigned long start_pos;
     struct list_entry *entry;
     struct accum_list *current;
-    uint8_t *dat;
 
     if (NEED_REHASH((*htable))) {
         *htable = accum_rehash(*htable);
@@ -338,51 +410,194 @@ accum_list_append(struct accum **htable, const char *docno, long double score)
     current = (struct accum_list *)(*htable);
 
     key = HASH(docno, current);
-    start_pos = key;
-    dat = (uint8_t *)current->data + key * ACCUM_LIST_SZ;
-    do {
-        entry = (struct list_entry *)dat;
+    /* assume table never gets full */
+    for (;;) {
+        entry = &current->data[key];
+        if (!entry->is_set) {
+            entry->docno = strdup(docno);
+            entry->ary = score_arr_create();
+            score_arr_insert(entry->ary, score);
+            entry->is_set = true;
+            ++current->size;
+            break;
+        } else if (0 == strcmp(entry->docno, docno)) {
+            score_arr_insert(entry->ary, score);
+            break;
+        }
+        ++key;
+        key %= current->capacity;
+    }
+
+    return key;
+}
+
+/*
+ * Create `rank` accumulator.
+ */
+struct accum *
+accum_rank_create(const size_t capacity)
+{
+    struct accum_rank *tab;
+
+    tab = bmalloc(sizeof(*tab));
+    tab->type = ACCUM_RANK;
+    tab->capacity = get_prime(capacity);
+    tab->size = 0;
+    tab->data = bmalloc(sizeof(struct rank_entry) * tab->capacity);
+
+    return (struct accum *)tab;
+}
+
+/*
+ * Free `rank` accumulator.
+ */
+void
+accum_rank_free(struct accum_rank *acc)
+{
+    for (size_t i = 0; i < acc->capacity; i++) {
+        if (acc->data[i].is_set) {
+            free(acc->data[i].docno);
+            free(acc->data[i].ranks);
+        }
+    }
+    free(acc->data);
+    free(acc);
+}
+
+/*
+ * Record the rank of `docno` by run `voter`. Runs before it that did not
+ * retrieve the document leave it unranked, and a document listed twice by a
+ * run keeps its best rank.
+ */
+unsigned long
+accum_rank_set(
+    struct accum **htable, const char *docno, size_t voter, uint16_t rank)
+{
+    unsigned long key;
+    struct rank_entry *entry;
+    struct accum_rank *current;
+
+    if (NEED_REHASH((*htable))) {
+        *htable = accum_rehash(*htable);
+    }
+    current = (struct accum_rank *)(*htable);
+
+    key = HASH(docno, current);
+    /* assume table never gets full */
+    for (;;) {
+        entry = &current->data[key];
         if (!entry->is_set) {
             entry->docno = strdup(docno);
-            entry->ary = ldbl_arr_create();
-            ldbl_arr_insert(entry->ary, score);
             entry->is_set = true;
             ++current->size;
             break;
-        } else if (0 == strncmp(entry->docno, docno, strlen(entry->docno))) {
-            ldbl_arr_insert(entry->ary, score);
+        } else if (0 == strcmp(entry->docno, docno)) {
             break;
         }
         ++key;
         key %= current->capacity;
-    } while (key != start_pos);
+    }
+
+    if (voter >= entry->alloc) {
+        entry->alloc = voter < 2 * entry->alloc ? 2 * entry->alloc : voter + 4;
+        entry->ranks =
+            brealloc(entry->ranks, sizeof(uint16_t) * entry->alloc);
+    }
+    if (voter >= entry->nranks) {
+        for (size_t v = entry->nranks; v <= voter; v++) {
+            entry->ranks[v] = PF_CONDORCET_UNRANKED;
+        }
+        entry->nranks = voter + 1;
+    }
+    if (rank < entry->ranks[voter]) {
+        entry->ranks[voter] = rank;
+    }
 
     return key;
 }
 
+/*
+ * Entries are moved into the new table as is, which keeps `count` intact and
+ * avoids copying `docno` strings and value lists.
+ */
 static void
 accum_dbl_rehash(struct accum_dbl *old, struct accum *new)
 {
+    struct accum_dbl *tab = (struct accum_dbl *)new;
+
     for (size_t i = 0; i < old->capacity; ++i) {
         if (old->data[i].is_set) {
-            accum_dbl_update(&new, old->data[i].docno, old->data[i].val);
+            unsigned long key = HASH(old->data[i].docno, tab);
+            while (tab->data[key].is_set) {
+                ++key;
+                key %= tab->capacity;
+            }
+            tab->data[key] = old->data[i];
+            ++tab->size;
         }
     }
-    accum_dbl_free(old);
+    free(old->data);
+    free(old);
+}
+
+static void
+accum_fixed_rehash(struct accum_fixed *old, struct accum *new)
+{
+    struct accum_fixed *tab = (struct accum_fixed *)new;
+
+    for (size_t i = 0; i < old->capacity; ++i) {
+        if (old->data[i].is_set) {
+            unsigned long key = HASH(old->data[i].docno, tab);
+            while (tab->data[key].is_set) {
+                ++key;
+                key %= tab->capacity;
+            }
+            tab->data[key] = old->data[i];
+            ++tab->size;
+        }
+    }
+    free(old->data);
+    free(old);
 }
 
 static void
 accum_list_rehash(struct accum_list *old, struct accum *new)
 {
+    struct accum_list *tab = (struct accum_list *)new;
+
+    for (size_t i = 0; i < old->capacity; ++i) {
+        if (old->data[i].is_set) {
+            unsigned long key = HASH(old->data[i].docno, tab);
+            while (tab->data[key].is_set) {
+                ++key;
+                key %= tab->capacity;
+            }
+            tab->data[key] = old->data[i];
+            ++tab->size;
+        }
+    }
+    free(old->data);
+    free(old);
+}
+
+static void
+accum_rank_rehash(struct accum_rank *old, struct accum *new)
+{
+    struct accum_rank *tab = (struct accum_rank *)new;
+
     for (size_t i = 0; i < old->capacity; ++i) {
         if (old->data[i].is_set) {
-            for (size_t j = 0; j < old->data[i].ary->size; ++j) {
-                long double val = old->data[i].ary->data[j];
-                accum_list_append(&new, old->data[i].docno, val);
+            unsigned long key = HASH(old->data[i].docno, tab);
+            while (tab->data[key].is_set) {
+                ++key;
+                key %= tab->capacity;
             }
+            tab->data[key] = old->data[i];
+            ++tab->size;
         }
     }
-    accum_list_free(old);
+    free(old->data);
+    free(old);
 }
 
 /*
@@ -394,19 +609,29 @@ accum_rehash(struct accum *htable)
     struct accum *rehash;
     size_t new_size;
 
+    PF_STATS_ADD(PF_CNT_ACCUM_REHASH, 1);
     /* Based from current load factor, take it down to ~25% */
     new_size = htable->size * 4;
     if (ACCUM_LIST == htable->type) {
         rehash = accum_list_create(new_size);
+    } else if (ACCUM_RANK == htable->type) {
+        rehash = accum_rank_create(new_size);
+    } else if (ACCUM_FIXED == htable->type) {
+        rehash = accum_fixed_create(new_size);
     } else {
         rehash = accum_dbl_create(new_size);
     }
 
     rehash->topic = htable->topic;
     rehash->is_set = htable->is_set;
+    PF_TRACE3(accum_rehash, htable->topic, htable->capacity, rehash->capacity);
 
     if (ACCUM_LIST == htable->type) {
         accum_list_rehash((struct accum_list *)htable, rehash);
+    } else if (ACCUM_RANK == htable->type) {
+        accum_rank_rehash((struct accum_rank *)htable, rehash);
+    } else if (ACCUM_FIXED == htable->type) {
+        accum_fixed_rehash((struct accum_fixed *)htable, rehash);
     } else {
         accum_dbl_rehash((struct accum_dbl *)htable, rehash);
     }
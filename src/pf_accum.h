@@ -10,6 +10,7 @@
 #ifndef PF_ACCUM_H
 #define PF_ACCUM_H
 
+#include <math.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -18,9 +19,32 @@
 
 #include "util.h"
 
-enum accumtype { ACCUM_NONE, ACCUM_DBL, ACCUM_LIST };
+enum accumtype { ACCUM_NONE, ACCUM_DBL, ACCUM_LIST, ACCUM_RANK, ACCUM_FIXED };
 
-struct ldbl_arr;
+struct score_arr;
+
+/*
+ * Q64.64 fixed point, for sums that must not depend on the order they are
+ * added in. Additions are exact, so the same contributions give the same
+ * bits whichever run, group or thread adds them first. Contributions are
+ * truncated to a multiple of 2^-64 and must be less than 2^63 in magnitude.
+ */
+__extension__ typedef __int128 pf_fixed_t;
+
+#define PF_FIXED_ONE 18446744073709551616.0L
+#define PF_FIXED_MAX 9223372036854775808.0L
+
+static inline pf_fixed_t
+pf_fixed_from(const long double x)
+{
+    return (pf_fixed_t)(x * PF_FIXED_ONE);
+}
+
+static inline long double
+pf_fixed_to(const pf_fixed_t x)
+{
+    return (long double)x / PF_FIXED_ONE;
+}
 
 struct default_entry {
     char *docno;
@@ -30,14 +54,37 @@ struct default_entry {
 struct dbl_entry {
     char *docno;
     bool is_set;
-    long double val;
+    pf_score_t val;
     size_t count;
 };
 
+/*
+ * A sum in fixed point, kept apart from `dbl_entry` as its 16 byte alignment
+ * would pad every entry of the other methods.
+ */
+struct fixed_entry {
+    char *docno;
+    bool is_set;
+    size_t count;
+    pf_fixed_t val;
+};
+
 struct list_entry {
     char *docno;
     bool is_set;
-    struct ldbl_arr *ary;
+    struct score_arr *ary;
+};
+
+/*
+ * The rank of a document by each run so far, `PF_CONDORCET_UNRANKED` where a
+ * run did not retrieve it.
+ */
+struct rank_entry {
+    char *docno;
+    bool is_set;
+    uint16_t *ranks;
+    uint32_t nranks;
+    uint32_t alloc;
 };
 
 /*
@@ -76,20 +123,59 @@ struct accum_list {
     struct list_entry *data;
 };
 
+/*
+ * Fixed point accumulator.
+ */
+struct accum_fixed {
+    uint8_t type;
+    size_t capacity;
+    size_t size;
+    int topic;
+    bool is_set;
+    struct fixed_entry *data;
+};
+
+/*
+ * Rank accumulator.
+ */
+struct accum_rank {
+    uint8_t type;
+    size_t capacity;
+    size_t size;
+    int topic;
+    bool is_set;
+    struct rank_entry *data;
+};
+
 struct accum *
 accum_dbl_create(const size_t capacity);
 
 void
 accum_dbl_free(struct accum_dbl *htable);
 
+struct dbl_entry *
+accum_dbl_slot(struct accum **htable, const char *docno);
+
+struct dbl_entry *
+accum_dbl_find(const struct accum *htable, const char *docno);
+
 unsigned long
-accum_dbl_less(struct accum **htable, const char *docno, long double score);
+accum_dbl_less(struct accum **htable, const char *docno, pf_score_t score);
 
 unsigned long
-accum_dbl_greater(struct accum **htable, const char *docno, long double score);
+accum_dbl_greater(struct accum **htable, const char *docno, pf_score_t score);
 
 unsigned long
-accum_dbl_update(struct accum **htable, const char *docno, long double score);
+accum_dbl_update(struct accum **htable, const char *docno, pf_score_t score);
+
+struct accum *
+accum_fixed_create(const size_t capacity);
+
+void
+accum_fixed_free(struct accum_fixed *acc);
+
+struct fixed_entry *
+accum_fixed_slot(struct accum **htable, const char *docno);
 
 struct accum *
 accum_list_create(const size_t capacity);
@@ -97,10 +183,64 @@ accum_list_create(const size_t capacity);
 void
 accum_list_free(struct accum_list *acc);
 
-long double
+pf_score_t
 accum_list_median(const struct list_entry *l);
 
+const pf_score_t *
+accum_list_values(const struct list_entry *l, size_t *n);
+
+unsigned long
+accum_list_append(struct accum **htable, const char *docno, pf_score_t score);
+
+struct accum *
+accum_rank_create(const size_t capacity);
+
+void
+accum_rank_free(struct accum_rank *acc);
+
 unsigned long
-accum_list_append(struct accum **htable, const char *docno, long double score);
+accum_rank_set(
+    struct accum **htable, const char *docno, size_t voter, uint16_t rank);
+
+/*
+ * Combine operators for an entry returned by `accum_dbl_slot`. These are
+ * inlined into the accumulation kernels of each fusion method.
+ */
+static inline void
+accum_op_add(struct dbl_entry *entry, const pf_score_t score)
+{
+    entry->val += score;
+    entry->count++;
+}
+
+/*
+ * `accum_op_add` for an entry returned by `accum_fixed_slot`.
+ */
+static inline void
+accum_op_add_fixed(struct fixed_entry *entry, const pf_score_t score)
+{
+    if (!(fabsl(score) < PF_FIXED_MAX)) {
+        err_exit("score %Lg is out of range of a reproducible sum",
+            (long double)score);
+    }
+    entry->val += pf_fixed_from(score);
+    entry->count++;
+}
+
+static inline void
+accum_op_less(struct dbl_entry *entry, const pf_score_t score)
+{
+    if (0 == entry->count++ || score < entry->val) {
+        entry->val = score;
+    }
+}
+
+static inline void
+accum_op_greater(struct dbl_entry *entry, const pf_score_t score)
+{
+    if (0 == entry->count++ || score > entry->val) {
+        entry->val = score;
+    }
+}
 
 #endif /* PF_ACCUM_H */
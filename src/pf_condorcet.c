@@ -0,0 +1,119 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "pf_condorcet.h"
+#include "util.h"
+
+struct condorcet {
+    const uint16_t *ranks;
+    size_t nvoters;
+    char *const *docno;
+};
+
+struct doc_ref {
+    const char *docno;
+    size_t idx;
+};
+
+static int
+doc_ref_cmp(const void *a, const void *b)
+{
+    return strcmp(((const struct doc_ref *)a)->docno,
+        ((const struct doc_ref *)b)->docno);
+}
+
+/*
+ * The runs ranking document `a` above `b`, less those ranking `b` above `a`.
+ */
+static long
+majority(const uint16_t *a, const uint16_t *b, size_t nvoters)
+{
+    long wins = 0;
+
+    for (size_t v = 0; v < nvoters; v++) {
+        wins += (a[v] < b[v]) - (a[v] > b[v]);
+    }
+
+    return wins;
+}
+
+/*
+ * Whether `a` goes before `b`. Documents no majority orders go by docno.
+ */
+static bool
+before(const struct condorcet *c, size_t a, size_t b)
+{
+    long m = majority(c->ranks + a * c->nvoters, c->ranks + b * c->nvoters,
+        c->nvoters);
+
+    return m > 0 || (0 == m && strcmp(c->docno[a], c->docno[b]) < 0);
+}
+
+/*
+ * Merge the sorted runs `[lo, mid)` and `[mid, hi)` of `src` into `dst`.
+ */
+static void
+merge(const struct condorcet *c, const size_t *src, size_t *dst, size_t lo,
+    size_t mid, size_t hi)
+{
+    size_t i = lo, j = mid, k = lo;
+
+    while (i < mid && j < hi) {
+        dst[k++] = before(c, src[j], src[i]) ? src[j++] : src[i++];
+    }
+    while (i < mid) {
+        dst[k++] = src[i++];
+    }
+    while (j < hi) {
+        dst[k++] = src[j++];
+    }
+}
+
+/*
+ * Write the `n` documents to `order` best first. A bottom up merge sort
+ * compares O(n log n) pairs, each over every run, against the n^2 pairs of
+ * the full Condorcet graph. Majorities can be cyclic, so where a cycle ends
+ * up depends on the order the sort starts from; it starts from docno order
+ * so the result does not depend on how the documents were gathered.
+ */
+void
+pf_condorcet_sort(const uint16_t *ranks, size_t nvoters, char *const *docno,
+    size_t *order, size_t n)
+{
+    const struct condorcet c = {ranks, nvoters, docno};
+    size_t *buf = bmalloc(sizeof(size_t) * (n + 1));
+    struct doc_ref *refs = bmalloc(sizeof(struct doc_ref) * (n + 1));
+    size_t *src = order, *dst = buf;
+
+    for (size_t i = 0; i < n; i++) {
+        refs[i] = (struct doc_ref){docno[i], i};
+    }
+    qsort(refs, n, sizeof(struct doc_ref), doc_ref_cmp);
+    for (size_t i = 0; i < n; i++) {
+        order[i] = refs[i].idx;
+    }
+    free(refs);
+    for (size_t width = 1; width < n; width *= 2) {
+        for (size_t lo = 0; lo < n; lo += 2 * width) {
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            merge(&c, src, dst, lo, mid, hi);
+        }
+        size_t *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    if (src != order) {
+        memcpy(order, src, sizeof(size_t) * n);
+    }
+    free(buf);
+}
@@ -0,0 +1,39 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#ifndef PF_CONDORCET_H
+#define PF_CONDORCET_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* the rank of a document a run did not retrieve, below all it did */
+#define PF_CONDORCET_UNRANKED UINT16_MAX
+
+/*
+ * Ranks are kept in 16 bits. Ranks past the last one that fits tie.
+ */
+static inline uint16_t
+pf_condorcet_rank(size_t rank)
+{
+    return rank < PF_CONDORCET_UNRANKED ? rank : PF_CONDORCET_UNRANKED - 1;
+}
+
+/*
+ * Condorcet-fuse (Montague and Aslam, 2002): a document goes before another
+ * if more runs rank it higher, and the documents are sorted by that order
+ * rather than compared all pairwise. Documents a run did not retrieve rank
+ * below all those it did and tie with each other. `ranks` holds the ranks
+ * of document `d` by the `nvoters` runs at `ranks + d * nvoters`.
+ */
+void
+pf_condorcet_sort(const uint16_t *ranks, size_t nvoters, char *const *docno,
+    size_t *order, size_t n);
+
+#endif /* PF_CONDORCET_H */
@@ -0,0 +1,333 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <math.h>
+
+#include "pf_eval.h"
+
+#define INIT_SZ 16
+
+/*
+ * A retrieved document as ordered by trec_eval.
+ */
+struct ranked {
+    const char *docno;
+    long double score;
+};
+
+static int
+qrels_topic_cmp(const void *a, const void *b)
+{
+    const struct pf_qrels_topic *x = a, *y = b;
+
+    return (x->qid > y->qid) - (x->qid < y->qid);
+}
+
+static int
+ldbl_desc_cmp(const void *a, const void *b)
+{
+    long double x = *(const long double *)a;
+    long double y = *(const long double *)b;
+
+    return (x < y) - (x > y);
+}
+
+/*
+ * trec_eval ranks by decreasing score and breaks ties by decreasing docno.
+ */
+static int
+ranked_cmp(const void *a, const void *b)
+{
+    const struct ranked *x = a, *y = b;
+
+    if (x->score != y->score) {
+        return (x->score < y->score) - (x->score > y->score);
+    }
+
+    return strcmp(y->docno, x->docno);
+}
+
+static struct pf_qrels_topic *
+qrels_topic(struct pf_qrels *q, int qid)
+{
+    for (size_t i = q->len; i > 0; i--) {
+        if (q->ary[i - 1].qid == qid) {
+            return &q->ary[i - 1];
+        }
+    }
+
+    if (q->len == q->alloc) {
+        q->alloc *= 2;
+        q->ary = brealloc(q->ary, sizeof(struct pf_qrels_topic) * q->alloc);
+    }
+    struct pf_qrels_topic *t = &q->ary[q->len++];
+    t->qid = qid;
+    t->rels = accum_dbl_create(1000);
+    t->num_rel = 0;
+    t->ideal = NULL;
+
+    return t;
+}
+
+/*
+ * Read a qrels file of `qid iter docno rel` lines.
+ */
+struct pf_qrels *
+pf_qrels_read(FILE *fp)
+{
+    struct pf_qrels *q;
+    struct pf_qrels_topic *t = NULL;
+    char buf[BUFSIZ] = {0};
+    char docno[BUFSIZ] = {0};
+    size_t line = 0;
+
+    q = bmalloc(sizeof(*q));
+    q->alloc = INIT_SZ;
+    q->ary = bmalloc(sizeof(struct pf_qrels_topic) * q->alloc);
+
+    while (fgets(buf, BUFSIZ, fp)) {
+        int qid;
+        long rel;
+        line++;
+        if (3 != sscanf(buf, "%d %*s %s %ld", &qid, docno, &rel)) {
+            err_exit("malformed qrels line %zu", line);
+        }
+        if (!t || t->qid != qid) {
+            t = qrels_topic(q, qid);
+        }
+        accum_dbl_slot(&t->rels, docno)->val = rel;
+    }
+
+    qsort(q->ary, q->len, sizeof(struct pf_qrels_topic), qrels_topic_cmp);
+    for (size_t i = 0; i < q->len; i++) {
+        struct pf_qrels_topic *qt = &q->ary[i];
+        struct accum_dbl *rels = (struct accum_dbl *)qt->rels;
+        qt->ideal = bmalloc(sizeof(long double) * (rels->size + 1));
+        for (size_t j = 0; j < rels->capacity; j++) {
+            if (rels->data[j].is_set && rels->data[j].val > 0) {
+                qt->ideal[qt->num_rel++] = rels->data[j].val;
+            }
+        }
+        qsort(qt->ideal, qt->num_rel, sizeof(long double), ldbl_desc_cmp);
+    }
+
+    return q;
+}
+
+void
+pf_qrels_destroy(struct pf_qrels *q)
+{
+    if (!q) {
+        return;
+    }
+
+    for (size_t i = 0; i < q->len; i++) {
+        accum_dbl_free((struct accum_dbl *)q->ary[i].rels);
+        free(q->ary[i].ideal);
+    }
+    free(q->ary);
+    free(q);
+}
+
+/*
+ * Find the judgments of a topic. Returns `NULL` if the topic is not judged.
+ */
+const struct pf_qrels_topic *
+pf_qrels_lookup(const struct pf_qrels *q, int qid)
+{
+    struct pf_qrels_topic key = {qid, NULL, 0, NULL};
+
+    return bsearch(
+        &key, q->ary, q->len, sizeof(struct pf_qrels_topic), qrels_topic_cmp);
+}
+
+void
+pf_eval_init(struct pf_eval *ev, const struct pf_qrels *qrels, size_t cutoff)
+{
+    memset(ev, 0, sizeof(*ev));
+    ev->qrels = qrels;
+    ev->cutoff = cutoff;
+}
+
+static void
+print_metric(FILE *stream, const char *name, size_t cutoff, const char *qid,
+    long double val)
+{
+    char label[32];
+
+    if (cutoff) {
+        snprintf(label, sizeof(label), "%s_%zu", name, cutoff);
+    } else {
+        snprintf(label, sizeof(label), "%s", name);
+    }
+    fprintf(stream, "%-22s\t%s\t%6.4Lf\n", label, qid, val);
+}
+
+static void
+print_metrics(
+    FILE *stream, const char *qid, const struct pf_metrics *m, size_t cutoff)
+{
+    print_metric(stream, "map", 0, qid, m->map);
+    print_metric(stream, "P", cutoff, qid, m->p);
+    print_metric(stream, "ndcg_cut", cutoff, qid, m->ndcg);
+    print_metric(stream, "recip_rank", 0, qid, m->rr);
+    print_metric(stream, "recall", 0, qid, m->recall);
+}
+
+/*
+ * Compute the metrics of one topic for the ranking `pf_present_topic` would
+ * write: the top `depth` entries of a finished selection.
+ */
+void
+pf_eval_metrics(const struct pf_qrels_topic *qt, const struct pf_topk *tk,
+    size_t depth, size_t cutoff, bool prevent_ties, struct pf_metrics *m)
+{
+    struct ranked *ranked;
+    long double dcg = 0.0, idcg = 0.0;
+    size_t n = 0, rel_ret = 0;
+
+    memset(m, 0, sizeof(*m));
+    ranked = bmalloc(sizeof(struct ranked) * (tk->size + 1));
+    for (; n < depth && n < tk->size; n++) {
+        const struct pf_topk_entry *e = &tk->ent[tk->size - n - 1];
+        ranked[n].docno = e->docno;
+        ranked[n].score = (prevent_ties ? tk->nranked - n - 1 : 0) + e->score;
+    }
+    qsort(ranked, n, sizeof(struct ranked), ranked_cmp);
+
+    for (size_t i = 0; i < n; i++) {
+        struct dbl_entry *e = accum_dbl_find(qt->rels, ranked[i].docno);
+        long double rel = e ? e->val : 0.0;
+        if (rel <= 0) {
+            continue;
+        }
+        rel_ret++;
+        m->map += (long double)rel_ret / (i + 1);
+        if (0 == m->rr) {
+            m->rr = 1.0 / (i + 1);
+        }
+        if (i < cutoff) {
+            m->p += 1;
+            dcg += rel / log2l(i + 2);
+        }
+    }
+    for (size_t i = 0; i < qt->num_rel && i < cutoff; i++) {
+        idcg += qt->ideal[i] / log2l(i + 2);
+    }
+
+    if (qt->num_rel) {
+        m->map /= qt->num_rel;
+        m->recall = (long double)rel_ret / qt->num_rel;
+    }
+    m->p /= cutoff;
+    m->ndcg = idcg > 0 ? dcg / idcg : 0.0;
+    free(ranked);
+}
+
+/*
+ * Evaluate the fused ranking of a topic and add it to the means. Returns
+ * false if the topic has no judgments.
+ */
+bool
+pf_eval_topic(struct pf_eval *ev, int qid, const struct pf_topk *tk,
+    size_t depth, bool prevent_ties)
+{
+    const struct pf_qrels_topic *qt = pf_qrels_lookup(ev->qrels, qid);
+    struct pf_metrics m;
+
+    if (!qt) {
+        return false;
+    }
+
+    pf_eval_metrics(qt, tk, depth, ev->cutoff, prevent_ties, &m);
+    if (ev->topic_out) {
+        char label[16];
+        snprintf(label, sizeof(label), "%d", qid);
+        print_metrics(ev->topic_out, label, &m, ev->cutoff);
+    }
+    ev->sum.map += m.map;
+    ev->sum.ndcg += m.ndcg;
+    ev->sum.p += m.p;
+    ev->sum.rr += m.rr;
+    ev->sum.recall += m.recall;
+    ev->ntopics++;
+
+    return true;
+}
+
+/*
+ * Select metric `which` of `m`.
+ */
+long double
+pf_metric_value(const struct pf_metrics *m, enum pf_metric which)
+{
+    switch (which) {
+    case PF_METRIC_NDCG:
+        return m->ndcg;
+    case PF_METRIC_P:
+        return m->p;
+    case PF_METRIC_RR:
+        return m->rr;
+    case PF_METRIC_RECALL:
+        return m->recall;
+    case PF_METRIC_MAP:
+    default:
+        return m->map;
+    }
+}
+
+/*
+ * Parse a metric name as printed by `pf_eval_report`, ignoring the cutoff
+ * suffix. Returns `PF_METRIC_NONE` for unknown names.
+ */
+enum pf_metric
+pf_metric_parse(const char *s)
+{
+    if (0 == strcmp(s, "map")) {
+        return PF_METRIC_MAP;
+    } else if (0 == strncmp(s, "ndcg", 4)) {
+        return PF_METRIC_NDCG;
+    } else if (0 == strncmp(s, "P", 1)) {
+        return PF_METRIC_P;
+    } else if (0 == strcmp(s, "recip_rank")) {
+        return PF_METRIC_RR;
+    } else if (0 == strcmp(s, "recall")) {
+        return PF_METRIC_RECALL;
+    }
+
+    return PF_METRIC_NONE;
+}
+
+/*
+ * Mean of each metric over the evaluated topics.
+ */
+void
+pf_eval_mean(const struct pf_eval *ev, struct pf_metrics *m)
+{
+    size_t n = ev->ntopics ? ev->ntopics : 1;
+
+    m->map = ev->sum.map / n;
+    m->ndcg = ev->sum.ndcg / n;
+    m->p = ev->sum.p / n;
+    m->rr = ev->sum.rr / n;
+    m->recall = ev->sum.recall / n;
+}
+
+/*
+ * Write the mean metrics in the format of `trec_eval`.
+ */
+void
+pf_eval_report(const struct pf_eval *ev, FILE *stream)
+{
+    struct pf_metrics m;
+
+    pf_eval_mean(ev, &m);
+    fprintf(stream, "%-22s\t%s\t%zu\n", "num_q", "all", ev->ntopics);
+    print_metrics(stream, "all", &m, ev->cutoff);
+}
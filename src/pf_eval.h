@@ -0,0 +1,103 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#ifndef PF_EVAL_H
+#define PF_EVAL_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pf_accum.h"
+#include "pf_topk.h"
+
+#define PF_EVAL_CUTOFF 10
+
+/*
+ * Relevance judgments of a topic. Documents are held in a `pf_score_t`
+ * accumulator with the relevance grade as value.
+ */
+struct pf_qrels_topic {
+    int qid;
+    struct accum *rels;
+    size_t num_rel;
+    long double *ideal;
+};
+
+/*
+ * Relevance judgments, sorted by topic.
+ */
+struct pf_qrels {
+    struct pf_qrels_topic *ary;
+    size_t len;
+    size_t alloc;
+};
+
+struct pf_metrics {
+    long double map;
+    long double ndcg;
+    long double p;
+    long double rr;
+    long double recall;
+};
+
+enum pf_metric {
+    PF_METRIC_NONE = 0,
+    PF_METRIC_MAP,
+    PF_METRIC_NDCG,
+    PF_METRIC_P,
+    PF_METRIC_RR,
+    PF_METRIC_RECALL,
+};
+
+/*
+ * Evaluation of a fused run. Per topic metrics are written to `topic_out`
+ * unless it is `NULL`. Means are taken over the evaluated topics.
+ */
+struct pf_eval {
+    const struct pf_qrels *qrels;
+    size_t cutoff;
+    FILE *topic_out;
+    struct pf_metrics sum;
+    size_t ntopics;
+};
+
+struct pf_qrels *
+pf_qrels_read(FILE *fp);
+
+void
+pf_qrels_destroy(struct pf_qrels *q);
+
+const struct pf_qrels_topic *
+pf_qrels_lookup(const struct pf_qrels *q, int qid);
+
+void
+pf_eval_init(struct pf_eval *ev, const struct pf_qrels *qrels, size_t cutoff);
+
+void
+pf_eval_metrics(const struct pf_qrels_topic *qt, const struct pf_topk *tk,
+    size_t depth, size_t cutoff, bool prevent_ties, struct pf_metrics *m);
+
+bool
+pf_eval_topic(struct pf_eval *ev, int qid, const struct pf_topk *tk,
+    size_t depth, bool prevent_ties);
+
+void
+pf_eval_mean(const struct pf_eval *ev, struct pf_metrics *m);
+
+void
+pf_eval_report(const struct pf_eval *ev, FILE *stream);
+
+long double
+pf_metric_value(const struct pf_metrics *m, enum pf_metric which);
+
+enum pf_metric
+pf_metric_parse(const char *s);
+
+#endif /* PF_EVAL_H */
@@ -0,0 +1,360 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pf_gen.h"
+#include "util.h"
+
+#define GOLDEN 0x9e3779b97f4a7c15ULL
+#define MAX_DRAWS 16
+
+/*
+ * splitmix64. Every topic of every run draws from its own stream, seeded
+ * from the seed, run and topic, so the output does not depend on the order
+ * or the threads the runs are written with.
+ */
+static uint64_t
+mix(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+    return z ^ (z >> 31);
+}
+
+static uint64_t
+next(uint64_t *s)
+{
+    return mix(*s += GOLDEN);
+}
+
+static double
+uniform(uint64_t *s)
+{
+    return (next(s) >> 11) * 0x1.0p-53;
+}
+
+static double
+exponential(uint64_t *s)
+{
+    return -log(1.0 - uniform(s));
+}
+
+static uint64_t
+stream(uint64_t seed, uint64_t run, uint64_t topic)
+{
+    return mix(mix(mix(seed) + run) + topic);
+}
+
+static uint64_t
+gcd(uint64_t a, uint64_t b)
+{
+    while (b) {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+/*
+ * Inverse of the standard normal CDF (Acklam), accurate to about 1e-9 which
+ * is the precision scores are written with.
+ */
+static double
+qnorm(double p)
+{
+    static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02,
+        -2.759285104469687e+02, 1.383577518672690e+02, -3.066479806614716e+01,
+        2.506628277459239e+00};
+    static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02,
+        -1.556989798598866e+02, 6.680131188771972e+01, -1.328068155288572e+01};
+    static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01,
+        -2.400758277161838e+00, -2.549732539343734e+00, 4.374664141464968e+00,
+        2.938163982698783e+00};
+    static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01,
+        2.445134137142996e+00, 3.754408661907416e+00};
+    double q, r;
+
+    if (p < 0.02425) {
+        q = sqrt(-2 * log(p));
+        return (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q +
+                   c[5]) /
+               ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+    } else if (p > 1 - 0.02425) {
+        return -qnorm(1 - p);
+    }
+
+    q = p - 0.5;
+    r = q * q;
+    return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r +
+               a[5]) *
+           q /
+           (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+}
+
+/*
+ * Build the alias table of a Zipf law over `n` documents (Vose).
+ */
+static void
+alias_init(struct pf_gen *g, size_t n, double s)
+{
+    uint32_t *small = bmalloc(sizeof(uint32_t) * n);
+    uint32_t *large = bmalloc(sizeof(uint32_t) * n);
+    size_t ns = 0, nl = 0;
+    double sum = 0.0;
+
+    g->prob = bmalloc(sizeof(double) * n);
+    g->alias = bmalloc(sizeof(uint32_t) * n);
+    for (size_t i = 0; i < n; i++) {
+        g->prob[i] = pow(i + 1, -s);
+        sum += g->prob[i];
+    }
+    for (size_t i = 0; i < n; i++) {
+        g->prob[i] *= n / sum;
+        g->alias[i] = i;
+        if (g->prob[i] < 1.0) {
+            small[ns++] = i;
+        } else {
+            large[nl++] = i;
+        }
+    }
+    while (ns && nl) {
+        uint32_t l = small[--ns], h = large[nl - 1];
+        g->alias[l] = h;
+        g->prob[h] -= 1.0 - g->prob[l];
+        if (g->prob[h] < 1.0) {
+            nl--;
+            small[ns++] = h;
+        }
+    }
+    while (nl) {
+        g->prob[large[--nl]] = 1.0;
+    }
+    while (ns) {
+        g->prob[small[--ns]] = 1.0;
+    }
+
+    free(small);
+    free(large);
+}
+
+void
+pf_gen_init(struct pf_gen *g, const struct pf_gen_opts *opts)
+{
+    size_t pool = opts->pool;
+
+    if (pool < opts->depth) {
+        err_exit("pool of %zu documents is smaller than the depth %zu", pool,
+            opts->depth);
+    }
+    if (pool > UINT32_MAX) {
+        err_exit("pool of %zu documents is too large", pool);
+    }
+
+    memset(g, 0, sizeof(*g));
+    g->opts = *opts;
+    g->ndocs = (uint64_t)opts->ntopics * pool;
+    alias_init(g, pool, opts->zipf);
+
+    /*
+     * Documents are numbered in order of popularity. Multiplying by a number
+     * coprime to the pool spreads them over the topic's docnos.
+     */
+    g->scramble = (uint64_t)(pool * 0.6180339887) | 1;
+    while (gcd(g->scramble, pool) != 1) {
+        g->scramble++;
+    }
+}
+
+void
+pf_gen_free(struct pf_gen *g)
+{
+    free(g->prob);
+    free(g->alias);
+}
+
+/*
+ * Write `v` in decimal, zero padded to `width` digits.
+ */
+static size_t
+fmt_uint(char *buf, uint64_t v, size_t width)
+{
+    char tmp[24];
+    size_t n = 0, len = 0;
+
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (len + n < width) {
+        buf[len++] = '0';
+    }
+    while (n) {
+        buf[len++] = tmp[--n];
+    }
+
+    return len;
+}
+
+static void
+fmt_docno(const struct pf_gen *g, char *buf, uint64_t id)
+{
+    size_t len = 0;
+
+    if (PF_GEN_DOCNO_CLUEWEB == g->opts.docno) {
+        memcpy(buf, "clueweb09-en", 12);
+        len = 12;
+        len += fmt_uint(buf + len, id / 10000000, 4);
+        buf[len++] = '-';
+        len += fmt_uint(buf + len, id / 100000 % 100, 2);
+        buf[len++] = '-';
+        len += fmt_uint(buf + len, id % 100000, 5);
+    } else {
+        len = fmt_uint(buf, id, g->opts.docno_len);
+    }
+    buf[len] = '\0';
+}
+
+/*
+ * Fill `score` with `n` scores in decreasing order. Order statistics are
+ * built from exponential spacings, so no sort is needed. Runs are given
+ * their own scale to exercise normalization.
+ */
+static void
+gen_scores(const struct pf_gen *g, uint64_t *s, double scale, double *score,
+    size_t n)
+{
+    double sum = 0.0;
+
+    switch (g->opts.score) {
+    case PF_GEN_SCORE_EXP:
+        for (size_t i = 0; i < n; i++) {
+            sum += exponential(s) / (n - i);
+            score[n - i - 1] = scale * sum;
+        }
+        break;
+    case PF_GEN_SCORE_UNIFORM:
+    case PF_GEN_SCORE_NORMAL:
+        for (size_t i = 0; i < n; i++) {
+            sum += exponential(s);
+            score[i] = sum;
+        }
+        sum += exponential(s);
+        for (size_t i = 0; i < n; i++) {
+            double u = 1.0 - score[i] / sum;
+            if (PF_GEN_SCORE_NORMAL == g->opts.score) {
+                score[i] = scale * qnorm(u);
+            } else {
+                score[i] = scale * u;
+            }
+        }
+        break;
+    case PF_GEN_SCORE_LINEAR:
+    default:
+        for (size_t i = 0; i < n; i++) {
+            score[i] = (double)(n - i) / n;
+        }
+        break;
+    }
+}
+
+/*
+ * Write run `run` to `w`. Documents of a topic are drawn by popularity
+ * without replacement: a document already in the topic is redrawn a few
+ * times, then the next free document of the pool is taken.
+ */
+void
+pf_gen_run(const struct pf_gen *g, size_t run, struct pf_writer *w)
+{
+    const struct pf_gen_opts *o = &g->opts;
+    size_t *order = bmalloc(sizeof(size_t) * (o->ntopics + 1));
+    uint32_t *seen = calloc(o->pool, sizeof(uint32_t));
+    double *score = bmalloc(sizeof(double) * (o->depth + 1));
+    uint64_t rs = stream(o->seed, run, UINT64_MAX);
+    double scale = 1.0 + 9.0 * uniform(&rs);
+    char id[32], docno[64];
+
+    if (!seen) {
+        err_exit("calloc failed");
+    }
+    snprintf(id, sizeof(id), "run%zu", run + 1);
+
+    for (size_t t = 0; t < o->ntopics; t++) {
+        order[t] = t;
+    }
+    for (size_t t = o->ntopics; o->shuffle_topics && t > 1; t--) {
+        size_t j = next(&rs) % t, tmp = order[t - 1];
+        order[t - 1] = order[j];
+        order[j] = tmp;
+    }
+
+    for (size_t t = 0; t < o->ntopics; t++) {
+        size_t topic = order[t];
+        uint64_t s = stream(o->seed, run, topic);
+        uint32_t tag = t + 1;
+        gen_scores(g, &s, scale, score, o->depth);
+        for (size_t i = 0; i < o->depth; i++) {
+            uint32_t doc = 0;
+            for (size_t d = 0; d < MAX_DRAWS; d++) {
+                double u = uniform(&s) * o->pool;
+                doc = u;
+                if (u - doc >= g->prob[doc]) {
+                    doc = g->alias[doc];
+                }
+                if (seen[doc] != tag) {
+                    break;
+                }
+            }
+            while (seen[doc] == tag) {
+                doc = doc + 1 == o->pool ? 0 : doc + 1;
+            }
+            seen[doc] = tag;
+            fmt_docno(g, docno,
+                topic * o->pool + doc * g->scramble % o->pool);
+            pf_writer_line(w, topic + 1, docno, i + 1, score[i], id);
+        }
+    }
+
+    free(score);
+    free(seen);
+    free(order);
+}
+
+enum pf_gen_score
+pf_gen_score_parse(const char *s)
+{
+    if (0 == strcmp(s, "linear")) {
+        return PF_GEN_SCORE_LINEAR;
+    } else if (0 == strcmp(s, "uniform")) {
+        return PF_GEN_SCORE_UNIFORM;
+    } else if (0 == strcmp(s, "normal")) {
+        return PF_GEN_SCORE_NORMAL;
+    } else if (0 == strcmp(s, "exp")) {
+        return PF_GEN_SCORE_EXP;
+    }
+
+    return PF_GEN_SCORE_NONE;
+}
+
+enum pf_gen_docno
+pf_gen_docno_parse(const char *s)
+{
+    if (0 == strcmp(s, "numeric")) {
+        return PF_GEN_DOCNO_NUMERIC;
+    } else if (0 == strcmp(s, "clueweb")) {
+        return PF_GEN_DOCNO_CLUEWEB;
+    }
+
+    return PF_GEN_DOCNO_NONE;
+}
@@ -0,0 +1,80 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#ifndef PF_GEN_H
+#define PF_GEN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "pf_writer.h"
+
+enum pf_gen_score {
+    PF_GEN_SCORE_NONE = 0,
+    PF_GEN_SCORE_LINEAR,
+    PF_GEN_SCORE_UNIFORM,
+    PF_GEN_SCORE_NORMAL,
+    PF_GEN_SCORE_EXP,
+};
+
+enum pf_gen_docno {
+    PF_GEN_DOCNO_NONE = 0,
+    PF_GEN_DOCNO_NUMERIC,
+    PF_GEN_DOCNO_CLUEWEB,
+};
+
+/*
+ * Shape of the generated runs. Each topic has a pool of `pool` documents
+ * whose popularity follows a Zipf law of exponent `zipf`, the same for every
+ * run, so the exponent and pool size set how much the runs overlap. Numeric
+ * docnos are zero padded to `docno_len` digits.
+ */
+struct pf_gen_opts {
+    size_t nruns;
+    size_t ntopics;
+    size_t depth;
+    size_t pool;
+    double zipf;
+    enum pf_gen_score score;
+    enum pf_gen_docno docno;
+    size_t docno_len;
+    bool shuffle_topics;
+    uint64_t seed;
+};
+
+/*
+ * Generator shared by all runs. The alias table samples the Zipf law in
+ * constant time and is read only once built, so runs can be written from
+ * several threads.
+ */
+struct pf_gen {
+    struct pf_gen_opts opts;
+    double *prob;
+    uint32_t *alias;
+    uint64_t scramble;
+    uint64_t ndocs;
+};
+
+void
+pf_gen_init(struct pf_gen *g, const struct pf_gen_opts *opts);
+
+void
+pf_gen_free(struct pf_gen *g);
+
+void
+pf_gen_run(const struct pf_gen *g, size_t run, struct pf_writer *w);
+
+enum pf_gen_score
+pf_gen_score_parse(const char *s);
+
+enum pf_gen_docno
+pf_gen_docno_parse(const char *s);
+
+#endif /* PF_GEN_H */
@@ -0,0 +1,283 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <string.h>
+
+#include "pf_kll.h"
+
+#define KLL_SEED 0x9e3779b97f4a7c15ULL
+
+struct kll_item {
+    pf_score_t val;
+    size_t weight;
+};
+
+static int
+item_cmp(const void *a, const void *b)
+{
+    pf_score_t x = ((const struct kll_item *)a)->val;
+    pf_score_t y = ((const struct kll_item *)b)->val;
+
+    return (x > y) - (x < y);
+}
+
+static int
+score_cmp(const void *a, const void *b)
+{
+    pf_score_t x = *(const pf_score_t *)a, y = *(const pf_score_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * xorshift64, for the offsets of compactions.
+ */
+static bool
+kll_coin(struct pf_kll *s)
+{
+    s->rng ^= s->rng << 13;
+    s->rng ^= s->rng >> 7;
+    s->rng ^= s->rng << 17;
+
+    return s->rng & 1;
+}
+
+/*
+ * Items level `h` holds before it is compacted.
+ */
+static size_t
+kll_capacity(const struct pf_kll *s, size_t h)
+{
+    double cap = s->k;
+
+    for (size_t i = h + 1; i < s->nlevels; i++) {
+        cap *= 2.0 / 3.0;
+    }
+
+    return cap < 2 ? 2 : (size_t)cap;
+}
+
+static void
+kll_set_levels(struct pf_kll *s, size_t nlevels)
+{
+    s->nlevels = nlevels;
+    s->capacity = 0;
+    for (size_t h = 0; h < nlevels; h++) {
+        s->capacity += kll_capacity(s, h);
+    }
+}
+
+static void
+kll_push(struct pf_kll_level *l, pf_score_t x)
+{
+    if (l->len == l->alloc) {
+        l->alloc = l->alloc ? l->alloc * 2 : 16;
+        l->items = brealloc(l->items, sizeof(pf_score_t) * l->alloc);
+    }
+    l->items[l->len++] = x;
+}
+
+static void
+kll_grow(struct pf_kll *s, size_t nlevels)
+{
+    if (nlevels > s->levels_alloc) {
+        size_t old = s->levels_alloc;
+        s->levels_alloc = nlevels * 2;
+        s->levels = brealloc(
+            s->levels, sizeof(struct pf_kll_level) * s->levels_alloc);
+        memset(s->levels + old, 0,
+            sizeof(struct pf_kll_level) * (s->levels_alloc - old));
+    }
+    if (nlevels > s->nlevels) {
+        kll_set_levels(s, nlevels);
+    }
+}
+
+/*
+ * Promote every other item of the sorted level `h` to the level above. An
+ * odd item out stays.
+ */
+static void
+kll_compact(struct pf_kll *s, size_t h)
+{
+    struct pf_kll_level *l;
+    size_t m;
+
+    kll_grow(s, h + 2);
+    l = &s->levels[h];
+    qsort(l->items, l->len, sizeof(pf_score_t), score_cmp);
+    m = l->len & ~(size_t)1;
+    for (size_t i = kll_coin(s); i < m; i += 2) {
+        kll_push(&s->levels[h + 1], l->items[i]);
+    }
+    memmove(l->items, l->items + m, sizeof(pf_score_t) * (l->len - m));
+    l->len -= m;
+    s->size -= m / 2;
+}
+
+static void
+kll_compress(struct pf_kll *s)
+{
+    while (s->size >= s->capacity) {
+        for (size_t h = 0; h < s->nlevels; h++) {
+            if (s->levels[h].len >= kll_capacity(s, h)) {
+                kll_compact(s, h);
+                break;
+            }
+        }
+    }
+}
+
+/*
+ * Sort the items with their cumulative weights for queries.
+ */
+static void
+kll_sort(struct pf_kll *s)
+{
+    struct kll_item *items;
+    size_t n = 0, cum = 0;
+
+    if (!s->stale) {
+        return;
+    }
+    items = bmalloc(sizeof(struct kll_item) * (s->size + 1));
+    for (size_t h = 0; h < s->nlevels; h++) {
+        for (size_t i = 0; i < s->levels[h].len; i++) {
+            items[n].val = s->levels[h].items[i];
+            items[n++].weight = (size_t)1 << h;
+        }
+    }
+    qsort(items, n, sizeof(struct kll_item), item_cmp);
+    s->sorted = brealloc(s->sorted, sizeof(pf_score_t) * (n + 1));
+    s->cum = brealloc(s->cum, sizeof(size_t) * (n + 1));
+    for (size_t i = 0; i < n; i++) {
+        cum += items[i].weight;
+        s->sorted[i] = items[i].val;
+        s->cum[i] = cum;
+    }
+    s->nsorted = n;
+    s->stale = false;
+    free(items);
+}
+
+void
+pf_kll_init(struct pf_kll *s, size_t k)
+{
+    memset(s, 0, sizeof(*s));
+    s->k = k < 8 ? 8 : k;
+    s->rng = KLL_SEED;
+    kll_grow(s, 1);
+}
+
+void
+pf_kll_free(struct pf_kll *s)
+{
+    for (size_t h = 0; h < s->levels_alloc; h++) {
+        free(s->levels[h].items);
+    }
+    free(s->levels);
+    free(s->sorted);
+    free(s->cum);
+    memset(s, 0, sizeof(*s));
+}
+
+/*
+ * Empty the sketch for another stream, keeping its memory.
+ */
+void
+pf_kll_reset(struct pf_kll *s)
+{
+    for (size_t h = 0; h < s->nlevels; h++) {
+        s->levels[h].len = 0;
+    }
+    kll_set_levels(s, 1);
+    s->n = s->size = 0;
+    s->rng = KLL_SEED;
+    s->stale = true;
+}
+
+void
+pf_kll_add(struct pf_kll *s, pf_score_t x)
+{
+    kll_push(&s->levels[0], x);
+    s->n++;
+    s->size++;
+    s->stale = true;
+    if (s->size >= s->capacity) {
+        kll_compress(s);
+    }
+}
+
+/*
+ * Add the stream of `other` to `s`.
+ */
+void
+pf_kll_merge(struct pf_kll *s, const struct pf_kll *other)
+{
+    kll_grow(s, other->nlevels);
+    for (size_t h = 0; h < other->nlevels; h++) {
+        const struct pf_kll_level *l = &other->levels[h];
+        for (size_t i = 0; i < l->len; i++) {
+            kll_push(&s->levels[h], l->items[i]);
+        }
+        s->size += l->len;
+    }
+    s->n += other->n;
+    s->stale = true;
+    kll_compress(s);
+}
+
+/*
+ * The smallest score with at least `q` of the stream at or below it, or 0
+ * for an empty sketch.
+ */
+pf_score_t
+pf_kll_quantile(struct pf_kll *s, double q)
+{
+    double target = q * s->n;
+    size_t lo = 0, hi;
+
+    kll_sort(s);
+    if (0 == s->nsorted) {
+        return 0.0;
+    }
+    hi = s->nsorted - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if ((double)s->cum[mid] >= target) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    return s->sorted[lo];
+}
+
+/*
+ * The share of the stream at or below `x`.
+ */
+double
+pf_kll_cdf(struct pf_kll *s, pf_score_t x)
+{
+    size_t lo = 0, hi;
+
+    kll_sort(s);
+    hi = s->nsorted;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (s->sorted[mid] <= x) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo ? (double)s->cum[lo - 1] / s->n : 0.0;
+}
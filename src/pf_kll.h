@@ -0,0 +1,78 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#ifndef PF_KLL_H
+#define PF_KLL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "util.h"
+
+/* default size of the top compactor */
+#define PF_KLL_K 256
+
+struct pf_kll_level {
+    pf_score_t *items;
+    size_t len;
+    size_t alloc;
+};
+
+/*
+ * A KLL quantile sketch of a stream of scores. Level `h` holds items of
+ * weight 2^h; when the sketch is full the lowest full level is sorted and
+ * every other item, starting at a pseudo random offset, is promoted to the
+ * level above. Levels shrink by 2/3 going down from the top one of `k`
+ * items, so the sketch holds O(k) items for any number of scores, and the
+ * rank error is about 1.7 / k of the stream. Up to `k` scores are kept
+ * exactly.
+ *
+ * The offsets come from a fixed seed, so a stream always gives the same
+ * sketch. Sketches of parts of a stream merge with `pf_kll_merge`.
+ */
+struct pf_kll {
+    size_t k;
+    size_t n;
+    size_t size;
+    struct pf_kll_level *levels;
+    size_t nlevels;
+    size_t levels_alloc;
+    /* items held before the sketch is compacted */
+    size_t capacity;
+    uint64_t rng;
+    /* sorted items and cumulative weights, built on the first query */
+    pf_score_t *sorted;
+    size_t *cum;
+    size_t nsorted;
+    bool stale;
+};
+
+void
+pf_kll_init(struct pf_kll *s, size_t k);
+
+void
+pf_kll_free(struct pf_kll *s);
+
+void
+pf_kll_reset(struct pf_kll *s);
+
+void
+pf_kll_add(struct pf_kll *s, pf_score_t x);
+
+void
+pf_kll_merge(struct pf_kll *s, const struct pf_kll *other);
+
+pf_score_t
+pf_kll_quantile(struct pf_kll *s, double q);
+
+double
+pf_kll_cdf(struct pf_kll *s, pf_score_t x);
+
+#endif /* PF_KLL_H */
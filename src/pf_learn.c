@@ -0,0 +1,318 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "pf_learn.h"
+#include "pf_score.h"
+
+/* smallest gain of a step to be taken */
+#define LEARN_EPS 1e-9
+
+static const long double steps[] = {0.01, 0.05, 0.1, 0.25, 0.5, 1.0, 2.0};
+#define NSTEPS (sizeof(steps) / sizeof(steps[0]))
+
+/*
+ * Candidate weights of one run, evaluated on a share of the topics. The
+ * metric of candidate `c` on topic `t` goes to `val[c * ntopics + t]`.
+ */
+struct learn_task {
+    struct pf_learn *l;
+    const bool *topics;
+    size_t run;
+    const long double *delta;
+    size_t ncand;
+    long double *val;
+    size_t tid;
+};
+
+/*
+ * Create a learner for `params` over the judged topics of `rs`. Only
+ * methods that sum the contributions of runs can be weighted.
+ */
+void
+pf_learn_init(struct pf_learn *l, const struct pf_runset *rs,
+    const struct pf_qrels *qrels, const struct pf_params *params)
+{
+    pf_score_t *rbc = NULL;
+
+    switch (params->type) {
+    case TCOMBMAX:
+    case TCOMBMED:
+    case TCOMBMIN:
+    case TCONDORCET:
+    case TMC4:
+    case TNONE:
+        err_exit("%s does not take run weights", fusetype_str[params->type]);
+        break;
+    default:
+        break;
+    }
+
+    memset(l, 0, sizeof(*l));
+    l->rs = rs;
+    l->params = *params;
+    l->params.weights = NULL;
+    l->metric = PF_METRIC_MAP;
+    l->depth = rs->max_rank;
+    l->passes = PF_LEARN_PASSES;
+    l->nthreads = 1;
+    l->judged = bmalloc(sizeof(struct pf_qrels_topic *) * (rs->ntopics + 1));
+    l->contrib = bmalloc(sizeof(pf_score_t *) * (rs->ntopics + 1));
+    l->base = bmalloc(sizeof(pf_score_t *) * (rs->ntopics + 1));
+    l->count = bmalloc(sizeof(size_t *) * (rs->ntopics + 1));
+
+    if (TRBC == params->type) {
+        rbc = bmalloc(sizeof(pf_score_t) * (rs->max_rank + 1));
+        pf_score_rbc_weights(rbc, params->phi, rs->max_rank);
+    }
+
+    for (size_t t = 0; t < rs->ntopics; t++) {
+        const struct pf_rs_topic *rt = &rs->topics[t];
+        l->judged[t] = pf_qrels_lookup(qrels, rt->qid);
+        l->contrib[t] = bmalloc(sizeof(pf_score_t) * (rt->npost + 1));
+        l->base[t] = bmalloc(sizeof(pf_score_t) * (rt->ndocs + 1));
+        l->count[t] = bmalloc(sizeof(size_t) * (rt->ndocs + 1));
+        for (size_t i = 0; i < rs->nruns; i++) {
+            for (size_t j = rt->run_off[i]; j < rt->run_off[i + 1]; j++) {
+                l->contrib[t][j] =
+                    pf_runset_contrib(rs, i, &rt->post[j], &l->params, rbc);
+                l->count[t][rt->post[j].doc]++;
+            }
+        }
+        if (rt->ndocs > l->max_docs) {
+            l->max_docs = rt->ndocs;
+        }
+    }
+    free(rbc);
+}
+
+void
+pf_learn_free(struct pf_learn *l)
+{
+    for (size_t t = 0; t < l->rs->ntopics; t++) {
+        free(l->contrib[t]);
+        free(l->base[t]);
+        free(l->count[t]);
+    }
+    free(l->judged);
+    free(l->contrib);
+    free(l->base);
+    free(l->count);
+}
+
+/*
+ * Recompute the fused scores of weights `w` from scratch. Runs are summed in
+ * the order of `pf_runset_fuse`, each weight rounded to `pf_score_t` first
+ * as there, so the scores match a weighted fusion bit for bit.
+ */
+static void
+learn_rebuild(struct pf_learn *l, const long double *w)
+{
+    const struct pf_runset *rs = l->rs;
+
+    for (size_t t = 0; t < rs->ntopics; t++) {
+        const struct pf_rs_topic *rt = &rs->topics[t];
+        pf_score_t *base = l->base[t];
+        memset(base, 0, sizeof(pf_score_t) * rt->ndocs);
+        for (size_t i = 0; i < rs->nruns; i++) {
+            for (size_t j = rt->run_off[i]; j < rt->run_off[i + 1]; j++) {
+                pf_score_t s = (pf_score_t)w[i] * l->contrib[t][j];
+                base[rt->post[j].doc] += s;
+            }
+        }
+    }
+}
+
+/*
+ * Move the weight of `run` by `delta` in the fused scores, from the
+ * contributions of its postings only. The scores are those the candidate
+ * was evaluated with.
+ */
+static void
+learn_apply(struct pf_learn *l, size_t run, long double delta)
+{
+    const struct pf_runset *rs = l->rs;
+
+    for (size_t t = 0; t < rs->ntopics; t++) {
+        const struct pf_rs_topic *rt = &rs->topics[t];
+        pf_score_t *base = l->base[t];
+        for (size_t j = rt->run_off[run]; j < rt->run_off[run + 1]; j++) {
+            base[rt->post[j].doc] += delta * l->contrib[t][j];
+        }
+    }
+}
+
+static void *
+learn_worker(void *arg)
+{
+    struct learn_task *task = arg;
+    struct pf_learn *l = task->l;
+    const struct pf_runset *rs = l->rs;
+    pf_score_t *score = bmalloc(sizeof(pf_score_t) * (l->max_docs + 1));
+    struct pf_topk tk = {0};
+    size_t depth = l->depth < rs->max_rank ? l->depth : rs->max_rank;
+
+    for (size_t t = task->tid; t < rs->ntopics; t += l->nthreads) {
+        const struct pf_rs_topic *rt = &rs->topics[t];
+        if (!task->topics[t] || !l->judged[t]) {
+            continue;
+        }
+        for (size_t c = 0; c < task->ncand; c++) {
+            struct pf_metrics m;
+            memcpy(score, l->base[t], sizeof(pf_score_t) * rt->ndocs);
+            for (size_t j = rt->run_off[task->run];
+                 j < rt->run_off[task->run + 1]; j++) {
+                score[rt->post[j].doc] += task->delta[c] * l->contrib[t][j];
+            }
+            pf_topk_reset(&tk, depth, rs->max_rank);
+            for (size_t d = 0; d < rt->ndocs; d++) {
+                pf_score_t s =
+                    pf_score_final(l->params.type, score[d], l->count[t][d]);
+                pf_topk_push(&tk, s, rt->docno[d]);
+            }
+            pf_topk_finish(&tk);
+            pf_eval_metrics(l->judged[t], &tk, depth, PF_EVAL_CUTOFF,
+                l->prevent_ties, &m);
+            task->val[c * rs->ntopics + t] = pf_metric_value(&m, l->metric);
+        }
+    }
+
+    pf_topk_free(&tk);
+    free(score);
+
+    return NULL;
+}
+
+/*
+ * Evaluate moving the weight of `run` by each of `delta` from the current
+ * scores. Topics are shared out between the threads.
+ */
+static void
+learn_candidates(struct pf_learn *l, const bool *topics, size_t run,
+    const long double *delta, size_t ncand, long double *val)
+{
+    struct learn_task *task = bmalloc(sizeof(struct learn_task) * l->nthreads);
+    pthread_t *tid = bmalloc(sizeof(pthread_t) * l->nthreads);
+
+    for (size_t i = 0; i < l->nthreads; i++) {
+        task[i] = (struct learn_task){l, topics, run, delta, ncand, val, i};
+    }
+    for (size_t i = 1; i < l->nthreads; i++) {
+        if (pthread_create(&tid[i], NULL, learn_worker, &task[i])) {
+            err_exit("unable to create thread");
+        }
+    }
+    learn_worker(&task[0]);
+    for (size_t i = 1; i < l->nthreads; i++) {
+        pthread_join(tid[i], NULL);
+    }
+
+    free(tid);
+    free(task);
+}
+
+/*
+ * Mean of candidate values over the judged topics of `topics`. Topics are
+ * summed in order, so the result does not depend on the thread count.
+ */
+static long double
+learn_mean(const struct pf_learn *l, const bool *topics,
+    const long double *val)
+{
+    long double sum = 0.0;
+    size_t n = 0;
+
+    for (size_t t = 0; t < l->rs->ntopics; t++) {
+        if (topics[t] && l->judged[t]) {
+            sum += val[t];
+            n++;
+        }
+    }
+
+    return n ? sum / n : 0.0;
+}
+
+/*
+ * Mean metric of weights `w` over the judged topics of `topics`.
+ */
+long double
+pf_learn_eval(struct pf_learn *l, const bool *topics, const long double *w)
+{
+    long double *val = bmalloc(sizeof(long double) * (l->rs->ntopics + 1));
+    long double zero = 0.0, mean;
+
+    learn_rebuild(l, w);
+    learn_candidates(l, topics, 0, &zero, 1, val);
+    mean = learn_mean(l, topics, val);
+    free(val);
+
+    return mean;
+}
+
+/*
+ * Learn the weights of the runs on `topics` by coordinate ascent, starting
+ * from `w`. In each pass every weight in turn takes the best of a range of
+ * steps. The weights are rescaled to a mean of one after a pass, which does
+ * not change the ranking, and the scores are rebuilt from scratch so they
+ * sum as `pf_runset_fuse` does. Returns the mean metric of the learned
+ * weights.
+ */
+long double
+pf_learn_fit(struct pf_learn *l, const bool *topics, long double *w)
+{
+    size_t nruns = l->rs->nruns, ntopics = l->rs->ntopics;
+    long double delta[NSTEPS * 2];
+    long double *val = bmalloc(sizeof(long double) * NSTEPS * 2 * ntopics);
+    long double cur = pf_learn_eval(l, topics, w);
+
+    for (size_t pass = 0; pass < l->passes; pass++) {
+        bool improved = false;
+        long double sum = 0.0;
+        for (size_t i = 0; i < nruns; i++) {
+            size_t ncand = 0;
+            long best = -1;
+            long double best_val = cur + LEARN_EPS;
+            for (size_t s = 0; s < NSTEPS; s++) {
+                delta[ncand++] = steps[s];
+                if (w[i] - steps[s] >= 0) {
+                    delta[ncand++] = -steps[s];
+                }
+            }
+            learn_candidates(l, topics, i, delta, ncand, val);
+            for (size_t c = 0; c < ncand; c++) {
+                long double m = learn_mean(l, topics, val + c * ntopics);
+                if (m > best_val) {
+                    best = c;
+                    best_val = m;
+                }
+            }
+            if (best >= 0) {
+                w[i] += delta[best];
+                learn_apply(l, i, delta[best]);
+                cur = best_val;
+                improved = true;
+            }
+        }
+        if (!improved) {
+            break;
+        }
+        for (size_t i = 0; i < nruns; i++) {
+            sum += w[i];
+        }
+        for (size_t i = 0; sum > 0 && i < nruns; i++) {
+            w[i] *= nruns / sum;
+        }
+        cur = pf_learn_eval(l, topics, w);
+    }
+    free(val);
+
+    return cur;
+}
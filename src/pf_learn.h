@@ -0,0 +1,56 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#ifndef PF_LEARN_H
+#define PF_LEARN_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "pf_eval.h"
+#include "pf_runset.h"
+
+#define PF_LEARN_PASSES 20
+
+/*
+ * Coordinate ascent over the run weights of an additive fusion method.
+ *
+ * The unweighted contribution of every posting is computed once, and the
+ * fused scores of the current weights are kept per topic. Moving the weight
+ * of one run then only touches the postings of that run.
+ */
+struct pf_learn {
+    const struct pf_runset *rs;
+    struct pf_params params;
+    enum pf_metric metric;
+    size_t depth;
+    size_t passes;
+    size_t nthreads;
+    bool prevent_ties;
+    const struct pf_qrels_topic **judged;
+    pf_score_t **contrib;
+    pf_score_t **base;
+    size_t **count;
+    size_t max_docs;
+};
+
+void
+pf_learn_init(struct pf_learn *l, const struct pf_runset *rs,
+    const struct pf_qrels *qrels, const struct pf_params *params);
+
+void
+pf_learn_free(struct pf_learn *l);
+
+long double
+pf_learn_eval(struct pf_learn *l, const bool *topics, const long double *w);
+
+long double
+pf_learn_fit(struct pf_learn *l, const bool *topics, long double *w);
+
+#endif /* PF_LEARN_H */
@@ -0,0 +1,278 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "pf_condorcet.h"
+#include "pf_mc4.h"
+
+/*
+ * Row `b` lists the documents `b` beats, `beaten[a]` counts the documents
+ * beating `a`.
+ */
+struct mc4_csr {
+    size_t *off;
+    uint32_t *col;
+    size_t nnz;
+    size_t alloc;
+    uint32_t *beaten;
+};
+
+struct doc_ref {
+    const char *docno;
+    size_t idx;
+};
+
+static int
+doc_ref_cmp(const void *a, const void *b)
+{
+    return strcmp(((const struct doc_ref *)a)->docno,
+        ((const struct doc_ref *)b)->docno);
+}
+
+/*
+ * The documents each run ranks, as numbered in the chain, and their ranks.
+ */
+struct mc4_lists {
+    size_t *off;
+    uint32_t *doc;
+    uint16_t *rank;
+};
+
+static void
+lists_build(struct mc4_lists *l, const uint16_t *ranks, size_t nvoters,
+    const size_t *order, size_t n)
+{
+    size_t *fill = bmalloc(sizeof(size_t) * (nvoters + 1));
+
+    l->off = bmalloc(sizeof(size_t) * (nvoters + 1));
+    memset(l->off, 0, sizeof(size_t) * (nvoters + 1));
+    for (size_t d = 0; d < n * nvoters; d++) {
+        if (ranks[d] != PF_CONDORCET_UNRANKED) {
+            l->off[d % nvoters + 1]++;
+        }
+    }
+    for (size_t v = 0; v < nvoters; v++) {
+        l->off[v + 1] += l->off[v];
+    }
+    memcpy(fill, l->off, sizeof(size_t) * (nvoters + 1));
+    l->doc = bmalloc(sizeof(uint32_t) * (l->off[nvoters] + 1));
+    l->rank = bmalloc(sizeof(uint16_t) * (l->off[nvoters] + 1));
+    for (size_t a = 0; a < n; a++) {
+        const uint16_t *ra = ranks + order[a] * nvoters;
+        for (size_t v = 0; v < nvoters; v++) {
+            if (ra[v] != PF_CONDORCET_UNRANKED) {
+                l->doc[fill[v]] = a;
+                l->rank[fill[v]++] = ra[v];
+            }
+        }
+    }
+    free(fill);
+}
+
+static void
+lists_free(struct mc4_lists *l)
+{
+    free(l->off);
+    free(l->doc);
+    free(l->rank);
+}
+
+/*
+ * Merge the `nruns` ascending runs of `a`, run `r` starting at `bound[r]`,
+ * pairwise through `tmp`. Returns whichever of `a` and `tmp` holds the
+ * merged result.
+ */
+static uint32_t *
+runs_merge(uint32_t *a, uint32_t *tmp, size_t *bound, size_t nruns)
+{
+    while (nruns > 1) {
+        size_t m = 0;
+        uint32_t *swap;
+        for (size_t r = 0; r < nruns; r += 2) {
+            size_t i = bound[r], o = bound[r], mid = bound[r + 1];
+            size_t j = mid, end = r + 2 <= nruns ? bound[r + 2] : mid;
+            while (i < mid && j < end) {
+                tmp[o++] = a[i] < a[j] ? a[i++] : a[j++];
+            }
+            while (i < mid) {
+                tmp[o++] = a[i++];
+            }
+            while (j < end) {
+                tmp[o++] = a[j++];
+            }
+            bound[m++] = bound[r];
+        }
+        bound[m] = bound[nruns];
+        nruns = m;
+        swap = a;
+        a = tmp;
+        tmp = swap;
+    }
+
+    return a;
+}
+
+/*
+ * Documents are numbered in docno order, through `order`, so the sums, and
+ * the near ties they decide, do not depend on how the documents were
+ * gathered.
+ *
+ * Only the runs ranking both of two documents take part in their majority,
+ * so a row is counted by walking the lists of the runs ranking its
+ * document, rather than comparing it with every document over every run.
+ * Only the documents met on the way are visited and reset. Each list is in
+ * number order, so merging the new documents of each run keeps the columns
+ * of a row sorted.
+ */
+static void
+csr_build(struct mc4_csr *g, const uint16_t *ranks, size_t nvoters,
+    const size_t *order, size_t n)
+{
+    struct mc4_lists l;
+    int *wins = bmalloc(sizeof(int) * (n + 1));
+    bool *seen = bmalloc(sizeof(bool) * (n + 1));
+    uint32_t *touched = bmalloc(sizeof(uint32_t) * (n + 1));
+    uint32_t *tmp = bmalloc(sizeof(uint32_t) * (n + 1));
+    size_t *bound = bmalloc(sizeof(size_t) * (nvoters + 1));
+
+    lists_build(&l, ranks, nvoters, order, n);
+    memset(wins, 0, sizeof(int) * (n + 1));
+    memset(seen, 0, sizeof(bool) * (n + 1));
+    g->off = bmalloc(sizeof(size_t) * (n + 1));
+    g->beaten = bmalloc(sizeof(uint32_t) * (n + 1));
+    memset(g->beaten, 0, sizeof(uint32_t) * (n + 1));
+    g->alloc = n;
+    g->col = bmalloc(sizeof(uint32_t) * g->alloc);
+    g->nnz = 0;
+
+    for (size_t b = 0; b < n; b++) {
+        const uint16_t *rb = ranks + order[b] * nvoters;
+        const uint32_t *row;
+        size_t ntouched = 0, nruns = 0;
+        for (size_t v = 0; v < nvoters; v++) {
+            if (PF_CONDORCET_UNRANKED == rb[v]) {
+                continue;
+            }
+            if (0 == nruns || bound[nruns - 1] < ntouched) {
+                bound[nruns++] = ntouched;
+            }
+            for (size_t j = l.off[v]; j < l.off[v + 1]; j++) {
+                const uint32_t a = l.doc[j];
+                if (!seen[a]) {
+                    seen[a] = true;
+                    touched[ntouched++] = a;
+                }
+                wins[a] += (rb[v] < l.rank[j]) - (l.rank[j] < rb[v]);
+            }
+        }
+        if (nruns > 0 && bound[nruns - 1] == ntouched) {
+            nruns--;
+        }
+        bound[nruns] = ntouched;
+        row = runs_merge(touched, tmp, bound, nruns);
+        g->off[b] = g->nnz;
+        for (size_t k = 0; k < ntouched; k++) {
+            const uint32_t a = row[k];
+            if (wins[a] > 0) {
+                if (g->nnz == g->alloc) {
+                    g->alloc *= 2;
+                    g->col = brealloc(g->col, sizeof(uint32_t) * g->alloc);
+                }
+                g->col[g->nnz++] = a;
+            } else if (wins[a] < 0) {
+                g->beaten[b]++;
+            }
+            wins[a] = 0;
+            seen[a] = false;
+        }
+    }
+    g->off[n] = g->nnz;
+    free(bound);
+    free(tmp);
+    free(touched);
+    free(seen);
+    free(wins);
+    lists_free(&l);
+}
+
+static void
+csr_free(struct mc4_csr *g)
+{
+    free(g->off);
+    free(g->col);
+    free(g->beaten);
+}
+
+size_t
+pf_mc4_stationary(const uint16_t *ranks, size_t nvoters, char *const *docno,
+    size_t n, double tol, size_t max_iter, pf_score_t *pi)
+{
+    struct mc4_csr g;
+    struct doc_ref *refs;
+    size_t *order;
+    double *p, *next, step;
+    uint32_t most = 0;
+    size_t iter = 0;
+
+    if (0 == n) {
+        return 0;
+    }
+    refs = bmalloc(sizeof(struct doc_ref) * n);
+    order = bmalloc(sizeof(size_t) * n);
+    for (size_t i = 0; i < n; i++) {
+        refs[i] = (struct doc_ref){docno[i], i};
+    }
+    qsort(refs, n, sizeof(struct doc_ref), doc_ref_cmp);
+    for (size_t i = 0; i < n; i++) {
+        order[i] = refs[i].idx;
+    }
+    free(refs);
+    csr_build(&g, ranks, nvoters, order, n);
+    p = bmalloc(sizeof(double) * n);
+    next = bmalloc(sizeof(double) * n);
+    for (size_t d = 0; d < n; d++) {
+        p[d] = 1.0 / n;
+        most = g.beaten[d] > most ? g.beaten[d] : most;
+    }
+    step = most ? 1.0 / most : 0.0;
+
+    while (most && iter < max_iter) {
+        double moved = 0.0, *tmp;
+        iter++;
+        for (size_t b = 0; b < n; b++) {
+            double in = 0.0;
+            for (size_t j = g.off[b]; j < g.off[b + 1]; j++) {
+                in += p[g.col[j]];
+            }
+            next[b] = (1.0 - PF_MC4_JUMP) *
+                          (p[b] * (1.0 - g.beaten[b] * step) + in * step) +
+                      PF_MC4_JUMP / n;
+            moved += fabs(next[b] - p[b]);
+        }
+        tmp = p;
+        p = next;
+        next = tmp;
+        if (moved < tol) {
+            break;
+        }
+    }
+
+    for (size_t d = 0; d < n; d++) {
+        pi[order[d]] = p[d] * n;
+    }
+    free(order);
+    free(p);
+    free(next);
+    csr_free(&g);
+
+    return iter;
+}
@@ -0,0 +1,46 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#ifndef PF_MC4_H
+#define PF_MC4_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "util.h"
+
+/* defaults of the convergence tolerance and the cap on iterations */
+#define PF_MC4_TOL 1e-9
+#define PF_MC4_ITERS 1000
+/* chance of a jump to any document, which makes the chain ergodic */
+#define PF_MC4_JUMP 0.15
+
+/*
+ * MC4 rank aggregation (Dwork et al., 2001). From document `a` the chain
+ * moves to a document `b` that a majority of the runs ranking both rank
+ * above `a`, or stays. Documents are ranked by the stationary distribution.
+ *
+ * The moves are kept in CSR form, one row per document listing the
+ * documents it beats, so memory follows the pairs a majority orders rather
+ * than n^2. Each move is taken with the same chance `1 / d`, `d` the most
+ * documents beating any one, which mixes faster than the `1 / n` of the
+ * paper and has the same stationary distribution before the jump.
+ *
+ * `ranks` holds the ranks of document `d` by the `nvoters` runs at
+ * `ranks + d * nvoters`, and its docno at `docno[d]`, as for
+ * `pf_condorcet_sort`. The stationary
+ * distribution times `n` is written to `pi`. Power iteration stops once an
+ * iteration moves less than `tol` of the mass, or after `max_iter`.
+ * Returns the iterations taken.
+ */
+size_t
+pf_mc4_stationary(const uint16_t *ranks, size_t nvoters, char *const *docno,
+    size_t n, double tol, size_t max_iter, pf_score_t *pi);
+
+#endif /* PF_MC4_H */
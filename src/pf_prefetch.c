@@ -0,0 +1,301 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+/* `fopencookie` */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pf_prefetch.h"
+#include "util.h"
+
+/*
+ * A chunk of a file. The last chunk of a file is shorter than a full one,
+ * possibly empty, and carries the `errno` of a failed open or read.
+ */
+struct chunk {
+    char *buf;
+    size_t len;
+    bool last;
+    int err;
+};
+
+struct pf_prefetch {
+    char **paths;
+    size_t n;
+    struct chunk ring[PF_PREFETCH_CHUNKS];
+    size_t head;
+    size_t tail;
+    size_t count;
+    bool stop;
+    pthread_t tid;
+    pthread_mutex_t lock;
+    pthread_cond_t filled;
+    pthread_cond_t freed;
+    /* the caller's side: the next file and the position in the head chunk */
+    size_t next;
+    size_t pos;
+    bool eof;
+};
+
+/*
+ * Wait for a free chunk to fill. Returns `NULL` once stopped.
+ */
+static struct chunk *
+ring_acquire(struct pf_prefetch *pf)
+{
+    struct chunk *c = NULL;
+
+    pthread_mutex_lock(&pf->lock);
+    while (PF_PREFETCH_CHUNKS == pf->count && !pf->stop) {
+        pthread_cond_wait(&pf->freed, &pf->lock);
+    }
+    if (!pf->stop) {
+        c = &pf->ring[pf->tail];
+    }
+    pthread_mutex_unlock(&pf->lock);
+
+    return c;
+}
+
+static void
+ring_publish(struct pf_prefetch *pf)
+{
+    pthread_mutex_lock(&pf->lock);
+    pf->tail = (pf->tail + 1) % PF_PREFETCH_CHUNKS;
+    pf->count++;
+    pthread_cond_signal(&pf->filled);
+    pthread_mutex_unlock(&pf->lock);
+}
+
+/*
+ * Wait for the oldest chunk read. The reader leaves it alone until it is
+ * released.
+ */
+static struct chunk *
+ring_head(struct pf_prefetch *pf)
+{
+    struct chunk *c;
+
+    pthread_mutex_lock(&pf->lock);
+    while (0 == pf->count) {
+        pthread_cond_wait(&pf->filled, &pf->lock);
+    }
+    c = &pf->ring[pf->head];
+    pthread_mutex_unlock(&pf->lock);
+
+    return c;
+}
+
+static void
+ring_release(struct pf_prefetch *pf)
+{
+    pthread_mutex_lock(&pf->lock);
+    pf->head = (pf->head + 1) % PF_PREFETCH_CHUNKS;
+    pf->count--;
+    pthread_cond_signal(&pf->freed);
+    pthread_mutex_unlock(&pf->lock);
+}
+
+/*
+ * Fill `buf` from `off` of `fd` up to `len` bytes or the end of the file.
+ * Returns the bytes read, or -1.
+ */
+static ssize_t
+read_full(int fd, char *buf, size_t len, off_t off)
+{
+    size_t got = 0;
+
+    while (got < len) {
+        ssize_t n = pread(fd, buf + got, len - got, off + got);
+        if (n < 0 && EINTR == errno) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (0 == n) {
+            break;
+        }
+        got += n;
+    }
+
+    return got;
+}
+
+static void *
+prefetch_reader(void *arg)
+{
+    struct pf_prefetch *pf = arg;
+
+    for (size_t i = 0; i < pf->n; i++) {
+        int fd = open(pf->paths[i], O_RDONLY);
+        int err = fd < 0 ? errno : 0;
+        off_t off = 0;
+        bool last = false;
+
+        if (fd >= 0) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        }
+        while (!last) {
+            struct chunk *c = ring_acquire(pf);
+            ssize_t got = 0;
+            if (!c) {
+                if (fd >= 0) {
+                    close(fd);
+                }
+                return NULL;
+            }
+            if (!err) {
+                got = read_full(fd, c->buf, PF_PREFETCH_CHUNK, off);
+            }
+            if (got < 0) {
+                err = errno;
+                got = 0;
+            }
+            c->len = got;
+            c->err = err;
+            c->last = last = err || got < PF_PREFETCH_CHUNK;
+            off += got;
+            ring_publish(pf);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    return NULL;
+}
+
+static ssize_t
+prefetch_read(void *cookie, char *buf, size_t size)
+{
+    struct pf_prefetch *pf = cookie;
+    size_t done = 0;
+
+    while (done < size && !pf->eof) {
+        struct chunk *c = ring_head(pf);
+        size_t n = c->len - pf->pos;
+        if (c->err) {
+            err_exit("%s: %s", pf->paths[pf->next - 1], strerror(c->err));
+        }
+        if (n > size - done) {
+            n = size - done;
+        }
+        memcpy(buf + done, c->buf + pf->pos, n);
+        done += n;
+        pf->pos += n;
+        if (pf->pos == c->len) {
+            pf->eof = c->last;
+            pf->pos = 0;
+            ring_release(pf);
+        }
+    }
+
+    return done;
+}
+
+/*
+ * Skip what is left of the file, so the next one starts at the head.
+ */
+static int
+prefetch_close(void *cookie)
+{
+    struct pf_prefetch *pf = cookie;
+
+    while (!pf->eof) {
+        pf->eof = ring_head(pf)->last;
+        ring_release(pf);
+    }
+    pf->pos = 0;
+
+    return 0;
+}
+
+/*
+ * Start reading the files of `paths` ahead, in order.
+ */
+struct pf_prefetch *
+pf_prefetch_create(char **paths, size_t n)
+{
+    struct pf_prefetch *pf = bmalloc(sizeof(struct pf_prefetch));
+
+    pf->paths = paths;
+    pf->n = n;
+    for (size_t i = 0; i < PF_PREFETCH_CHUNKS; i++) {
+        void *buf;
+        if (posix_memalign(&buf, 4096, PF_PREFETCH_CHUNK)) {
+            err_exit("unable to allocate read buffers");
+        }
+        pf->ring[i].buf = buf;
+    }
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->filled, NULL);
+    pthread_cond_init(&pf->freed, NULL);
+    if (pthread_create(&pf->tid, NULL, prefetch_reader, pf)) {
+        err_exit("unable to create thread");
+    }
+
+    return pf;
+}
+
+void
+pf_prefetch_destroy(struct pf_prefetch *pf)
+{
+    if (!pf) {
+        return;
+    }
+
+    pthread_mutex_lock(&pf->lock);
+    pf->stop = true;
+    pthread_cond_signal(&pf->freed);
+    pthread_mutex_unlock(&pf->lock);
+    pthread_join(pf->tid, NULL);
+    for (size_t i = 0; i < PF_PREFETCH_CHUNKS; i++) {
+        free(pf->ring[i].buf);
+    }
+    pthread_mutex_destroy(&pf->lock);
+    pthread_cond_destroy(&pf->filled);
+    pthread_cond_destroy(&pf->freed);
+    free(pf);
+}
+
+/*
+ * Open the next file as a stream over its chunks, or return `NULL` after
+ * the last. The stream must be closed before the next file is opened.
+ * Exits if the file cannot be opened.
+ */
+FILE *
+pf_prefetch_next(struct pf_prefetch *pf)
+{
+    cookie_io_functions_t io = {prefetch_read, NULL, NULL, prefetch_close};
+    struct chunk *c;
+    FILE *fp;
+
+    if (pf->next == pf->n) {
+        return NULL;
+    }
+    c = ring_head(pf);
+    if (c->err) {
+        err_exit("%s: %s", pf->paths[pf->next], strerror(c->err));
+    }
+    pf->next++;
+    pf->eof = false;
+    if (!(fp = fopencookie(pf, "r", io))) {
+        err_exit("unable to open stream: %s", strerror(errno));
+    }
+    setvbuf(fp, NULL, _IOFBF, 1 << 16);
+
+    return fp;
+}
@@ -0,0 +1,38 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#ifndef PF_PREFETCH_H
+#define PF_PREFETCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* chunks read ahead, and their size */
+#define PF_PREFETCH_CHUNKS 16
+#define PF_PREFETCH_CHUNK (1 << 20)
+
+/*
+ * Read a list of files ahead of their use. A thread reads the files in
+ * order, in large chunks with `pread`, into a ring of buffers while the
+ * caller parses the chunks already read, so reading the next run overlaps
+ * parsing and accumulating the current one. The ring bounds the memory
+ * used to `PF_PREFETCH_CHUNKS` chunks.
+ */
+struct pf_prefetch;
+
+struct pf_prefetch *
+pf_prefetch_create(char **paths, size_t n);
+
+void
+pf_prefetch_destroy(struct pf_prefetch *pf);
+
+FILE *
+pf_prefetch_next(struct pf_prefetch *pf);
+
+#endif /* PF_PREFETCH_H */
@@ -0,0 +1,702 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include "pf_condorcet.h"
+#include "pf_mc4.h"
+#include "pf_runset.h"
+#include "pf_score.h"
+#include "polyfuse.h"
+
+#define INIT_SZ 16
+#define NEED_GROW(n, cap) ((n) * 2 >= (cap))
+
+/*
+ * Find the index of topic `qid`. Returns -1 if the topic is not in the set.
+ */
+static long
+rs_topic_index(const struct pf_runset *rs, int qid)
+{
+    size_t key = int_hash(qid) & (rs->qid_cap - 1);
+
+    while (rs->qid_slots[key]) {
+        if (rs->topics[rs->qid_slots[key] - 1].qid == qid) {
+            return rs->qid_slots[key] - 1;
+        }
+        key = (key + 1) & (rs->qid_cap - 1);
+    }
+
+    return -1;
+}
+
+/*
+ * Double the docno table of a topic and reinsert all documents.
+ */
+static void
+rs_slots_grow(struct pf_rs_topic *t)
+{
+    t->slot_cap *= 2;
+    free(t->slots);
+    t->slots = bmalloc(sizeof(uint32_t) * t->slot_cap);
+    for (size_t i = 0; i < t->ndocs; i++) {
+        size_t key = str_hash(t->docno[i]) & (t->slot_cap - 1);
+        while (t->slots[key]) {
+            key = (key + 1) & (t->slot_cap - 1);
+        }
+        t->slots[key] = i + 1;
+    }
+}
+
+/*
+ * Map `docno` to its document index within the topic, adding it if new.
+ */
+static uint32_t
+rs_intern(struct pf_rs_topic *t, const char *docno)
+{
+    size_t key;
+
+    if (NEED_GROW(t->ndocs + 1, t->slot_cap)) {
+        rs_slots_grow(t);
+    }
+
+    key = str_hash(docno) & (t->slot_cap - 1);
+    while (t->slots[key]) {
+        uint32_t doc = t->slots[key] - 1;
+        if (0 == strcmp(t->docno[doc], docno)) {
+            return doc;
+        }
+        key = (key + 1) & (t->slot_cap - 1);
+    }
+
+    if (t->ndocs == t->doc_alloc) {
+        t->doc_alloc *= 2;
+        t->docno = brealloc(t->docno, sizeof(char *) * t->doc_alloc);
+    }
+    t->docno[t->ndocs] = strdup(docno);
+    t->slots[key] = ++t->ndocs;
+
+    return t->ndocs - 1;
+}
+
+/*
+ * Create an empty run set for the topics of the first run.
+ */
+struct pf_runset *
+pf_runset_create(const struct trec_topic *topics)
+{
+    struct pf_runset *rs;
+
+    rs = bmalloc(sizeof(*rs));
+    rs->ntopics = topics->len;
+    rs->topics = bmalloc(sizeof(struct pf_rs_topic) * (topics->len + 1));
+    rs->run_alloc = INIT_SZ;
+    rs->run_len = bmalloc(sizeof(size_t) * rs->run_alloc);
+    rs->qid_cap = INIT_SZ;
+    while (NEED_GROW(topics->len, rs->qid_cap)) {
+        rs->qid_cap *= 2;
+    }
+    rs->qid_slots = bmalloc(sizeof(int) * rs->qid_cap);
+
+    for (size_t i = 0; i < topics->len; i++) {
+        struct pf_rs_topic *t = &rs->topics[i];
+        t->qid = topics->ary[i];
+        t->doc_alloc = INIT_SZ;
+        t->docno = bmalloc(sizeof(char *) * t->doc_alloc);
+        t->slot_cap = INIT_SZ;
+        t->slots = bmalloc(sizeof(uint32_t) * t->slot_cap);
+        t->post_alloc = INIT_SZ;
+        t->post = bmalloc(sizeof(struct pf_posting) * t->post_alloc);
+        t->run_off = bmalloc(sizeof(size_t) * (rs->run_alloc + 1));
+
+        size_t key = int_hash(t->qid) & (rs->qid_cap - 1);
+        while (rs->qid_slots[key]) {
+            key = (key + 1) & (rs->qid_cap - 1);
+        }
+        rs->qid_slots[key] = i + 1;
+    }
+
+    return rs;
+}
+
+void
+pf_runset_destroy(struct pf_runset *rs)
+{
+    if (!rs) {
+        return;
+    }
+
+    for (size_t i = 0; i < rs->ntopics; i++) {
+        struct pf_rs_topic *t = &rs->topics[i];
+        for (size_t j = 0; j < t->ndocs; j++) {
+            free(t->docno[j]);
+        }
+        free(t->docno);
+        free(t->slots);
+        free(t->post);
+        free(t->run_off);
+        free(t->doc_off);
+        free(t->doc_ref);
+    }
+    free(rs->topics);
+    free(rs->run_len);
+    free(rs->qid_slots);
+    free(rs);
+}
+
+/*
+ * Add the postings of a run. Entries of topics that are not in the set are
+ * ignored, as are entries ranked below the deepest rank seen so far.
+ */
+void
+pf_runset_add(struct pf_runset *rs, const struct trec_run *r)
+{
+    long idx = -1;
+    int qid = 0;
+    bool first = true;
+
+    if (rs->nruns == rs->run_alloc) {
+        rs->run_alloc *= 2;
+        rs->run_len = brealloc(rs->run_len, sizeof(size_t) * rs->run_alloc);
+        for (size_t i = 0; i < rs->ntopics; i++) {
+            struct pf_rs_topic *t = &rs->topics[i];
+            t->run_off =
+                brealloc(t->run_off, sizeof(size_t) * (rs->run_alloc + 1));
+        }
+    }
+    if (r->max_rank > rs->max_rank) {
+        rs->max_rank = r->max_rank;
+    }
+    for (size_t i = 0; i < rs->ntopics; i++) {
+        struct pf_rs_topic *t = &rs->topics[i];
+        free(t->doc_off);
+        free(t->doc_ref);
+        t->doc_off = NULL;
+        t->doc_ref = NULL;
+    }
+
+    for (size_t i = 0; i < r->len; i++) {
+        const struct trec_entry *tentry = &r->ary[i];
+        if ((size_t)tentry->rank > rs->max_rank) {
+            continue;
+        }
+        if (first || tentry->qid != qid) {
+            idx = rs_topic_index(rs, tentry->qid);
+            qid = tentry->qid;
+            first = false;
+        }
+        if (idx < 0) {
+            continue;
+        }
+
+        struct pf_rs_topic *t = &rs->topics[idx];
+        if (t->npost == t->post_alloc) {
+            t->post_alloc *= 2;
+            t->post =
+                brealloc(t->post, sizeof(struct pf_posting) * t->post_alloc);
+        }
+        struct pf_posting *p = &t->post[t->npost++];
+        p->doc = rs_intern(t, tentry->docno);
+        p->rank = tentry->rank;
+        p->score = tentry->score;
+    }
+
+    rs->run_len[rs->nruns++] = r->len;
+    for (size_t i = 0; i < rs->ntopics; i++) {
+        rs->topics[i].run_off[rs->nruns] = rs->topics[i].npost;
+    }
+}
+
+/*
+ * Combine operators over the `score` and `count` arrays of `pf_runset_fuse`.
+ */
+#define RS_OP_ADD(score, count, d, s) \
+    do {                              \
+        score[d] += s;                \
+        count[d]++;                   \
+    } while (0)
+
+#define RS_OP_LESS(score, count, d, s)          \
+    do {                                        \
+        if (0 == count[d]++ || s < score[d]) {  \
+            score[d] = s;                       \
+        }                                       \
+    } while (0)
+
+#define RS_OP_GREATER(score, count, d, s)       \
+    do {                                        \
+        if (0 == count[d]++ || s > score[d]) {  \
+            score[d] = s;                       \
+        }                                       \
+    } while (0)
+
+/*
+ * Expand a fusion kernel over the postings of a topic. Runs are visited in
+ * the order they were added, so sums match those of `pf_accumulate`.
+ */
+#define RS_KERNEL(name, contrib, combine)                                   \
+    static void name(const struct pf_runset *rs,                            \
+        const struct pf_rs_topic *t, const struct pf_params *params,        \
+        const pf_score_t *rbc, pf_score_t *score, size_t *count)            \
+    {                                                                       \
+        (void)rbc;                                                          \
+        for (size_t i = 0; i < rs->nruns; i++) {                            \
+            size_t n = rs->run_len[i];                                      \
+            pf_score_t w = params->weights ? params->weights[i] : 1.0;      \
+            (void)n;                                                        \
+            for (size_t j = t->run_off[i]; j < t->run_off[i + 1]; j++) {    \
+                const struct pf_posting *p = &t->post[j];                   \
+                pf_score_t s = w * (contrib);                               \
+                combine(score, count, p->doc, s);                           \
+            }                                                               \
+        }                                                                   \
+    }
+
+RS_KERNEL(rs_borda, pf_score_borda(p->rank, n), RS_OP_ADD)
+RS_KERNEL(rs_comb_sum, p->score, RS_OP_ADD)
+RS_KERNEL(rs_comb_min, p->score, RS_OP_LESS)
+RS_KERNEL(rs_comb_max, p->score, RS_OP_GREATER)
+RS_KERNEL(rs_isr, pf_score_isr(p->rank), RS_OP_ADD)
+RS_KERNEL(rs_rbc, rbc[p->rank - 1], RS_OP_ADD)
+RS_KERNEL(rs_rrf, pf_score_rrf(params->rrf_k, p->rank), RS_OP_ADD)
+
+static int
+score_cmp(const void *a, const void *b)
+{
+    pf_score_t x = *(const pf_score_t *)a;
+    pf_score_t y = *(const pf_score_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * CombMED: gather the scores of every document and take the median.
+ */
+static void
+rs_comb_med(
+    const struct pf_rs_topic *t, pf_score_t *score, size_t *count)
+{
+    size_t *off = bmalloc(sizeof(size_t) * (t->ndocs + 1));
+    pf_score_t *vals = bmalloc(sizeof(pf_score_t) * (t->npost + 1));
+
+    for (size_t j = 0; j < t->npost; j++) {
+        count[t->post[j].doc]++;
+    }
+    for (size_t d = 0; d < t->ndocs; d++) {
+        off[d + 1] = off[d] + count[d];
+        count[d] = 0;
+    }
+    for (size_t j = 0; j < t->npost; j++) {
+        uint32_t d = t->post[j].doc;
+        vals[off[d] + count[d]++] = t->post[j].score;
+    }
+    for (size_t d = 0; d < t->ndocs; d++) {
+        pf_score_t *v = vals + off[d];
+        size_t n = count[d], idx = n >> 1;
+        qsort(v, n, sizeof(pf_score_t), score_cmp);
+        if (n % 2 == 0) {
+            score[d] = (v[idx - 1] + v[idx]) / 2;
+        } else {
+            score[d] = v[idx];
+        }
+    }
+
+    free(vals);
+    free(off);
+}
+
+/*
+ * The ranks every run gives the documents of a topic, a row per document.
+ */
+static uint16_t *
+rs_ranks(const struct pf_runset *rs, const struct pf_rs_topic *t)
+{
+    const size_t m = rs->nruns;
+    uint16_t *ranks = bmalloc(sizeof(uint16_t) * (t->ndocs * m + 1));
+
+    for (size_t i = 0; i < t->ndocs * m; i++) {
+        ranks[i] = PF_CONDORCET_UNRANKED;
+    }
+    for (size_t r = 0; r < m; r++) {
+        for (size_t j = t->run_off[r]; j < t->run_off[r + 1]; j++) {
+            uint16_t *rank = &ranks[t->post[j].doc * m + r];
+            uint16_t x = pf_condorcet_rank(t->post[j].rank);
+            *rank = x < *rank ? x : *rank;
+        }
+    }
+
+    return ranks;
+}
+
+/*
+ * Condorcet: sort the documents by the ranks every run gives them, and score
+ * them by their place, the best the number of documents.
+ */
+static void
+rs_condorcet(
+    const struct pf_runset *rs, const struct pf_rs_topic *t, pf_score_t *score)
+{
+    uint16_t *ranks = rs_ranks(rs, t);
+    size_t *order = bmalloc(sizeof(size_t) * (t->ndocs + 1));
+
+    pf_condorcet_sort(ranks, rs->nruns, t->docno, order, t->ndocs);
+    for (size_t i = 0; i < t->ndocs; i++) {
+        score[order[i]] = t->ndocs - i;
+    }
+
+    free(ranks);
+    free(order);
+}
+
+/*
+ * MC4: score the documents by the stationary distribution of the chain
+ * moving to documents a majority of runs prefer.
+ */
+static void
+rs_mc4(
+    const struct pf_runset *rs, const struct pf_rs_topic *t, pf_score_t *score)
+{
+    uint16_t *ranks = rs_ranks(rs, t);
+
+    pf_mc4_stationary(ranks, rs->nruns, t->docno, t->ndocs, PF_MC4_TOL,
+        PF_MC4_ITERS, score);
+    free(ranks);
+}
+
+/*
+ * Unweighted contribution of posting `p` of run `run` to its document under
+ * an additive fusion method. `rbc` holds the RBC weights of ranks.
+ */
+pf_score_t
+pf_runset_contrib(const struct pf_runset *rs, size_t run,
+    const struct pf_posting *p, const struct pf_params *params,
+    const pf_score_t *rbc)
+{
+    switch (params->type) {
+    case TBORDA:
+        return pf_score_borda(p->rank, rs->run_len[run]);
+    case TISR:
+    case TLOGISR:
+        return pf_score_isr(p->rank);
+    case TRBC:
+        return rbc[p->rank - 1];
+    case TRRF:
+        return pf_score_rrf(params->rrf_k, p->rank);
+    default:
+        return p->score;
+    }
+}
+
+/*
+ * Fuse the runs of topic index `topic` into `score`, which must hold one
+ * value per document of the topic.
+ */
+void
+pf_runset_fuse(const struct pf_runset *rs, size_t topic,
+    const struct pf_params *params, pf_score_t *score)
+{
+    const struct pf_rs_topic *t = &rs->topics[topic];
+    size_t *count = bmalloc(sizeof(size_t) * (t->ndocs + 1));
+    pf_score_t *rbc = NULL;
+
+    memset(score, 0, sizeof(pf_score_t) * t->ndocs);
+    if (TRBC == params->type) {
+        rbc = bmalloc(sizeof(pf_score_t) * (rs->max_rank + 1));
+        pf_score_rbc_weights(rbc, params->phi, rs->max_rank);
+    }
+
+    switch (params->type) {
+    case TBORDA:
+        rs_borda(rs, t, params, rbc, score, count);
+        break;
+    case TCOMBMED:
+        rs_comb_med(t, score, count);
+        break;
+    case TCOMBMIN:
+        rs_comb_min(rs, t, params, rbc, score, count);
+        break;
+    case TCOMBMAX:
+        rs_comb_max(rs, t, params, rbc, score, count);
+        break;
+    case TCOMBANZ:
+    case TCOMBMNZ:
+    case TCOMBSUM:
+        rs_comb_sum(rs, t, params, rbc, score, count);
+        break;
+    case TISR:
+    case TLOGISR:
+        rs_isr(rs, t, params, rbc, score, count);
+        break;
+    case TRBC:
+        rs_rbc(rs, t, params, rbc, score, count);
+        break;
+    case TRRF:
+        rs_rrf(rs, t, params, rbc, score, count);
+        break;
+    case TCONDORCET:
+        rs_condorcet(rs, t, score);
+        break;
+    case TMC4:
+        rs_mc4(rs, t, score);
+        break;
+    default:
+        break;
+    }
+
+    if (TCOMBMED != params->type) {
+        for (size_t d = 0; d < t->ndocs; d++) {
+            score[d] = pf_score_final(params->type, score[d], count[d]);
+        }
+    }
+
+    free(rbc);
+    free(count);
+}
+
+/*
+ * Fuse topic index `topic` and select its top `k` documents into `tk`, as
+ * ranked among at most `rs->max_rank` candidates. Returns the number of
+ * entries selected.
+ */
+size_t
+pf_runset_rank(const struct pf_runset *rs, size_t topic,
+    const struct pf_params *params, size_t k, struct pf_topk *tk)
+{
+    const struct pf_rs_topic *t = &rs->topics[topic];
+    pf_score_t *score, bound;
+
+    if (params->early && t->doc_off && pf_runset_ta_applies(rs, params)) {
+        return pf_runset_rank_ta(rs, topic, params, k, NULL, tk, &bound);
+    }
+
+    score = bmalloc(sizeof(pf_score_t) * (t->ndocs + 1));
+
+    pf_runset_fuse(rs, topic, params, score);
+    pf_topk_reset(tk, k, rs->max_rank);
+    for (size_t d = 0; d < t->ndocs; d++) {
+        pf_topk_push(tk, score[d], t->docno[d]);
+    }
+    free(score);
+
+    return pf_topk_finish(tk);
+}
+
+/*
+ * Index the postings of every topic by document for `pf_runset_rank_ta`.
+ * Adding a run drops the index.
+ */
+void
+pf_runset_index(struct pf_runset *rs)
+{
+    for (size_t i = 0; i < rs->ntopics; i++) {
+        struct pf_rs_topic *t = &rs->topics[i];
+        size_t *off;
+
+        free(t->doc_off);
+        free(t->doc_ref);
+        off = t->doc_off = bmalloc(sizeof(size_t) * (t->ndocs + 1));
+        t->doc_ref = bmalloc(sizeof(struct pf_rs_ref) * (t->npost + 1));
+        for (size_t j = 0; j < t->npost; j++) {
+            off[t->post[j].doc + 1]++;
+        }
+        for (size_t d = 0; d < t->ndocs; d++) {
+            off[d + 1] += off[d];
+        }
+        /* `off[d]` walks up to the start of `d + 1` and is then restored */
+        for (size_t r = 0; r < rs->nruns; r++) {
+            for (size_t j = t->run_off[r]; j < t->run_off[r + 1]; j++) {
+                t->doc_ref[off[t->post[j].doc]++] =
+                    (struct pf_rs_ref){(uint32_t)r, (uint32_t)j};
+            }
+        }
+        for (size_t d = t->ndocs; d > 0; d--) {
+            off[d] = off[d - 1];
+        }
+        off[0] = 0;
+    }
+}
+
+/*
+ * The threshold algorithm needs contributions that only fall with rank and
+ * fused scores that only grow with them: the rank based methods with
+ * weights of at least zero.
+ */
+bool
+pf_runset_ta_applies(const struct pf_runset *rs,
+    const struct pf_params *params)
+{
+    switch (params->type) {
+    case TBORDA:
+    case TISR:
+    case TLOGISR:
+    case TRBC:
+    case TRRF:
+        break;
+    default:
+        return false;
+    }
+    for (size_t i = 0; params->weights && i < rs->nruns; i++) {
+        if (params->weights[i] < 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Fused score of document `d`, adding its contributions in run order as
+ * the kernels of `pf_runset_fuse` do.
+ */
+static pf_score_t
+ta_score(const struct pf_runset *rs, const struct pf_rs_topic *t, uint32_t d,
+    const struct pf_params *params, const pf_score_t *rbc)
+{
+    pf_score_t score = 0.0;
+    size_t count = 0;
+
+    for (size_t j = t->doc_off[d]; j < t->doc_off[d + 1]; j++) {
+        const struct pf_rs_ref *ref = &t->doc_ref[j];
+        pf_score_t w = params->weights ? params->weights[ref->run] : 1.0;
+        score += w * pf_runset_contrib(
+                         rs, ref->run, &t->post[ref->post], params, rbc);
+        count++;
+    }
+
+    return pf_score_final(params->type, score, count);
+}
+
+static bool
+ta_expired(const struct timespec *deadline)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec > deadline->tv_sec ||
+           (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+/*
+ * Select the top `k` documents of topic index `topic` as `pf_runset_rank`
+ * does, by the threshold algorithm. Runs are read in rank order a depth at
+ * a time, and each new document is scored in full through the document
+ * index. No document yet unseen can score more than the contributions at
+ * the next depth of every run, so reading stops once the `k`-th score
+ * beats that bound. The run set must be indexed, see `pf_runset_index`.
+ *
+ * If `deadline` passes first, on `CLOCK_MONOTONIC`, the documents seen so
+ * far are selected and `bound` is set to how much an unseen document could
+ * score above the last one selected. It is zero for an exact selection.
+ */
+size_t
+pf_runset_rank_ta(const struct pf_runset *rs, size_t topic,
+    const struct pf_params *params, size_t k, const struct timespec *deadline,
+    struct pf_topk *tk, pf_score_t *bound)
+{
+    const struct pf_rs_topic *t = &rs->topics[topic];
+    bool *seen = bmalloc(sizeof(bool) * (t->ndocs + 1));
+    pf_score_t *rbc = NULL;
+
+    if (!t->doc_off) {
+        err_exit("run set is not indexed, see `pf_runset_index`");
+    }
+    if (TRBC == params->type) {
+        rbc = bmalloc(sizeof(pf_score_t) * (rs->max_rank + 1));
+        pf_score_rbc_weights(rbc, params->phi, rs->max_rank);
+    }
+
+    *bound = 0.0;
+    pf_topk_reset(tk, k, rs->max_rank);
+    for (size_t depth = 0;; depth++) {
+        pf_score_t next = 0.0, kth;
+        size_t open = 0;
+
+        for (size_t i = 0; i < rs->nruns; i++) {
+            size_t j = t->run_off[i] + depth;
+            pf_score_t w = params->weights ? params->weights[i] : 1.0;
+            if (j >= t->run_off[i + 1]) {
+                continue;
+            }
+            uint32_t d = t->post[j].doc;
+            if (!seen[d]) {
+                seen[d] = true;
+                pf_topk_push(tk, ta_score(rs, t, d, params, rbc), t->docno[d]);
+            }
+            if (j + 1 < t->run_off[i + 1]) {
+                next += w * pf_runset_contrib(rs, i, &t->post[j + 1], params,
+                                rbc);
+                open++;
+            }
+        }
+
+        /* the most an unseen document can score */
+        next = pf_score_final(params->type, next, open);
+        if (0 == open) {
+            break;
+        }
+        if (pf_topk_threshold(tk, &kth) && kth > next) {
+            break;
+        }
+        if (deadline && ta_expired(deadline)) {
+            if (!pf_topk_threshold(tk, &kth)) {
+                kth = 0.0;
+            }
+            *bound = next - kth;
+            break;
+        }
+    }
+    /* candidates are counted as if all were scored, for `prevent_ties` */
+    tk->seen = t->ndocs;
+    free(rbc);
+    free(seen);
+
+    return pf_topk_finish(tk);
+}
+
+/*
+ * Fuse every topic and write the result in TREC format. The ranking is also
+ * evaluated if `ev` is given, and writing is skipped if `stream` is `NULL`.
+ * For the main thread, as the last flush is timed as the write phase.
+ */
+void
+pf_runset_present(FILE *stream, const struct pf_runset *rs,
+    const struct pf_params *params, const char *id, size_t depth,
+    bool prevent_ties, struct pf_eval *ev)
+{
+    struct pf_topk tk = {0};
+    struct pf_writer w;
+
+    if (depth < 1) {
+        err_exit("`depth` is 0");
+    }
+
+    if (depth > rs->max_rank) {
+        depth = rs->max_rank;
+    }
+
+    if (stream) {
+        pf_writer_init(&w, stream);
+    }
+
+    for (size_t i = 0; i < rs->ntopics; i++) {
+        pf_runset_rank(rs, i, params, depth, &tk);
+        if (ev) {
+            pf_eval_topic(ev, rs->topics[i].qid, &tk, depth, prevent_ties);
+        }
+        if (stream) {
+            pf_present_topic(
+                &w, rs->topics[i].qid, &tk, depth, id, prevent_ties);
+        }
+    }
+    if (stream) {
+        PF_STATS_ENTER(prev, PF_PHASE_WRITE);
+        pf_writer_free(&w);
+        PF_STATS_LEAVE(prev);
+    }
+    pf_topk_free(&tk);
+}
@@ -0,0 +1,130 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#ifndef PF_RUNSET_H
+#define PF_RUNSET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "fusetype.h"
+#include "pf_accum.h"
+#include "pf_eval.h"
+#include "pf_topk.h"
+#include "trec.h"
+
+/*
+ * A run entry with its document interned in the topic's docno table.
+ */
+struct pf_posting {
+    uint32_t doc;
+    uint32_t rank;
+    pf_score_t score;
+};
+
+/*
+ * A posting of a document, by run.
+ */
+struct pf_rs_ref {
+    uint32_t run;
+    uint32_t post;
+};
+
+/*
+ * Postings of all runs for a topic. The postings of run `i` are
+ * `post[run_off[i]]` up to `post[run_off[i + 1]]`, in rank order. Once
+ * indexed by `pf_runset_index`, the postings of document `d` are
+ * `doc_ref[doc_off[d]]` up to `doc_ref[doc_off[d + 1]]`, in run order.
+ */
+struct pf_rs_topic {
+    int qid;
+    char **docno;
+    size_t ndocs;
+    size_t doc_alloc;
+    uint32_t *slots;
+    size_t slot_cap;
+    struct pf_posting *post;
+    size_t npost;
+    size_t post_alloc;
+    size_t *run_off;
+    size_t *doc_off;
+    struct pf_rs_ref *doc_ref;
+};
+
+/*
+ * A set of runs held in memory so they can be fused many times over.
+ */
+struct pf_runset {
+    struct pf_rs_topic *topics;
+    size_t ntopics;
+    size_t *run_len;
+    size_t nruns;
+    size_t run_alloc;
+    size_t max_rank;
+    int *qid_slots;
+    size_t qid_cap;
+};
+
+/*
+ * Fusion method and its parameters. The contributions of run `i` are scaled
+ * by `weights[i]`, or left as they are if `weights` is `NULL`. With `early`
+ * the top documents of an indexed run set are settled by
+ * `pf_runset_rank_ta` where the method allows it.
+ */
+struct pf_params {
+    enum fusetype type;
+    long rrf_k;
+    long double phi;
+    const long double *weights;
+    bool early;
+};
+
+struct pf_runset *
+pf_runset_create(const struct trec_topic *topics);
+
+void
+pf_runset_destroy(struct pf_runset *rs);
+
+void
+pf_runset_add(struct pf_runset *rs, const struct trec_run *r);
+
+pf_score_t
+pf_runset_contrib(const struct pf_runset *rs, size_t run,
+    const struct pf_posting *p, const struct pf_params *params,
+    const pf_score_t *rbc);
+
+void
+pf_runset_fuse(const struct pf_runset *rs, size_t topic,
+    const struct pf_params *params, pf_score_t *score);
+
+size_t
+pf_runset_rank(const struct pf_runset *rs, size_t topic,
+    const struct pf_params *params, size_t k, struct pf_topk *tk);
+
+void
+pf_runset_index(struct pf_runset *rs);
+
+bool
+pf_runset_ta_applies(const struct pf_runset *rs,
+    const struct pf_params *params);
+
+size_t
+pf_runset_rank_ta(const struct pf_runset *rs, size_t topic,
+    const struct pf_params *params, size_t k, const struct timespec *deadline,
+    struct pf_topk *tk, pf_score_t *bound);
+
+void
+pf_runset_present(FILE *stream, const struct pf_runset *rs,
+    const struct pf_params *params, const char *id, size_t depth,
+    bool prevent_ties, struct pf_eval *ev);
+
+#endif /* PF_RUNSET_H */
@@ -0,0 +1,76 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#ifndef PF_SCORE_H
+#define PF_SCORE_H
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "fusetype.h"
+#include "util.h"
+
+/*
+ * Per entry contributions of the rank based fusion methods. `rank` is one
+ * based and `n` is the number of entries in the run.
+ */
+static inline pf_score_t
+pf_score_borda(size_t rank, size_t n)
+{
+    return ((pf_score_t)n - rank + 1) / n;
+}
+
+static inline pf_score_t
+pf_score_isr(size_t rank)
+{
+    return (pf_score_t)1 / pow(rank, 2);
+}
+
+static inline pf_score_t
+pf_score_rrf(long k, size_t rank)
+{
+    return 1 / ((pf_score_t)k + rank);
+}
+
+/*
+ * Fill `w` with the RBC weights of ranks `1..len`.
+ */
+static inline void
+pf_score_rbc_weights(pf_score_t *w, pf_score_t phi, size_t len)
+{
+    pf_score_t x = 1.0 - phi;
+
+    for (size_t i = 0; i < len; i++) {
+        w[i] = x;
+        x *= phi;
+    }
+}
+
+/*
+ * Apply the final transformation to an accumulated score.
+ *
+ * CombANZ divides and CombMNZ multiplies by the number of runs a document
+ * appeared in. ISR and logISR scale the sum of contributions in the same way.
+ */
+static inline pf_score_t
+pf_score_final(enum fusetype type, pf_score_t score, size_t count)
+{
+    if (TCOMBANZ == type) {
+        score /= count;
+    } else if (TCOMBMNZ == type || TISR == type) {
+        score *= count;
+    } else if (TLOGISR == type) {
+        /* +1 to `log` to avoid log(1) = 0 */
+        score *= log(count + 1);
+    }
+
+    return score;
+}
+
+#endif /* PF_SCORE_H */
@@ -0,0 +1,665 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "pf_serve.h"
+#include "polyfuse.h"
+#include "util.h"
+
+#define INIT_SZ 16
+
+static int
+fail(char *err, size_t errlen, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(err, errlen, fmt, ap);
+    va_end(ap);
+
+    return -1;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t
+count_items(const char *s)
+{
+    size_t n = 1;
+
+    for (; *s; s++) {
+        n += ',' == *s;
+    }
+
+    return n;
+}
+
+/*
+ * Split a comma separated list of run paths.
+ */
+static size_t
+parse_paths(const char *s, char ***out)
+{
+    char *dup = strdup(s), *save = NULL;
+    size_t n = 0;
+
+    *out = bmalloc(sizeof(char *) * count_items(s));
+    for (char *tok = strtok_r(dup, ",", &save); tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        (*out)[n++] = strdup(tok);
+    }
+    free(dup);
+
+    return n;
+}
+
+static int
+parse_topics(const char *s, struct pf_serve_req *req)
+{
+    const char *p = s;
+
+    req->topics = bmalloc(sizeof(int) * count_items(s));
+    while (*p) {
+        char *end;
+        long v = strtol(p, &end, 10);
+        if (end == p || (*end && ',' != *end)) {
+            return -1;
+        }
+        for (size_t i = 0; i < req->ntopics; i++) {
+            if (req->topics[i] == v) {
+                return -1;
+            }
+        }
+        req->topics[req->ntopics++] = v;
+        p = *end ? end + 1 : end;
+    }
+
+    return 0;
+}
+
+static int
+parse_weights(const char *s, struct pf_serve_req *req)
+{
+    const char *p = s;
+
+    req->weights = bmalloc(sizeof(long double) * count_items(s));
+    while (*p) {
+        char *end;
+        long double v = strtold(p, &end);
+        if (end == p || (*end && ',' != *end) || v < 0) {
+            return -1;
+        }
+        req->weights[req->nweights++] = v;
+        p = *end ? end + 1 : end;
+    }
+
+    return 0;
+}
+
+static int
+parse_pair(struct pf_serve_req *req, const char *key, const char *val,
+    char *err, size_t errlen)
+{
+    char *end = NULL;
+
+    if (0 == strcmp(key, "method")) {
+        if (TNONE == (req->type = fusetype_parse(val))) {
+            return fail(err, errlen, "unknown fusion method '%s'", val);
+        }
+    } else if (0 == strcmp(key, "k")) {
+        req->rrf_k = strtol(val, &end, 10);
+    } else if (0 == strcmp(key, "phi")) {
+        req->phi = strtold(val, &end);
+    } else if (0 == strcmp(key, "norm")) {
+        if (TNORM_NONE == (req->norm = trec_norm_parse(val))) {
+            return fail(err, errlen, "unknown normalization '%s'", val);
+        }
+    } else if (0 == strcmp(key, "depth")) {
+        req->depth = strtoul(val, &end, 10);
+    } else if (0 == strcmp(key, "ties")) {
+        req->prevent_ties = 0 != strtol(val, &end, 10);
+    } else if (0 == strcmp(key, "id")) {
+        free(req->id);
+        req->id = strdup(val);
+    } else if (0 == strcmp(key, "runs")) {
+        req->nruns = parse_paths(val, &req->runs);
+    } else if (0 == strcmp(key, "topics")) {
+        if (parse_topics(val, req) < 0) {
+            return fail(err, errlen, "malformed topics '%s'", val);
+        }
+    } else if (0 == strcmp(key, "weights")) {
+        if (parse_weights(val, req) < 0) {
+            return fail(err, errlen, "malformed weights '%s'", val);
+        }
+    } else {
+        return fail(err, errlen, "unknown key '%s'", key);
+    }
+    if (end && (end == val || *end)) {
+        return fail(err, errlen, "malformed value of '%s'", key);
+    }
+
+    return 0;
+}
+
+/*
+ * Parse the request of `len` bytes in `msg`. Returns -1 with a message in
+ * `err` if it is malformed.
+ */
+int
+pf_serve_parse(struct pf_serve_req *req, const char *msg, size_t len,
+    char *err, size_t errlen)
+{
+    char *buf = strndup(msg, len), *save = NULL, *tok;
+    int ret = 0;
+
+    memset(req, 0, sizeof(*req));
+    req->rrf_k = 60;
+    req->phi = 0.8;
+    req->depth = PF_SERVE_DEPTH;
+
+    if (!(tok = strtok_r(buf, " \t\r\n", &save))) {
+        ret = fail(err, errlen, "empty request");
+    } else if (0 == strcmp(tok, "fuse")) {
+        req->cmd = PF_SERVE_FUSE;
+    } else if (0 == strcmp(tok, "stats")) {
+        req->cmd = PF_SERVE_STATS;
+    } else if (0 == strcmp(tok, "ping")) {
+        req->cmd = PF_SERVE_PING;
+    } else {
+        ret = fail(err, errlen, "unknown command '%s'", tok);
+    }
+
+    while (0 == ret && (tok = strtok_r(NULL, " \t\r\n", &save))) {
+        char *eq = strchr(tok, '=');
+        if (!eq) {
+            ret = fail(err, errlen, "expected key=value, found '%s'", tok);
+            break;
+        }
+        *eq = '\0';
+        ret = parse_pair(req, tok, eq + 1, err, errlen);
+    }
+
+    if (0 == ret && PF_SERVE_FUSE == req->cmd) {
+        if (TNONE == req->type) {
+            ret = fail(err, errlen, "no fusion method given");
+        } else if (req->nruns < 1) {
+            ret = fail(err, errlen, "no runs given");
+        } else if (req->depth < 1) {
+            ret = fail(err, errlen, "`depth` is 0");
+        } else if (req->nweights && req->nweights != req->nruns) {
+            ret = fail(err, errlen, "%zu weights for %zu runs", req->nweights,
+                req->nruns);
+        } else if (req->nweights && (TCOMBMED == req->type ||
+                                       fusetype_is_pairwise(req->type))) {
+            ret = fail(err, errlen, "%s can not be weighted",
+                fusetype_str[req->type]);
+        }
+    }
+    free(buf);
+
+    return ret;
+}
+
+void
+pf_serve_req_free(struct pf_serve_req *req)
+{
+    for (size_t i = 0; i < req->nruns; i++) {
+        free(req->runs[i]);
+    }
+    free(req->runs);
+    free(req->weights);
+    free(req->topics);
+    free(req->id);
+}
+
+void
+pf_cache_init(struct pf_cache *c, size_t budget)
+{
+    memset(c, 0, sizeof(*c));
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->loaded, NULL);
+    c->alloc = INIT_SZ;
+    c->ent = bmalloc(sizeof(struct pf_cache_entry *) * c->alloc);
+    c->budget = budget;
+}
+
+static void
+entry_free(struct pf_cache_entry *e)
+{
+    trec_destroy(e->run);
+    free(e->path);
+    free(e);
+}
+
+void
+pf_cache_free(struct pf_cache *c)
+{
+    for (size_t i = 0; i < c->len; i++) {
+        entry_free(c->ent[i]);
+    }
+    free(c->ent);
+    pthread_cond_destroy(&c->loaded);
+    pthread_mutex_destroy(&c->lock);
+}
+
+/*
+ * Memory held by a parsed run.
+ */
+static size_t
+run_bytes(const struct trec_run *r)
+{
+    size_t n = sizeof(*r) + sizeof(struct trec_entry) * r->alloc +
+               sizeof(int) * r->topics.alloc;
+
+    for (size_t i = 0; i < r->len; i++) {
+        n += strlen(r->ary[i].docno) + strlen(r->ary[i].name) + 2;
+    }
+
+    return n;
+}
+
+static void
+cache_remove(struct pf_cache *c, size_t i)
+{
+    c->bytes -= c->ent[i]->bytes;
+    c->ent[i] = c->ent[--c->len];
+}
+
+/*
+ * Evict the least recently used runs not in use until the cache is within
+ * its budget. Called with the lock held.
+ */
+static void
+cache_evict(struct pf_cache *c)
+{
+    while (c->bytes > c->budget) {
+        size_t lru = c->len;
+        for (size_t i = 0; i < c->len; i++) {
+            if (0 == c->ent[i]->refs &&
+                (lru == c->len || c->ent[i]->tick < c->ent[lru]->tick)) {
+                lru = i;
+            }
+        }
+        if (lru == c->len) {
+            break;
+        }
+        struct pf_cache_entry *e = c->ent[lru];
+        cache_remove(c, lru);
+        entry_free(e);
+        c->evictions++;
+    }
+}
+
+/*
+ * Find a resident entry that is still current. Called with the lock held.
+ */
+static struct pf_cache_entry *
+cache_find(struct pf_cache *c, const char *path, enum trec_norm norm,
+    const struct stat *st)
+{
+    for (size_t i = 0; i < c->len; i++) {
+        struct pf_cache_entry *e = c->ent[i];
+        if (e->norm != norm || 0 != strcmp(e->path, path)) {
+            continue;
+        }
+        if (e->mtime == st->st_mtime && e->size == st->st_size) {
+            return e;
+        }
+        /* the file changed since it was read */
+        cache_remove(c, i);
+        if (e->refs) {
+            e->stale = true;
+        } else {
+            entry_free(e);
+        }
+        break;
+    }
+
+    return NULL;
+}
+
+/*
+ * Unpin `e` and take a failed read out of the table. Called with the lock
+ * held. Returns true if the caller is to free `e`.
+ */
+static bool
+cache_unpin(struct pf_cache *c, struct pf_cache_entry *e)
+{
+    e->refs--;
+    if (!e->run && !e->stale) {
+        for (size_t i = 0; i < c->len; i++) {
+            if (c->ent[i] == e) {
+                cache_remove(c, i);
+                break;
+            }
+        }
+        e->stale = true;
+    }
+
+    return e->stale && 0 == e->refs;
+}
+
+/*
+ * Get the run at `path` with scores normalized by `norm`, reading it if it
+ * is not resident. The entry is pinned until `pf_cache_put`. Returns `NULL`
+ * with a message in `err` if the run can not be read.
+ *
+ * A run is read once however many requests want it at the same time: the
+ * first publishes a `loading` entry and reads without the lock, the others
+ * wait on `loaded` until it is filled.
+ */
+struct pf_cache_entry *
+pf_cache_get(struct pf_cache *c, const char *path, enum trec_norm norm,
+    char *err, size_t errlen)
+{
+    struct pf_cache_entry *e;
+    struct trec_run *run;
+    struct stat st;
+    FILE *fp;
+
+    if (stat(path, &st) < 0) {
+        fail(err, errlen, "%s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    pthread_mutex_lock(&c->lock);
+    while ((e = cache_find(c, path, norm, &st))) {
+        e->refs++;
+        while (e->loading) {
+            pthread_cond_wait(&c->loaded, &c->lock);
+        }
+        if (e->run) {
+            e->tick = ++c->tick;
+            c->hits++;
+            pthread_mutex_unlock(&c->lock);
+            return e;
+        }
+        /* the read failed, try it again to report why */
+        if (cache_unpin(c, e)) {
+            entry_free(e);
+        }
+    }
+    c->misses++;
+    e = bmalloc(sizeof(struct pf_cache_entry));
+    e->path = strdup(path);
+    e->norm = norm;
+    e->run = NULL;
+    e->bytes = 0;
+    e->tick = ++c->tick;
+    e->refs = 1;
+    e->stale = false;
+    e->loading = true;
+    e->mtime = st.st_mtime;
+    e->size = st.st_size;
+    if (c->len == c->alloc) {
+        c->alloc *= 2;
+        c->ent = brealloc(c->ent, sizeof(struct pf_cache_entry *) * c->alloc);
+    }
+    c->ent[c->len++] = e;
+    pthread_mutex_unlock(&c->lock);
+
+    if ((fp = fopen(path, "r"))) {
+        run = trec_create();
+        trec_read(run, fp);
+        fclose(fp);
+        trec_normalize(run, norm);
+    } else {
+        fail(err, errlen, "%s: %s", path, strerror(errno));
+        run = NULL;
+    }
+
+    pthread_mutex_lock(&c->lock);
+    e->run = run;
+    e->loading = false;
+    pthread_cond_broadcast(&c->loaded);
+    if (!run) {
+        bool drop = cache_unpin(c, e);
+        pthread_mutex_unlock(&c->lock);
+        if (drop) {
+            entry_free(e);
+        }
+        return NULL;
+    }
+    e->bytes = run_bytes(run);
+    if (!e->stale) {
+        c->bytes += e->bytes;
+        cache_evict(c);
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    return e;
+}
+
+/*
+ * Unpin an entry from `pf_cache_get`.
+ */
+void
+pf_cache_put(struct pf_cache *c, struct pf_cache_entry *e)
+{
+    bool drop;
+
+    pthread_mutex_lock(&c->lock);
+    drop = cache_unpin(c, e);
+    cache_evict(c);
+    pthread_mutex_unlock(&c->lock);
+    if (drop) {
+        entry_free(e);
+    }
+}
+
+void
+pf_server_init(struct pf_server *srv, size_t budget)
+{
+    memset(srv, 0, sizeof(*srv));
+    pf_cache_init(&srv->cache, budget);
+    pthread_mutex_init(&srv->lock, NULL);
+}
+
+void
+pf_server_free(struct pf_server *srv)
+{
+    pf_cache_free(&srv->cache);
+    pthread_mutex_destroy(&srv->lock);
+}
+
+/*
+ * Count requests waiting for a worker.
+ */
+void
+pf_server_queue(struct pf_server *srv, long delta)
+{
+    pthread_mutex_lock(&srv->lock);
+    srv->queued += delta;
+    if (srv->queued > srv->max_queued) {
+        srv->max_queued = srv->queued;
+    }
+    pthread_mutex_unlock(&srv->lock);
+}
+
+/*
+ * Fuse the runs of `req`, taken from the cache, into `out`. Returns -1 with
+ * a message in `err` if a run can not be read.
+ */
+int
+pf_cache_fuse(struct pf_cache *c, const struct pf_serve_req *req,
+    struct pf_writer *out, char *err, size_t errlen)
+{
+    struct pf_cache_entry **ent;
+    enum trec_norm norm = TNORM_NONE;
+    struct trec_topic topics;
+    struct pf_ctx *ctx;
+    char id[64];
+    size_t n = 0;
+    int ret = 0;
+
+    if (fusetype_is_score_based(req->type)) {
+        norm = req->norm;
+    }
+    ent = bmalloc(sizeof(struct pf_cache_entry *) * req->nruns);
+    for (; n < req->nruns; n++) {
+        ent[n] = pf_cache_get(c, req->runs[n], norm, err, errlen);
+        if (!ent[n]) {
+            ret = -1;
+            goto done;
+        }
+    }
+
+    if (req->ntopics) {
+        topics.ary = req->topics;
+        topics.len = topics.alloc = req->ntopics;
+    } else {
+        topics = ent[0]->run->topics;
+    }
+    snprintf(id, sizeof(id), "polyfuse-%s", fusetype_str[req->type]);
+
+    ctx = pf_ctx_create();
+    pf_set_fusion(ctx, req->type);
+    pf_set_rrf_k(ctx, req->rrf_k);
+    pf_init(ctx, &topics);
+    for (size_t i = 0; i < req->nruns; i++) {
+        pf_weight_alloc(ctx, req->phi, ent[i]->run->max_rank);
+        pf_set_run_weight(ctx, req->nweights ? req->weights[i] : 1.0);
+        pf_accumulate(ctx, ent[i]->run);
+    }
+    pf_present_writer(
+        ctx, out, req->id ? req->id : id, req->depth, req->prevent_ties);
+    pf_ctx_destroy(ctx);
+
+done:
+    for (size_t i = 0; i < n; i++) {
+        pf_cache_put(c, ent[i]);
+    }
+    free(ent);
+
+    return ret;
+}
+
+static int
+dbl_cmp(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void
+put_stat(struct pf_writer *out, const char *name, const char *fmt, ...)
+{
+    char buf[128];
+    va_list ap;
+    int n = snprintf(buf, sizeof(buf), "%-20s ", name);
+
+    va_start(ap, fmt);
+    n += vsnprintf(buf + n, sizeof(buf) - n - 1, fmt, ap);
+    va_end(ap);
+    buf[n++] = '\n';
+    pf_writer_bytes(out, buf, n);
+}
+
+/*
+ * Write the counters as `name value` lines. Latency percentiles are taken
+ * over the last `PF_SERVE_LAT_WINDOW` requests.
+ */
+static void
+stats(struct pf_server *srv, struct pf_writer *out)
+{
+    double lat[PF_SERVE_LAT_WINDOW];
+    size_t nlat;
+    struct pf_cache *c = &srv->cache;
+
+    pthread_mutex_lock(&srv->lock);
+    nlat = srv->nlat < PF_SERVE_LAT_WINDOW ? srv->nlat : PF_SERVE_LAT_WINDOW;
+    memcpy(lat, srv->lat, sizeof(double) * nlat);
+    put_stat(out, "requests", "%llu", (unsigned long long)srv->requests);
+    put_stat(out, "errors", "%llu", (unsigned long long)srv->errors);
+    put_stat(out, "queue_depth", "%zu", srv->queued);
+    put_stat(out, "queue_depth_max", "%zu", srv->max_queued);
+    put_stat(out, "busy", "%zu", srv->busy);
+    pthread_mutex_unlock(&srv->lock);
+
+    qsort(lat, nlat, sizeof(double), dbl_cmp);
+    put_stat(out, "latency_p50_ms", "%.3f",
+        nlat ? lat[nlat / 2] * 1e3 : 0.0);
+    put_stat(out, "latency_p90_ms", "%.3f",
+        nlat ? lat[nlat * 9 / 10] * 1e3 : 0.0);
+    put_stat(out, "latency_p99_ms", "%.3f",
+        nlat ? lat[nlat * 99 / 100] * 1e3 : 0.0);
+    put_stat(out, "latency_max_ms", "%.3f",
+        nlat ? lat[nlat - 1] * 1e3 : 0.0);
+
+    pthread_mutex_lock(&c->lock);
+    put_stat(out, "cache_runs", "%zu", c->len);
+    put_stat(out, "cache_bytes", "%zu", c->bytes);
+    put_stat(out, "cache_budget", "%zu", c->budget);
+    put_stat(out, "cache_hits", "%llu", (unsigned long long)c->hits);
+    put_stat(out, "cache_misses", "%llu", (unsigned long long)c->misses);
+    put_stat(
+        out, "cache_evictions", "%llu", (unsigned long long)c->evictions);
+    pthread_mutex_unlock(&c->lock);
+}
+
+/*
+ * Answer the request in `msg`, writing the fused run, the counters or an
+ * error message to `out`. Returns 0 on success, -1 on error.
+ */
+int
+pf_server_request(struct pf_server *srv, const char *msg, size_t len,
+    struct pf_writer *out)
+{
+    struct pf_serve_req req;
+    char err[512];
+    double start = now();
+    int ret;
+
+    pthread_mutex_lock(&srv->lock);
+    srv->busy++;
+    pthread_mutex_unlock(&srv->lock);
+
+    if (0 == (ret = pf_serve_parse(&req, msg, len, err, sizeof(err)))) {
+        switch (req.cmd) {
+        case PF_SERVE_FUSE:
+            ret = pf_cache_fuse(&srv->cache, &req, out, err, sizeof(err));
+            break;
+        case PF_SERVE_STATS:
+            stats(srv, out);
+            break;
+        case PF_SERVE_PING:
+        default:
+            pf_writer_bytes(out, "pong\n", 5);
+            break;
+        }
+    }
+    pf_serve_req_free(&req);
+    if (ret < 0) {
+        out->len = 0;
+        pf_writer_bytes(out, err, strlen(err));
+    }
+
+    pthread_mutex_lock(&srv->lock);
+    srv->busy--;
+    srv->requests++;
+    srv->errors += ret < 0;
+    srv->lat[srv->nlat++ % PF_SERVE_LAT_WINDOW] = now() - start;
+    pthread_mutex_unlock(&srv->lock);
+
+    return ret;
+}
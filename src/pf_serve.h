@@ -0,0 +1,151 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#ifndef PF_SERVE_H
+#define PF_SERVE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "fusetype.h"
+#include "pf_writer.h"
+#include "trec.h"
+
+/* requests whose latency the percentiles are taken over */
+#define PF_SERVE_LAT_WINDOW 4096
+#define PF_SERVE_DEPTH 1000
+
+enum pf_serve_cmd {
+    PF_SERVE_NONE = 0,
+    PF_SERVE_FUSE,
+    PF_SERVE_STATS,
+    PF_SERVE_PING,
+};
+
+/*
+ * A request, parsed from a line of whitespace separated words: the command
+ * followed by `key=value` pairs, e.g.
+ *
+ *     fuse method=rrf k=60 depth=100 topics=401,402 runs=a.run,b.run
+ *
+ * `topics` defaults to the topics of the first run.
+ */
+struct pf_serve_req {
+    enum pf_serve_cmd cmd;
+    enum fusetype type;
+    long rrf_k;
+    long double phi;
+    enum trec_norm norm;
+    size_t depth;
+    bool prevent_ties;
+    char *id;
+    char **runs;
+    size_t nruns;
+    long double *weights;
+    size_t nweights;
+    int *topics;
+    size_t ntopics;
+};
+
+/*
+ * A run held in memory, with its scores normalized by `norm`. Entries in use
+ * are pinned by `refs`. An entry whose file changed on disk is `stale`: it
+ * leaves the table at once and is freed when its last user is done. An entry
+ * is `loading` while its first user reads the run, and others wanting the
+ * same run wait for it rather than reading it again.
+ */
+struct pf_cache_entry {
+    char *path;
+    enum trec_norm norm;
+    struct trec_run *run;
+    size_t bytes;
+    uint64_t tick;
+    size_t refs;
+    bool stale;
+    bool loading;
+    time_t mtime;
+    off_t size;
+};
+
+/*
+ * Runs kept resident under a memory budget. The least recently used entries
+ * that are not in use are evicted once `bytes` exceeds `budget`.
+ */
+struct pf_cache {
+    pthread_mutex_t lock;
+    pthread_cond_t loaded;
+    struct pf_cache_entry **ent;
+    size_t len;
+    size_t alloc;
+    size_t bytes;
+    size_t budget;
+    uint64_t tick;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+/*
+ * A fusion server: the run cache and the request counters. `queued` and
+ * `busy` are kept by the connection handling.
+ */
+struct pf_server {
+    struct pf_cache cache;
+    pthread_mutex_t lock;
+    uint64_t requests;
+    uint64_t errors;
+    size_t queued;
+    size_t max_queued;
+    size_t busy;
+    double lat[PF_SERVE_LAT_WINDOW];
+    size_t nlat;
+};
+
+int
+pf_serve_parse(struct pf_serve_req *req, const char *msg, size_t len,
+    char *err, size_t errlen);
+
+void
+pf_serve_req_free(struct pf_serve_req *req);
+
+void
+pf_cache_init(struct pf_cache *c, size_t budget);
+
+void
+pf_cache_free(struct pf_cache *c);
+
+struct pf_cache_entry *
+pf_cache_get(struct pf_cache *c, const char *path, enum trec_norm norm,
+    char *err, size_t errlen);
+
+void
+pf_cache_put(struct pf_cache *c, struct pf_cache_entry *e);
+
+int
+pf_cache_fuse(struct pf_cache *c, const struct pf_serve_req *req,
+    struct pf_writer *out, char *err, size_t errlen);
+
+void
+pf_server_init(struct pf_server *srv, size_t budget);
+
+void
+pf_server_free(struct pf_server *srv);
+
+int
+pf_server_request(struct pf_server *srv, const char *msg, size_t len,
+    struct pf_writer *out);
+
+void
+pf_server_queue(struct pf_server *srv, long delta);
+
+#endif /* PF_SERVE_H */
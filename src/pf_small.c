@@ -0,0 +1,288 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <tgmath.h>
+#include <string.h>
+
+#include "pf_score.h"
+#include "pf_small.h"
+#include "util.h"
+
+struct small_acc {
+    uint64_t doc;
+    pf_score_t val;
+    size_t count;
+};
+
+/*
+ * RBC weight of `rank`. Lists come in rank order, so the weight of the
+ * previous rank is carried in `w` and `prev` to replace `pow` by a product.
+ */
+static inline pf_score_t
+rbc_weight(const struct pf_small_params *p, uint32_t rank, uint32_t *prev,
+    pf_score_t *w)
+{
+    if (rank == *prev + 1 && *prev) {
+        *w *= p->phi;
+    } else {
+        *w = (1.0 - p->phi) * pow(p->phi, rank - 1);
+    }
+    *prev = rank;
+
+    return *w;
+}
+
+static inline pf_score_t
+contribution(const struct pf_small_params *p, const struct pf_small_list *l,
+    const struct pf_small_hit *h, uint32_t *prev, pf_score_t *w)
+{
+    switch (p->type) {
+    case TBORDA:
+        return l->weight * pf_score_borda(h->rank, l->len);
+    case TISR:
+    case TLOGISR:
+        return l->weight * pf_score_isr(h->rank);
+    case TRBC:
+        return l->weight * rbc_weight(p, h->rank, prev, w);
+    case TRRF:
+        return l->weight * pf_score_rrf(p->rrf_k, h->rank);
+    default:
+        return l->weight * h->score;
+    }
+}
+
+static inline void
+combine(enum fusetype type, struct small_acc *a, pf_score_t s)
+{
+    if (TCOMBMIN == type) {
+        if (0 == a->count || s < a->val) {
+            a->val = s;
+        }
+    } else if (TCOMBMAX == type) {
+        if (0 == a->count || s > a->val) {
+            a->val = s;
+        }
+    } else {
+        a->val += s;
+    }
+    a->count++;
+}
+
+/*
+ * Accumulate by scanning the documents seen so far for each hit.
+ */
+static size_t
+accumulate_linear(const struct pf_small_params *p,
+    const struct pf_small_list *lists, size_t nlists, struct small_acc *acc)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < nlists; i++) {
+        const struct pf_small_list *l = &lists[i];
+        uint32_t prev = 0;
+        pf_score_t w = 0.0;
+        for (size_t j = 0; j < l->len; j++) {
+            const struct pf_small_hit *h = &l->hits[j];
+            size_t d = 0;
+            while (d < n && acc[d].doc != h->doc) {
+                d++;
+            }
+            if (d == n) {
+                acc[n++] = (struct small_acc){h->doc, 0.0, 0};
+            }
+            combine(p->type, &acc[d], contribution(p, l, h, &prev, &w));
+        }
+    }
+
+    return n;
+}
+
+/*
+ * Accumulate through an open addressing table of indices into `acc`, with
+ * at least two slots per hit.
+ */
+static size_t
+accumulate_table(const struct pf_small_params *p,
+    const struct pf_small_list *lists, size_t nlists, struct small_acc *acc,
+    uint32_t *slot, unsigned bits)
+{
+    const size_t mask = ((size_t)1 << bits) - 1;
+    size_t n = 0;
+
+    memset(slot, 0, sizeof(uint32_t) * (mask + 1));
+    for (size_t i = 0; i < nlists; i++) {
+        const struct pf_small_list *l = &lists[i];
+        uint32_t prev = 0;
+        pf_score_t w = 0.0;
+        for (size_t j = 0; j < l->len; j++) {
+            const struct pf_small_hit *h = &l->hits[j];
+            size_t key = (h->doc * 0x9e3779b97f4a7c15ULL) >> (64 - bits);
+            while (slot[key] && acc[slot[key] - 1].doc != h->doc) {
+                key = (key + 1) & mask;
+            }
+            if (!slot[key]) {
+                acc[n] = (struct small_acc){h->doc, 0.0, 0};
+                slot[key] = ++n;
+            }
+            combine(p->type, &acc[slot[key] - 1],
+                contribution(p, l, h, &prev, &w));
+        }
+    }
+
+    return n;
+}
+
+/*
+ * CombMED gathers the scores of each document in `vals`: a first pass
+ * counts them, a prefix sum places each document's scores together and a
+ * second pass scatters them. The few scores of a document are then sorted
+ * by insertion to take the middle. As in `pf_accumulate`, the median is
+ * not weighted.
+ */
+static size_t
+accumulate_median(const struct pf_small_list *lists, size_t nlists,
+    struct small_acc *acc, uint32_t *slot, unsigned bits, uint32_t *hidx,
+    pf_score_t *vals)
+{
+    const size_t mask = ((size_t)1 << bits) - 1;
+    uint32_t *end = slot;
+    size_t n = 0, h = 0;
+
+    memset(slot, 0, sizeof(uint32_t) * (mask + 1));
+    for (size_t i = 0; i < nlists; i++) {
+        for (size_t j = 0; j < lists[i].len; j++) {
+            uint64_t doc = lists[i].hits[j].doc;
+            size_t key = (doc * 0x9e3779b97f4a7c15ULL) >> (64 - bits);
+            while (slot[key] && acc[slot[key] - 1].doc != doc) {
+                key = (key + 1) & mask;
+            }
+            if (!slot[key]) {
+                acc[n] = (struct small_acc){doc, 0.0, 0};
+                slot[key] = ++n;
+            }
+            hidx[h++] = slot[key] - 1;
+            acc[slot[key] - 1].count++;
+        }
+    }
+
+    /* the table is done with, its slots now mark where each run ends */
+    for (size_t d = 0, off = 0; d < n; d++) {
+        end[d] = off;
+        off += acc[d].count;
+    }
+    h = 0;
+    for (size_t i = 0; i < nlists; i++) {
+        for (size_t j = 0; j < lists[i].len; j++) {
+            vals[end[hidx[h++]]++] = lists[i].hits[j].score;
+        }
+    }
+
+    for (size_t d = 0; d < n; d++) {
+        pf_score_t *v = vals + end[d] - acc[d].count;
+        size_t c = acc[d].count, m = c / 2;
+        for (size_t x = 1; x < c; x++) {
+            pf_score_t tmp = v[x];
+            size_t y = x;
+            while (y > 0 && tmp < v[y - 1]) {
+                v[y] = v[y - 1];
+                y--;
+            }
+            v[y] = tmp;
+        }
+        acc[d].val = c % 2 ? v[m] : (v[m - 1] + v[m]) / 2;
+    }
+
+    return n;
+}
+
+/*
+ * Insert into the `len` results of `out`, kept best first, dropping the
+ * last once `k` are held. Ties go to the larger document id, as in
+ * `pf_topk`.
+ */
+static inline size_t
+result_insert(struct pf_small_result *out, size_t len, size_t k,
+    uint64_t doc, pf_score_t score)
+{
+    size_t i;
+
+    if (len == k && (score < out[k - 1].score ||
+                        (score == out[k - 1].score && doc < out[k - 1].doc))) {
+        return len;
+    }
+    i = len < k ? len++ : k - 1;
+    while (i > 0 && (score > out[i - 1].score ||
+                        (score == out[i - 1].score && doc > out[i - 1].doc))) {
+        out[i] = out[i - 1];
+        i--;
+    }
+    out[i] = (struct pf_small_result){doc, score};
+
+    return len;
+}
+
+/*
+ * Fuse `nlists` result lists into the `k` best documents, written to `out`
+ * best first. Returns the number of results, at most `k`.
+ */
+size_t
+pf_small_fuse(const struct pf_small_params *p,
+    const struct pf_small_list *lists, size_t nlists,
+    struct pf_small_result *out, size_t k)
+{
+    struct small_acc stack[PF_SMALL_MAX], *acc = stack;
+    uint32_t stack_slot[2 * PF_SMALL_MAX], *slot = stack_slot;
+    uint32_t stack_hidx[PF_SMALL_MAX], *hidx = stack_hidx;
+    pf_score_t stack_vals[PF_SMALL_MAX], *vals = stack_vals;
+    size_t total = 0, n, len = 0;
+    unsigned bits = 1;
+
+    if (fusetype_is_pairwise(p->type)) {
+        err_exit("%s is not supported by `pf_small_fuse`",
+            fusetype_str[p->type]);
+    }
+    for (size_t i = 0; i < nlists; i++) {
+        total += lists[i].len;
+    }
+    while (((size_t)1 << bits) < 2 * total) {
+        bits++;
+    }
+    if (total > PF_SMALL_MAX) {
+        acc = bmalloc(sizeof(struct small_acc) * total);
+        slot = bmalloc(sizeof(uint32_t) << bits);
+        if (TCOMBMED == p->type) {
+            hidx = bmalloc(sizeof(uint32_t) * total);
+            vals = bmalloc(sizeof(pf_score_t) * total);
+        }
+    }
+
+    if (TCOMBMED == p->type) {
+        n = accumulate_median(lists, nlists, acc, slot, bits, hidx, vals);
+    } else if (total <= PF_SMALL_LINEAR) {
+        n = accumulate_linear(p, lists, nlists, acc);
+    } else {
+        n = accumulate_table(p, lists, nlists, acc, slot, bits);
+    }
+
+    for (size_t i = 0; i < n && k > 0; i++) {
+        len = result_insert(out, len, k, acc[i].doc,
+            pf_score_final(p->type, acc[i].val, acc[i].count));
+    }
+
+    if (acc != stack) {
+        free(acc);
+        free(slot);
+        if (TCOMBMED == p->type) {
+            free(hidx);
+            free(vals);
+        }
+    }
+
+    return len;
+}
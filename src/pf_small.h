@@ -0,0 +1,63 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#ifndef PF_SMALL_H
+#define PF_SMALL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "fusetype.h"
+#include "util.h"
+
+/* hits accumulated on the stack, larger inputs take a heap buffer */
+#define PF_SMALL_MAX 1024
+/* up to this many hits a linear scan beats the table */
+#define PF_SMALL_LINEAR 48
+
+/*
+ * Fusion of a few short result lists at query time, without the topic and
+ * document hash tables of `struct pf_ctx`. Documents are identified by the
+ * caller's integer ids. Inputs of up to `PF_SMALL_MAX` hits are accumulated
+ * on the stack, about 64 KiB of it, by a linear scan when tiny and an open
+ * addressing table of indices otherwise, so nothing is allocated.
+ *
+ * `rank` is one based. Scores are combined as by `pf_accumulate` and
+ * `pf_present`, except that Borda counts over the length of each list.
+ * Condorcet and MC4 are not supported.
+ */
+struct pf_small_hit {
+    uint64_t doc;
+    uint32_t rank;
+    pf_score_t score;
+};
+
+struct pf_small_list {
+    const struct pf_small_hit *hits;
+    size_t len;
+    pf_score_t weight;
+};
+
+struct pf_small_params {
+    enum fusetype type;
+    long rrf_k;
+    pf_score_t phi;
+};
+
+struct pf_small_result {
+    uint64_t doc;
+    pf_score_t score;
+};
+
+size_t
+pf_small_fuse(const struct pf_small_params *p,
+    const struct pf_small_list *lists, size_t nlists,
+    struct pf_small_result *out, size_t k);
+
+#endif /* PF_SMALL_H */
@@ -0,0 +1,493 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+/*
+ * A spill file holds the number of topics, then for each topic its qid and
+ * a record per document in docno order, closed by `SPILL_END`:
+ *
+ *     uint32_t len, char docno[len], size_t count, pf_score_t val
+ *
+ * For CombMED `val` is replaced by the `count` scores, in ascending order,
+ * and for reproducible sums by a `pf_fixed_t`.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pf_spill.h"
+#include "util.h"
+
+#define SPILL_END UINT32_MAX
+
+/*
+ * The state of a document, read from a spill file or merged.
+ */
+struct spill_doc {
+    char *docno;
+    size_t docno_alloc;
+    size_t count;
+    union {
+        pf_score_t val;
+        pf_fixed_t fixed;
+    };
+    pf_score_t *vals;
+    size_t vals_alloc;
+};
+
+struct spill_in {
+    FILE *fp;
+    bool done;
+    struct spill_doc head;
+};
+
+static void
+spill_write(FILE *fp, const void *p, size_t n)
+{
+    if (n > 0 && 1 != fwrite(p, n, 1, fp)) {
+        err_exit("unable to write spill file: %s", strerror(errno));
+    }
+}
+
+static void
+spill_read(FILE *fp, void *p, size_t n)
+{
+    if (n > 0 && 1 != fread(p, n, 1, fp)) {
+        err_exit("spill file is truncated");
+    }
+}
+
+static FILE *
+spill_open(void)
+{
+    FILE *fp = tmpfile();
+
+    if (!fp) {
+        err_exit("unable to create spill file: %s", strerror(errno));
+    }
+
+    return fp;
+}
+
+static void
+write_doc(FILE *fp, const struct pf_spill *s, const char *docno, size_t count,
+    const void *val, const pf_score_t *vals)
+{
+    uint32_t len = strlen(docno);
+
+    spill_write(fp, &len, sizeof(len));
+    spill_write(fp, docno, len);
+    spill_write(fp, &count, sizeof(count));
+    if (TCOMBMED == s->fusion) {
+        spill_write(fp, vals, sizeof(pf_score_t) * count);
+    } else if (s->fixed) {
+        spill_write(fp, val, sizeof(pf_fixed_t));
+    } else {
+        spill_write(fp, val, sizeof(pf_score_t));
+    }
+}
+
+static void
+doc_reserve(struct spill_doc *d, size_t len, size_t count)
+{
+    if (len + 1 > d->docno_alloc) {
+        d->docno_alloc = len + 1;
+        d->docno = brealloc(d->docno, d->docno_alloc);
+    }
+    if (count > d->vals_alloc) {
+        d->vals_alloc = count * 2;
+        d->vals = brealloc(d->vals, sizeof(pf_score_t) * d->vals_alloc);
+    }
+}
+
+static void
+doc_free(struct spill_doc *d)
+{
+    free(d->docno);
+    free(d->vals);
+}
+
+/*
+ * Read the next document of the current topic into the head of `in`.
+ */
+static void
+in_next(const struct pf_spill *s, struct spill_in *in)
+{
+    struct spill_doc *d = &in->head;
+    uint32_t len;
+
+    spill_read(in->fp, &len, sizeof(len));
+    if (SPILL_END == len) {
+        in->done = true;
+        return;
+    }
+    doc_reserve(d, len, 0);
+    spill_read(in->fp, d->docno, len);
+    d->docno[len] = '\0';
+    spill_read(in->fp, &d->count, sizeof(d->count));
+    if (TCOMBMED == s->fusion) {
+        doc_reserve(d, len, d->count);
+        spill_read(in->fp, d->vals, sizeof(pf_score_t) * d->count);
+    } else if (s->fixed) {
+        spill_read(in->fp, &d->fixed, sizeof(d->fixed));
+    } else {
+        spill_read(in->fp, &d->val, sizeof(d->val));
+    }
+}
+
+/*
+ * Start the next topic of every input. Returns its qid.
+ */
+static int
+in_topic(const struct pf_spill *s, struct spill_in *in, size_t n)
+{
+    int qid = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        int q;
+        spill_read(in[i].fp, &q, sizeof(q));
+        if (i > 0 && q != qid) {
+            err_exit("spill files disagree on topics");
+        }
+        qid = q;
+        in[i].done = false;
+        in_next(s, &in[i]);
+    }
+
+    return qid;
+}
+
+static int
+score_cmp(const void *a, const void *b)
+{
+    pf_score_t x = *(const pf_score_t *)a, y = *(const pf_score_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Merge the documents with the smallest docno at the heads of `in` into
+ * `d`. Returns false once every input is done with the topic.
+ */
+static bool
+merge_next(const struct pf_spill *s, struct spill_in *in, size_t n,
+    struct spill_doc *d)
+{
+    const enum fusetype fusion = s->fusion;
+    const bool list = TCOMBMED == fusion;
+    struct spill_doc *h;
+    size_t m = n, inputs = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        if (!in[i].done &&
+            (m == n || strcmp(in[i].head.docno, in[m].head.docno) < 0)) {
+            m = i;
+        }
+    }
+    if (m == n) {
+        return false;
+    }
+
+    h = &in[m].head;
+    doc_reserve(d, strlen(h->docno), list ? h->count : 0);
+    strcpy(d->docno, h->docno);
+    d->count = 0;
+    d->fixed = h->fixed;
+    for (size_t i = m; i < n; i++) {
+        h = &in[i].head;
+        if (in[i].done || strcmp(h->docno, d->docno)) {
+            continue;
+        }
+        if (list) {
+            doc_reserve(d, 0, d->count + h->count);
+            memcpy(d->vals + d->count, h->vals,
+                sizeof(pf_score_t) * h->count);
+        } else if (TCOMBMIN == fusion) {
+            d->val = h->val < d->val ? h->val : d->val;
+        } else if (TCOMBMAX == fusion) {
+            d->val = h->val > d->val ? h->val : d->val;
+        } else if (inputs > 0 && s->fixed) {
+            d->fixed += h->fixed;
+        } else if (inputs > 0) {
+            d->val += h->val;
+        }
+        d->count += h->count;
+        inputs++;
+        in_next(s, &in[i]);
+    }
+    if (list && inputs > 1) {
+        qsort(d->vals, d->count, sizeof(pf_score_t), score_cmp);
+    }
+
+    return true;
+}
+
+static size_t
+in_open(struct spill_in **in, FILE **files, size_t n)
+{
+    size_t ntopics = 0;
+
+    *in = bmalloc(sizeof(struct spill_in) * n);
+    memset(*in, 0, sizeof(struct spill_in) * n);
+    for (size_t i = 0; i < n; i++) {
+        size_t t;
+        (*in)[i].fp = files[i];
+        rewind(files[i]);
+        spill_read(files[i], &t, sizeof(t));
+        if (i > 0 && t != ntopics) {
+            err_exit("spill files disagree on topics");
+        }
+        ntopics = t;
+    }
+
+    return ntopics;
+}
+
+static void
+in_close(struct spill_in *in, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        fclose(in[i].fp);
+        doc_free(&in[i].head);
+    }
+    free(in);
+}
+
+static int
+dbl_entry_cmp(const void *a, const void *b)
+{
+    const struct dbl_entry *x = *(const struct dbl_entry *const *)a;
+    const struct dbl_entry *y = *(const struct dbl_entry *const *)b;
+
+    return strcmp(x->docno, y->docno);
+}
+
+static int
+fixed_entry_cmp(const void *a, const void *b)
+{
+    const struct fixed_entry *x = *(const struct fixed_entry *const *)a;
+    const struct fixed_entry *y = *(const struct fixed_entry *const *)b;
+
+    return strcmp(x->docno, y->docno);
+}
+
+static int
+list_entry_cmp(const void *a, const void *b)
+{
+    const struct list_entry *x = *(const struct list_entry *const *)a;
+    const struct list_entry *y = *(const struct list_entry *const *)b;
+
+    return strcmp(x->docno, y->docno);
+}
+
+/*
+ * Write the accumulators of every topic of `ctx` to a new spill file.
+ */
+static FILE *
+spill_ctx(const struct pf_spill *s, struct pf_ctx *ctx)
+{
+    const bool list = TCOMBMED == ctx->fusion;
+    FILE *fp = spill_open();
+    void **ent = NULL;
+    size_t alloc = 0;
+
+    spill_write(fp, &ctx->nqids, sizeof(ctx->nqids));
+    for (size_t i = 0; i < ctx->nqids; i++) {
+        struct accum *acc = *pf_topic_lookup(ctx->topic_tab, ctx->qids[i]);
+        const uint32_t end = SPILL_END;
+        size_t n = 0;
+
+        if (acc->capacity > alloc) {
+            alloc = acc->capacity;
+            ent = brealloc(ent, sizeof(void *) * alloc);
+        }
+        spill_write(fp, &ctx->qids[i], sizeof(int));
+        if (list) {
+            struct list_entry *data = ((struct accum_list *)acc)->data;
+            for (size_t j = 0; j < acc->capacity; j++) {
+                if (data[j].is_set) {
+                    ent[n++] = &data[j];
+                }
+            }
+            qsort(ent, n, sizeof(void *), list_entry_cmp);
+            for (size_t j = 0; j < n; j++) {
+                const struct list_entry *e = ent[j];
+                size_t count;
+                const pf_score_t *vals = accum_list_values(e, &count);
+                write_doc(fp, s, e->docno, count, NULL, vals);
+            }
+        } else if (ACCUM_FIXED == acc->type) {
+            struct fixed_entry *data = ((struct accum_fixed *)acc)->data;
+            for (size_t j = 0; j < acc->capacity; j++) {
+                if (data[j].is_set) {
+                    ent[n++] = &data[j];
+                }
+            }
+            qsort(ent, n, sizeof(void *), fixed_entry_cmp);
+            for (size_t j = 0; j < n; j++) {
+                const struct fixed_entry *e = ent[j];
+                write_doc(fp, s, e->docno, e->count, &e->val, NULL);
+            }
+        } else {
+            struct dbl_entry *data = ((struct accum_dbl *)acc)->data;
+            for (size_t j = 0; j < acc->capacity; j++) {
+                if (data[j].is_set) {
+                    ent[n++] = &data[j];
+                }
+            }
+            qsort(ent, n, sizeof(void *), dbl_entry_cmp);
+            for (size_t j = 0; j < n; j++) {
+                const struct dbl_entry *e = ent[j];
+                write_doc(fp, s, e->docno, e->count, &e->val, NULL);
+            }
+        }
+        spill_write(fp, &end, sizeof(end));
+    }
+    free(ent);
+
+    return fp;
+}
+
+/*
+ * Merge `n` spill files into a new one. The inputs are closed.
+ */
+static FILE *
+spill_merge(const struct pf_spill *s, FILE **files, size_t n)
+{
+    const uint32_t end = SPILL_END;
+    struct spill_doc d = {0};
+    struct spill_in *in;
+    FILE *fp = spill_open();
+    size_t ntopics = in_open(&in, files, n);
+
+    spill_write(fp, &ntopics, sizeof(ntopics));
+    for (size_t t = 0; t < ntopics; t++) {
+        int qid = in_topic(s, in, n);
+        spill_write(fp, &qid, sizeof(qid));
+        while (merge_next(s, in, n, &d)) {
+            write_doc(fp, s, d.docno, d.count, &d.fixed, d.vals);
+        }
+        spill_write(fp, &end, sizeof(end));
+    }
+    in_close(in, n);
+    doc_free(&d);
+
+    return fp;
+}
+
+void
+pf_spill_init(struct pf_spill *s, enum fusetype fusion)
+{
+    memset(s, 0, sizeof(*s));
+    s->fusion = fusion;
+}
+
+void
+pf_spill_free(struct pf_spill *s)
+{
+    for (size_t i = 0; i < s->len; i++) {
+        fclose(s->files[i]);
+    }
+    free(s->files);
+    free(s->level);
+    memset(s, 0, sizeof(*s));
+}
+
+/*
+ * Spill the accumulators of `ctx`, which is left as is, and merge the last
+ * files while `PF_SPILL_FANIN` of them share a level.
+ */
+void
+pf_spill_add(struct pf_spill *s, struct pf_ctx *ctx)
+{
+    s->fixed = ctx->reproducible && fusetype_is_sum(s->fusion);
+    if (s->len == s->alloc) {
+        s->alloc = s->alloc ? s->alloc * 2 : PF_SPILL_FANIN;
+        s->files = brealloc(s->files, sizeof(FILE *) * s->alloc);
+        s->level = brealloc(s->level, sizeof(size_t) * s->alloc);
+    }
+    s->files[s->len] = spill_ctx(s, ctx);
+    s->level[s->len++] = 0;
+
+    while (s->len >= PF_SPILL_FANIN &&
+           s->level[s->len - PF_SPILL_FANIN] == s->level[s->len - 1]) {
+        size_t first = s->len - PF_SPILL_FANIN;
+        s->files[first] =
+            spill_merge(s, s->files + first, PF_SPILL_FANIN);
+        s->level[first]++;
+        s->len = first + 1;
+    }
+}
+
+/*
+ * Merge all spill files and write the top `depth` documents of every topic
+ * with `w`, as `pf_present_writer` does for `ctx`. Only the method, RBC
+ * depth and evaluation of `ctx` are used. The spill files are closed.
+ */
+void
+pf_spill_present(struct pf_spill *s, struct pf_ctx *ctx, struct pf_writer *w,
+    const char *id, size_t depth, bool prevent_ties)
+{
+    const bool list = TCOMBMED == s->fusion;
+    struct pf_topk tk = {0};
+    struct spill_doc d = {0};
+    struct spill_in *in;
+    char **docnos = NULL;
+    size_t ntopics, alloc = 0;
+
+    if (depth < 1) {
+        err_exit("`depth` is 0");
+    }
+    if (depth > ctx->weight_sz) {
+        depth = ctx->weight_sz;
+    }
+
+    ntopics = in_open(&in, s->files, s->len);
+    for (size_t t = 0; t < ntopics; t++) {
+        int qid = in_topic(s, in, s->len);
+        size_t n = 0;
+
+        pf_topk_reset(&tk, depth, ctx->weight_sz);
+        while (merge_next(s, in, s->len, &d)) {
+            pf_score_t score;
+            if (list) {
+                size_t m = d.count / 2;
+                score = d.count % 2 ? d.vals[m]
+                                    : (d.vals[m - 1] + d.vals[m]) / 2;
+            } else if (s->fixed) {
+                score = pf_score_final(s->fusion, pf_fixed_to(d.fixed),
+                    d.count);
+            } else {
+                score = pf_score_final(s->fusion, d.val, d.count);
+            }
+            if (n == alloc) {
+                alloc = alloc ? alloc * 2 : 1024;
+                docnos = brealloc(docnos, sizeof(char *) * alloc);
+            }
+            docnos[n] = strdup(d.docno);
+            pf_topk_push(&tk, score, docnos[n++]);
+        }
+        pf_topk_finish(&tk);
+        PF_STATS_TOPIC(qid, tk.seen);
+        if (ctx->eval) {
+            pf_eval_topic(ctx->eval, qid, &tk, depth, prevent_ties);
+        }
+        if (w) {
+            pf_present_topic(w, qid, &tk, depth, id, prevent_ties);
+        }
+        for (size_t i = 0; i < n; i++) {
+            free(docnos[i]);
+        }
+    }
+    in_close(in, s->len);
+    s->len = 0;
+    free(docnos);
+    doc_free(&d);
+    pf_topk_free(&tk);
+}
@@ -0,0 +1,58 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#ifndef PF_SPILL_H
+#define PF_SPILL_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "polyfuse.h"
+
+/* spill files merged at once */
+#define PF_SPILL_FANIN 16
+
+/*
+ * Fusion of many runs in bounded memory. Groups of runs are fused into a
+ * context each, whose accumulator states are spilled to a temporary file
+ * with the documents of every topic sorted by docno. Spill files are merged
+ * `PF_SPILL_FANIN` at a time as they reach the same level, as in an LSM
+ * tree, so at most a few dozen are open at once, and the last merge is
+ * presented without writing it out.
+ *
+ * States merge exactly: sums, minima, maxima and counts combine, and CombMED
+ * keeps every score of a document. Only the order in which sums are added
+ * differs from fusing all runs in one context, unless the contexts are
+ * `pf_set_reproducible`, whose fixed point sums are spilled and merged as
+ * such, and give the same bits.
+ */
+struct pf_spill {
+    enum fusetype fusion;
+    bool fixed;
+    FILE **files;
+    size_t *level;
+    size_t len;
+    size_t alloc;
+};
+
+void
+pf_spill_init(struct pf_spill *s, enum fusetype fusion);
+
+void
+pf_spill_free(struct pf_spill *s);
+
+void
+pf_spill_add(struct pf_spill *s, struct pf_ctx *ctx);
+
+void
+pf_spill_present(struct pf_spill *s, struct pf_ctx *ctx, struct pf_writer *w,
+    const char *id, size_t depth, bool prevent_ties);
+
+#endif /* PF_SPILL_H */
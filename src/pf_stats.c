@@ -0,0 +1,258 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include "pf_stats.h"
+
+#ifdef PF_STATS
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "util.h"
+
+static const char *phase_str[] = {
+    "other",
+    "parse",
+    "normalize",
+    "accumulate",
+    "present",
+    "write",
+};
+
+static const char *hist_str[] = {
+    "accum_dbl_slot",
+    "pf_topic_lookup",
+};
+
+static const char *counter_str[] = {
+    "alloc_bytes",
+    "alloc_calls",
+    "accum_rehash",
+    "pf_topic_rehash",
+};
+
+struct topic_count {
+    int qid;
+    size_t candidates;
+};
+
+bool pf_stats_enabled = false;
+static bool json = false;
+
+static atomic_size_t counters[PF_CNT_COUNT];
+static atomic_size_t hist[PF_HIST_COUNT][PF_STATS_PROBE_BUCKETS];
+
+/*
+ * Phases are switched by the main thread, but topics are also recorded by
+ * the workers of batch and serve, so this state is kept under `lock`.
+ */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static enum pf_phase phase = PF_PHASE_NONE;
+static struct timespec phase_wall, phase_cpu;
+static double wall[PF_PHASE_COUNT], cpu[PF_PHASE_COUNT];
+
+static struct topic_count *topics = NULL;
+static size_t ntopics = 0, topic_alloc = 0;
+
+static double
+ts_diff(const struct timespec *a, const struct timespec *b)
+{
+    return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+/*
+ * Start collecting statistics. The report is written as JSON if `as_json`.
+ */
+void
+pf_stats_enable(bool as_json)
+{
+    pf_stats_enabled = true;
+    json = as_json;
+    clock_gettime(CLOCK_MONOTONIC, &phase_wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &phase_cpu);
+}
+
+void
+pf_stats_add(enum pf_stats_counter c, size_t n)
+{
+    atomic_fetch_add_explicit(&counters[c], n, memory_order_relaxed);
+}
+
+void
+pf_stats_probe(enum pf_stats_hist h, size_t len)
+{
+    size_t b = 0;
+
+    while (len && b < PF_STATS_PROBE_BUCKETS - 1) {
+        len >>= 1;
+        b++;
+    }
+    atomic_fetch_add_explicit(&hist[h][b], 1, memory_order_relaxed);
+}
+
+/*
+ * Switch the current phase. Returns the phase that was left.
+ */
+enum pf_phase
+pf_stats_enter(enum pf_phase next)
+{
+    struct timespec now_wall, now_cpu;
+    enum pf_phase prev;
+
+    pthread_mutex_lock(&lock);
+    prev = phase;
+    clock_gettime(CLOCK_MONOTONIC, &now_wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now_cpu);
+    wall[phase] += ts_diff(&phase_wall, &now_wall);
+    cpu[phase] += ts_diff(&phase_cpu, &now_cpu);
+    phase_wall = now_wall;
+    phase_cpu = now_cpu;
+    phase = next;
+    pthread_mutex_unlock(&lock);
+
+    return prev;
+}
+
+/*
+ * Record the number of fusion candidates of a topic. The list is grown with
+ * `realloc` to stay out of the allocation counters.
+ */
+void
+pf_stats_topic(int qid, size_t candidates)
+{
+    pthread_mutex_lock(&lock);
+    if (ntopics == topic_alloc) {
+        topic_alloc = topic_alloc ? topic_alloc * 2 : 1024;
+        topics = realloc(topics, sizeof(struct topic_count) * topic_alloc);
+        if (!topics) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    topics[ntopics].qid = qid;
+    topics[ntopics++].candidates = candidates;
+    pthread_mutex_unlock(&lock);
+}
+
+static void
+bucket_label(char *buf, size_t size, size_t b)
+{
+    size_t lo = b ? (size_t)1 << (b - 1) : 0;
+    size_t hi = b ? ((size_t)1 << b) - 1 : 0;
+
+    if (PF_STATS_PROBE_BUCKETS - 1 == b) {
+        snprintf(buf, size, "%zu+", lo);
+    } else if (lo == hi) {
+        snprintf(buf, size, "%zu", lo);
+    } else {
+        snprintf(buf, size, "%zu-%zu", lo, hi);
+    }
+}
+
+static void
+report_text(FILE *stream, long peak_rss)
+{
+    size_t min = SIZE_MAX, max = 0, sum = 0;
+
+    fprintf(stream, "# stats\n");
+    fprintf(stream, "%-22s\t%10s\t%10s\n", "phase", "wall_s", "cpu_s");
+    for (size_t p = 1; p < PF_PHASE_COUNT; p++) {
+        fprintf(stream, "%-22s\t%10.6f\t%10.6f\n", phase_str[p], wall[p],
+            cpu[p]);
+    }
+    fprintf(stream, "%-22s\t%10.6f\t%10.6f\n", phase_str[0], wall[0], cpu[0]);
+    fprintf(stream, "%-22s\t%ld\n", "peak_rss_kb", peak_rss);
+    for (size_t c = 0; c < PF_CNT_COUNT; c++) {
+        fprintf(stream, "%-22s\t%zu\n", counter_str[c],
+            atomic_load_explicit(&counters[c], memory_order_relaxed));
+    }
+    for (size_t h = 0; h < PF_HIST_COUNT; h++) {
+        fprintf(stream, "probes %s:", hist_str[h]);
+        for (size_t b = 0; b < PF_STATS_PROBE_BUCKETS; b++) {
+            size_t n = atomic_load_explicit(&hist[h][b], memory_order_relaxed);
+            char label[32];
+            if (n) {
+                bucket_label(label, sizeof(label), b);
+                fprintf(stream, " %s:%zu", label, n);
+            }
+        }
+        fprintf(stream, "\n");
+    }
+    for (size_t i = 0; i < ntopics; i++) {
+        sum += topics[i].candidates;
+        min = topics[i].candidates < min ? topics[i].candidates : min;
+        max = topics[i].candidates > max ? topics[i].candidates : max;
+    }
+    if (ntopics) {
+        fprintf(stream, "%-22s\ttopics %zu min %zu mean %.1f max %zu\n",
+            "candidates", ntopics, min, (double)sum / ntopics, max);
+    }
+}
+
+static void
+report_json(FILE *stream, long peak_rss)
+{
+    fprintf(stream, "{\"phases\":{");
+    for (size_t p = 0; p < PF_PHASE_COUNT; p++) {
+        fprintf(stream, "%s\"%s\":{\"wall_s\":%.6f,\"cpu_s\":%.6f}",
+            p ? "," : "", phase_str[p], wall[p], cpu[p]);
+    }
+    fprintf(stream, "},\"peak_rss_kb\":%ld", peak_rss);
+    for (size_t c = 0; c < PF_CNT_COUNT; c++) {
+        fprintf(stream, ",\"%s\":%zu", counter_str[c],
+            atomic_load_explicit(&counters[c], memory_order_relaxed));
+    }
+    fprintf(stream, ",\"probes\":{");
+    for (size_t h = 0; h < PF_HIST_COUNT; h++) {
+        fprintf(stream, "%s\"%s\":{", h ? "," : "", hist_str[h]);
+        for (size_t b = 0; b < PF_STATS_PROBE_BUCKETS; b++) {
+            char label[32];
+            bucket_label(label, sizeof(label), b);
+            fprintf(stream, "%s\"%s\":%zu", b ? "," : "", label,
+                atomic_load_explicit(&hist[h][b], memory_order_relaxed));
+        }
+        fprintf(stream, "}");
+    }
+    fprintf(stream, "},\"candidates\":{");
+    for (size_t i = 0; i < ntopics; i++) {
+        fprintf(stream, "%s\"%d\":%zu", i ? "," : "", topics[i].qid,
+            topics[i].candidates);
+    }
+    fprintf(stream, "}}\n");
+}
+
+/*
+ * Close the current phase and write the report.
+ */
+void
+pf_stats_report(FILE *stream)
+{
+    struct rusage ru;
+
+    if (!pf_stats_enabled) {
+        return;
+    }
+
+    pf_stats_enter(PF_PHASE_NONE);
+    pthread_mutex_lock(&lock);
+    getrusage(RUSAGE_SELF, &ru);
+    if (json) {
+        report_json(stream, ru.ru_maxrss);
+    } else {
+        report_text(stream, ru.ru_maxrss);
+    }
+    free(topics);
+    topics = NULL;
+    ntopics = topic_alloc = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+#endif /* PF_STATS */
@@ -0,0 +1,143 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#ifndef PF_STATS_H
+#define PF_STATS_H
+
+/*
+ * Runtime statistics reported by `--stats`.
+ *
+ * Statistics are only built with `-DPF_STATS` (`make STATS=1`, the
+ * default). Without it every `PF_STATS_*` macro expands to nothing and the
+ * counters do not exist. When built in, the counters are only touched once
+ * `pf_stats_enable` has been called, so a run without `--stats` pays a
+ * branch per event.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+enum pf_phase {
+    PF_PHASE_NONE = 0,
+    PF_PHASE_PARSE,
+    PF_PHASE_NORMALIZE,
+    PF_PHASE_ACCUMULATE,
+    PF_PHASE_PRESENT,
+    PF_PHASE_WRITE,
+    PF_PHASE_COUNT,
+};
+
+/* probe lengths 0, 1, 2-3, 4-7, ..., and the last bucket takes the rest */
+#define PF_STATS_PROBE_BUCKETS 12
+
+enum pf_stats_hist {
+    PF_HIST_ACCUM_SLOT = 0,
+    PF_HIST_TOPIC_LOOKUP,
+    PF_HIST_COUNT,
+};
+
+enum pf_stats_counter {
+    PF_CNT_ALLOC_BYTES = 0,
+    PF_CNT_ALLOC_CALLS,
+    PF_CNT_ACCUM_REHASH,
+    PF_CNT_TOPIC_REHASH,
+    PF_CNT_COUNT,
+};
+
+#ifdef PF_STATS
+
+#include <stdatomic.h>
+
+extern bool pf_stats_enabled;
+
+void
+pf_stats_enable(bool json);
+
+void
+pf_stats_add(enum pf_stats_counter c, size_t n);
+
+void
+pf_stats_probe(enum pf_stats_hist h, size_t len);
+
+enum pf_phase
+pf_stats_enter(enum pf_phase phase);
+
+void
+pf_stats_topic(int qid, size_t candidates);
+
+void
+pf_stats_report(FILE *stream);
+
+#define PF_STATS_ADD(c, n)            \
+    do {                              \
+        if (pf_stats_enabled) {       \
+            pf_stats_add((c), (n));   \
+        }                             \
+    } while (0)
+
+#define PF_STATS_PROBE(h, len)          \
+    do {                                \
+        if (pf_stats_enabled) {         \
+            pf_stats_probe((h), (len)); \
+        }                               \
+    } while (0)
+
+#define PF_STATS_TOPIC(qid, n)          \
+    do {                                \
+        if (pf_stats_enabled) {         \
+            pf_stats_topic((qid), (n)); \
+        }                               \
+    } while (0)
+
+/*
+ * Attribute the time from here on to `phase`, saving the current phase in
+ * `prev` so `PF_STATS_LEAVE` can return to it.
+ */
+#define PF_STATS_ENTER(prev, phase) \
+    enum pf_phase prev = pf_stats_enabled ? pf_stats_enter(phase) : PF_PHASE_NONE
+
+#define PF_STATS_LEAVE(prev)          \
+    do {                              \
+        if (pf_stats_enabled) {       \
+            pf_stats_enter(prev);     \
+        }                             \
+    } while (0)
+
+#define PF_STATS_SWITCH(phase)        \
+    do {                              \
+        if (pf_stats_enabled) {       \
+            pf_stats_enter(phase);    \
+        }                             \
+    } while (0)
+
+#else
+
+#define PF_STATS_ADD(c, n) \
+    do {                   \
+    } while (0)
+#define PF_STATS_PROBE(h, len) \
+    do {                       \
+    } while (0)
+#define PF_STATS_TOPIC(qid, n) \
+    do {                       \
+    } while (0)
+#define PF_STATS_ENTER(prev, phase) \
+    do {                            \
+    } while (0)
+#define PF_STATS_LEAVE(prev) \
+    do {                     \
+    } while (0)
+#define PF_STATS_SWITCH(phase) \
+    do {                       \
+    } while (0)
+
+#endif /* PF_STATS */
+
+#endif /* PF_STATS_H */
@@ -7,31 +7,13 @@
  * that was distributed with this source code.
  */
 
+#include "pf_stats.h"
 #include "pf_topic.h"
 
 #define LOAD_FACTOR 0.75
 #define HASH(num, ht) (int_hash(num) % ht->capacity)
 #define NEED_REHASH(ht) ((float)ht->size / ht->capacity > LOAD_FACTOR)
 
-static enum accumtype accum_type = ACCUM_DBL;
-
-void
-enable_list_accumulator()
-{
-    accum_type = ACCUM_LIST;
-}
-
-/*
- * Knuth's multiplicative method.
- */
-static uint32_t
-int_hash(const uint32_t val)
-{
-    const uint32_t k = 2654435761;
-
-    return val * k;
-}
-
 /*
  * Get a low prime for linear probing.
  *
@@ -61,16 +43,19 @@ get_prime(unsigned long n)
 }
 
 /*
- * Create the hash table.
+ * Create the hash table for `capacity` topics. Topics are given accumulators
+ * of kind `type`. The table is kept larger than `capacity`, so looking up a
+ * topic that is not in a full table still finds an empty slot.
  */
 struct pf_topic *
-pf_topic_create(size_t capacity)
+pf_topic_create(size_t capacity, enum accumtype type)
 {
     struct pf_topic *htable;
 
     htable = bmalloc(sizeof(*htable));
-    htable->capacity = get_prime(capacity);
+    htable->capacity = get_prime(capacity + capacity / 3 + 3);
     htable->size = 0;
+    htable->type = type;
     htable->data = bmalloc(sizeof(void *) * htable->capacity);
 
     return htable;
@@ -84,8 +69,12 @@ pf_topic_free(struct pf_topic *htable)
 {
     for (size_t i = 0; i < htable->capacity; i++) {
         if (htable->data[i]) {
-            if (ACCUM_LIST == accum_type) {
+            if (ACCUM_LIST == htable->type) {
                 accum_list_free((struct accum_list *)htable->data[i]);
+            } else if (ACCUM_RANK == htable->type) {
+                accum_rank_free((struct accum_rank *)htable->data[i]);
+            } else if (ACCUM_FIXED == htable->type) {
+                accum_fixed_free((struct accum_fixed *)htable->data[i]);
             } else {
                 accum_dbl_free((struct accum_dbl *)htable->data[i]);
             }
@@ -121,8 +110,12 @@ pf_topic_insert(struct pf_topic **htable, const int val)
     }
 
     if (!entry) {
-        if (ACCUM_LIST == accum_type) {
+        if (ACCUM_LIST == current->type) {
             entry = accum_list_create(1000);
+        } else if (ACCUM_RANK == current->type) {
+            entry = accum_rank_create(1000);
+        } else if (ACCUM_FIXED == current->type) {
+            entry = accum_fixed_create(1000);
         } else {
             entry = accum_dbl_create(1000);
         }
@@ -144,6 +137,7 @@ pf_topic_lookup(struct pf_topic *htable, const int val)
 {
     unsigned long key;
     struct accum *entry;
+    size_t probes = 0;
 
     key = HASH(val, htable);
     entry = htable->data[key];
@@ -151,7 +145,9 @@ pf_topic_lookup(struct pf_topic *htable, const int val)
         ++key;
         key %= htable->capacity;
         entry = htable->data[key];
+        ++probes;
     }
+    PF_STATS_PROBE(PF_HIST_TOPIC_LOOKUP, probes);
 
     return &htable->data[key];
 }
@@ -165,9 +161,10 @@ pf_topic_rehash(struct pf_topic *htable)
     struct pf_topic *rehash;
     size_t new_size;
 
+    PF_STATS_ADD(PF_CNT_TOPIC_REHASH, 1);
     /* Based from current load factor, take it down to ~25% */
     new_size = htable->size * 4;
-    rehash = pf_topic_create(new_size);
+    rehash = pf_topic_create(new_size, htable->type);
 
     for (size_t i = 0; i < htable->capacity; ++i) {
         if (htable->data[i]) {
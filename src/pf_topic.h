@@ -20,14 +20,12 @@
 struct pf_topic {
     size_t capacity;
     size_t size;
+    enum accumtype type;
     struct accum **data;
 };
 
-void
-enable_list_accumulator();
-
 struct pf_topic *
-pf_topic_create(size_t capacity);
+pf_topic_create(size_t capacity, enum accumtype type);
 
 void
 pf_topic_free(struct pf_topic *htable);
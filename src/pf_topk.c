@@ -0,0 +1,141 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <string.h>
+
+#include "pf_topk.h"
+#include "pf_trace.h"
+#include "util.h"
+
+static inline bool
+topk_less(const struct pf_topk_entry *a, const struct pf_topk_entry *b)
+{
+    if (a->score != b->score) {
+        return a->score < b->score;
+    }
+
+    return strcmp(a->docno, b->docno) < 0;
+}
+
+static int
+topk_cmp(const void *a, const void *b)
+{
+    const struct pf_topk_entry *x = a, *y = b;
+
+    return topk_less(x, y) ? -1 : topk_less(y, x);
+}
+
+static void
+topk_sift_down(struct pf_topk *tk, size_t n)
+{
+    struct pf_topk_entry *heap = tk->ent;
+    struct pf_topk_entry e = heap[n];
+
+    while (2 * n + 1 < tk->size) {
+        size_t j = 2 * n + 1;
+        if (j + 1 < tk->size && topk_less(&heap[j + 1], &heap[j])) {
+            j++;
+        }
+        if (!topk_less(&heap[j], &e)) {
+            break;
+        }
+        heap[n] = heap[j];
+        n = j;
+    }
+    heap[n] = e;
+}
+
+static void
+topk_heapify(struct pf_topk *tk)
+{
+    for (size_t i = tk->size / 2; i > 0; i--) {
+        topk_sift_down(tk, i - 1);
+    }
+    tk->heap = true;
+}
+
+/*
+ * Start a new selection of the top `k` entries.
+ */
+void
+pf_topk_reset(struct pf_topk *tk, size_t k, size_t limit)
+{
+    if (k > tk->alloc) {
+        tk->alloc = k;
+        tk->ent = brealloc(tk->ent, sizeof(struct pf_topk_entry) * k);
+    }
+    tk->size = 0;
+    tk->k = k;
+    tk->limit = limit;
+    tk->seen = 0;
+    tk->nranked = 0;
+    tk->heap = false;
+}
+
+void
+pf_topk_free(struct pf_topk *tk)
+{
+    free(tk->ent);
+    memset(tk, 0, sizeof(*tk));
+}
+
+void
+pf_topk_push(struct pf_topk *tk, pf_score_t score, char *docno)
+{
+    struct pf_topk_entry e = {score, docno};
+
+    tk->seen++;
+    if (tk->size < tk->k) {
+        tk->ent[tk->size++] = e;
+        return;
+    }
+    if (0 == tk->k) {
+        return;
+    }
+
+    if (!tk->heap) {
+        topk_heapify(tk);
+    }
+    if (topk_less(&tk->ent[0], &e)) {
+        PF_TRACE1(topk_evict, tk->size);
+        tk->ent[0] = e;
+        topk_sift_down(tk, 0);
+    }
+}
+
+/*
+ * The lowest score held, which a document must beat to be selected, once
+ * `k` entries are held. Returns false while fewer are.
+ */
+bool
+pf_topk_threshold(struct pf_topk *tk, pf_score_t *score)
+{
+    if (0 == tk->k || tk->size < tk->k) {
+        return false;
+    }
+    if (!tk->heap) {
+        topk_heapify(tk);
+    }
+    *score = tk->ent[0].score;
+
+    return true;
+}
+
+/*
+ * Sort the selected entries in ascending order. Returns the number of
+ * entries.
+ */
+size_t
+pf_topk_finish(struct pf_topk *tk)
+{
+    qsort(tk->ent, tk->size, sizeof(struct pf_topk_entry), topk_cmp);
+    tk->nranked = tk->seen < tk->limit ? tk->seen : tk->limit;
+
+    return tk->size;
+}
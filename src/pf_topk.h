@@ -0,0 +1,61 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#ifndef PF_TOPK_H
+#define PF_TOPK_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "util.h"
+
+struct pf_topk_entry {
+    pf_score_t score;
+    char *docno;
+};
+
+/*
+ * Selection of the `k` best scoring documents of a topic. Documents are
+ * ordered by score, then by docno, so ties are resolved the same way on
+ * every run.
+ *
+ * Entries are gathered unordered until `k` are held and only then turned
+ * into a min-heap, so topics with fewer than `k` candidates are just
+ * sorted. The buffer is kept by `pf_topk_reset` to serve the next topic.
+ *
+ * After `pf_topk_finish`, `ent` holds `size` entries in ascending order and
+ * `nranked` is the number of candidates seen, counting at most `limit`.
+ */
+struct pf_topk {
+    struct pf_topk_entry *ent;
+    size_t size;
+    size_t alloc;
+    size_t k;
+    size_t limit;
+    size_t seen;
+    size_t nranked;
+    bool heap;
+};
+
+void
+pf_topk_reset(struct pf_topk *tk, size_t k, size_t limit);
+
+void
+pf_topk_free(struct pf_topk *tk);
+
+void
+pf_topk_push(struct pf_topk *tk, pf_score_t score, char *docno);
+
+bool
+pf_topk_threshold(struct pf_topk *tk, pf_score_t *score);
+
+size_t
+pf_topk_finish(struct pf_topk *tk);
+
+#endif /* PF_TOPK_H */
@@ -0,0 +1,116 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#ifndef PF_TRACE_H
+#define PF_TRACE_H
+
+#include <stdint.h>
+
+/*
+ * USDT probes of provider `polyfuse`, for bpftrace and perf:
+ *
+ *     file_open(path, fd)         a run file is opened
+ *     file_close(fd)
+ *     accumulate_topic_start(qid)
+ *     accumulate_topic_end(qid, entries)
+ *     present_topic_start(qid)
+ *     present_topic_end(qid, candidates)
+ *     accum_rehash(topic, old_capacity, new_capacity)
+ *     pq_evict(size)              a full heap drops its minimum
+ *     topk_evict(size)
+ *
+ * A probe is a single `nop` with an ELF note describing where its arguments
+ * live, so it costs nothing until a tracer patches it. Arguments are passed
+ * as 64 bit integers. `sys/sdt.h` is used when the build finds it, otherwise
+ * the notes are emitted here on x86-64 and AArch64. `make TRACE=0` compiles
+ * the probes out.
+ */
+#if defined(PF_TRACE) && defined(PF_TRACE_SDT)
+
+#include <sys/sdt.h>
+
+#define PF_TRACE0(name) DTRACE_PROBE(polyfuse, name)
+#define PF_TRACE1(name, a) DTRACE_PROBE1(polyfuse, name, (int64_t)(a))
+#define PF_TRACE2(name, a, b) \
+    DTRACE_PROBE2(polyfuse, name, (int64_t)(a), (int64_t)(b))
+#define PF_TRACE3(name, a, b, c) \
+    DTRACE_PROBE3(polyfuse, name, (int64_t)(a), (int64_t)(b), (int64_t)(c))
+
+#elif defined(PF_TRACE) && (defined(__x86_64__) || defined(__aarch64__))
+
+/*
+ * The `.note.stapsdt` layout of `sys/sdt.h` version 3: probe address, base
+ * address, semaphore address, then the provider, name and argument strings.
+ */
+#define PF_TRACE_NOTE_(name, args)                                         \
+    "990: nop\n"                                                           \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n"                          \
+    ".balign 4\n"                                                          \
+    ".4byte 992f-991f, 994f-993f, 3\n"                                     \
+    "991: .asciz \"stapsdt\"\n"                                            \
+    "992: .balign 4\n"                                                     \
+    "993: .8byte 990b\n"                                                   \
+    ".8byte _.stapsdt.base\n"                                              \
+    ".8byte 0\n"                                                           \
+    ".asciz \"polyfuse\"\n"                                                \
+    ".asciz \"" #name "\"\n"                                               \
+    ".asciz \"" args "\"\n"                                                \
+    "994: .balign 4\n"                                                     \
+    ".popsection\n"                                                        \
+    ".ifndef _.stapsdt.base\n"                                             \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    ".weak _.stapsdt.base\n"                                               \
+    ".hidden _.stapsdt.base\n"                                             \
+    "_.stapsdt.base: .space 1\n"                                           \
+    ".size _.stapsdt.base, 1\n"                                            \
+    ".popsection\n"                                                        \
+    ".endif\n"
+
+#define PF_TRACE0(name) __asm__ __volatile__(PF_TRACE_NOTE_(name, ""))
+#define PF_TRACE1(name, a)                                         \
+    __asm__ __volatile__(PF_TRACE_NOTE_(name, "-8@%0")               \
+                         :                                           \
+                         : "nor"((int64_t)(a)))
+#define PF_TRACE2(name, a, b)                                      \
+    __asm__ __volatile__(PF_TRACE_NOTE_(name, "-8@%0 -8@%1")         \
+                         :                                           \
+                         : "nor"((int64_t)(a)), "nor"((int64_t)(b)))
+#define PF_TRACE3(name, a, b, c)                                          \
+    __asm__ __volatile__(PF_TRACE_NOTE_(name, "-8@%0 -8@%1 -8@%2")          \
+                         :                                                  \
+                         : "nor"((int64_t)(a)), "nor"((int64_t)(b)),        \
+                         "nor"((int64_t)(c)))
+
+#else
+
+/*
+ * `sizeof` keeps the arguments from being unused without evaluating them.
+ */
+#define PF_TRACE0(name) \
+    do {                \
+    } while (0)
+#define PF_TRACE1(name, a) \
+    do {                   \
+        (void)sizeof(a);   \
+    } while (0)
+#define PF_TRACE2(name, a, b) \
+    do {                      \
+        (void)sizeof(a);      \
+        (void)sizeof(b);      \
+    } while (0)
+#define PF_TRACE3(name, a, b, c) \
+    do {                         \
+        (void)sizeof(a);         \
+        (void)sizeof(b);         \
+        (void)sizeof(c);         \
+    } while (0)
+
+#endif
+
+#endif /* PF_TRACE_H */
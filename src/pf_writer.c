@@ -0,0 +1,234 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pf_writer.h"
+#include "util.h"
+
+/* room for a score formatted on the fast path */
+#define SCORE_MAX 32
+/* largest score formatted on the fast path, so `score * 1e9` fits 63 bits */
+#define SCORE_FAST_MAX 9.0e9L
+
+/*
+ * Write the digits of `v` ending just before `end`. Returns the start of the
+ * digits.
+ */
+static inline char *
+fmt_u64_rev(char *end, uint64_t v)
+{
+    do {
+        *--end = '0' + v % 10;
+        v /= 10;
+    } while (v);
+
+    return end;
+}
+
+static inline char *
+put_u64(char *p, uint64_t v)
+{
+    char tmp[20];
+    char *s = fmt_u64_rev(tmp + sizeof(tmp), v);
+    size_t n = tmp + sizeof(tmp) - s;
+
+    memcpy(p, s, n);
+
+    return p + n;
+}
+
+/*
+ * Format `score` as `%.9Lf` into `buf` of `size` bytes, without the
+ * terminating NUL. Returns the length of the text, which may exceed `size`
+ * in the way of `snprintf`.
+ *
+ * Scores are scaled to nanounits and rounded to nearest even, which is what
+ * glibc does with the exact binary value. The product is rounded too, by at
+ * most one part in 2^64, so values that land too close to a rounding
+ * boundary, and large or non-finite values, go through `snprintf`.
+ */
+size_t
+pf_fmt_score(char *buf, size_t size, long double score)
+{
+    long double a = fabsl(score);
+
+    if (size >= SCORE_MAX && a < SCORE_FAST_MAX) {
+        long double scaled = a * 1e9L;
+        long double fl = floorl(scaled);
+        long double frac = scaled - fl;
+        long double slack = scaled * 0x1p-62L;
+        if (fabsl(frac - 0.5L) > slack) {
+            uint64_t n = (uint64_t)fl + (frac > 0.5L);
+            uint64_t ip = n / 1000000000u, fp = n % 1000000000u;
+            char *p = buf;
+            if (signbit(score)) {
+                *p++ = '-';
+            }
+            p = put_u64(p, ip);
+            *p++ = '.';
+            for (char *q = p + 9; q > p; fp /= 10) {
+                *--q = '0' + fp % 10;
+            }
+
+            return p + 9 - buf;
+        }
+    }
+
+    char tmp[SCORE_MAX];
+    int n = snprintf(tmp, sizeof(tmp), "%.9Lf", score);
+    if ((size_t)n < sizeof(tmp)) {
+        memcpy(buf, tmp, n < (int)size ? (size_t)n : size);
+    } else if ((size_t)n < size) {
+        char *big = bmalloc(n + 1);
+        snprintf(big, n + 1, "%.9Lf", score);
+        memcpy(buf, big, n);
+        free(big);
+    }
+
+    return n;
+}
+
+/*
+ * Start writing to `stream`, which is flushed first so the output stays in
+ * order.
+ */
+void
+pf_writer_init(struct pf_writer *w, FILE *stream)
+{
+    fflush(stream);
+    w->fd = fileno(stream);
+    w->cap = PF_WRITER_BUFSZ;
+    w->buf = bmalloc(w->cap);
+    w->len = 0;
+}
+
+/*
+ * Write into memory instead of a file. The buffer grows to hold the whole
+ * output, which is left in `buf` and `len` until `pf_writer_free`.
+ */
+void
+pf_writer_init_mem(struct pf_writer *w)
+{
+    w->fd = -1;
+    w->cap = PF_WRITER_MEMSZ;
+    w->buf = bmalloc(w->cap);
+    w->len = 0;
+}
+
+void
+pf_writer_flush(struct pf_writer *w)
+{
+    size_t off = 0;
+
+    if (w->fd < 0) {
+        return;
+    }
+
+    while (off < w->len) {
+        ssize_t n = write(w->fd, w->buf + off, w->len - off);
+        if (n < 0 && EINTR == errno) {
+            continue;
+        }
+        if (n < 0) {
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+        off += n;
+    }
+    w->len = 0;
+}
+
+void
+pf_writer_free(struct pf_writer *w)
+{
+    pf_writer_flush(w);
+    free(w->buf);
+    w->buf = NULL;
+}
+
+/*
+ * Make room for `n` more bytes.
+ */
+static inline void
+writer_reserve(struct pf_writer *w, size_t n)
+{
+    if (w->len + n <= w->cap) {
+        return;
+    }
+    if (w->fd < 0) {
+        while (w->len + n > w->cap) {
+            w->cap *= 2;
+        }
+        w->buf = brealloc(w->buf, w->cap);
+        return;
+    }
+    pf_writer_flush(w);
+    if (n > w->cap) {
+        w->cap = n;
+        w->buf = brealloc(w->buf, w->cap);
+    }
+}
+
+/*
+ * Write `n` bytes of `buf` as they are.
+ */
+void
+pf_writer_bytes(struct pf_writer *w, const char *buf, size_t n)
+{
+    writer_reserve(w, n);
+    memcpy(w->buf + w->len, buf, n);
+    w->len += n;
+}
+
+void
+pf_writer_line(struct pf_writer *w, int qid, const char *docno, size_t rank,
+    long double score, const char *id)
+{
+    size_t docno_len = strlen(docno), id_len = strlen(id);
+    char *p;
+    size_t n;
+
+    writer_reserve(w, docno_len + id_len + SCORE_MAX + 48);
+    p = w->buf + w->len;
+    if (qid < 0) {
+        *p++ = '-';
+    }
+    p = put_u64(p, qid < 0 ? -(uint64_t)qid : (uint64_t)qid);
+    memcpy(p, " Q0 ", 4);
+    p += 4;
+    memcpy(p, docno, docno_len);
+    p += docno_len;
+    *p++ = ' ';
+    p = put_u64(p, rank);
+    *p++ = ' ';
+
+    n = pf_fmt_score(p, w->buf + w->cap - p, score);
+    if (p + n > w->buf + w->cap) {
+        /* a score too long for the buffer, retry with enough room */
+        size_t head = p - (w->buf + w->len);
+        char *line = bmalloc(head);
+        memcpy(line, w->buf + w->len, head);
+        writer_reserve(w, head + n + id_len + 2);
+        memcpy(w->buf + w->len, line, head);
+        free(line);
+        p = w->buf + w->len + head;
+        n = pf_fmt_score(p, w->buf + w->cap - p, score);
+    }
+    p += n;
+    *p++ = ' ';
+    memcpy(p, id, id_len);
+    p += id_len;
+    *p++ = '\n';
+    w->len = p - w->buf;
+}
@@ -0,0 +1,58 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#ifndef PF_WRITER_H
+#define PF_WRITER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PF_WRITER_BUFSZ (1 << 20)
+#define PF_WRITER_MEMSZ (1 << 16)
+
+/*
+ * Buffered writer of TREC run lines. Lines are formatted by hand into a
+ * large buffer that is handed to `write` when full, bypassing stdio. The
+ * output is byte for byte that of
+ *
+ *     fprintf(stream, "%d Q0 %s %lu %.9Lf %s\n", ...)
+ *
+ * A writer without a file, from `pf_writer_init_mem`, keeps all output in
+ * its buffer.
+ */
+struct pf_writer {
+    int fd;
+    char *buf;
+    size_t len;
+    size_t cap;
+};
+
+void
+pf_writer_init(struct pf_writer *w, FILE *stream);
+
+void
+pf_writer_init_mem(struct pf_writer *w);
+
+void
+pf_writer_flush(struct pf_writer *w);
+
+void
+pf_writer_free(struct pf_writer *w);
+
+void
+pf_writer_bytes(struct pf_writer *w, const char *buf, size_t n);
+
+void
+pf_writer_line(struct pf_writer *w, int qid, const char *docno, size_t rank,
+    long double score, const char *id);
+
+size_t
+pf_fmt_score(char *buf, size_t size, long double score);
+
+#endif /* PF_WRITER_H */
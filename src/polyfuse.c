@@ -7,128 +7,428 @@
  * that was distributed with this source code.
  */
 
+#include <pthread.h>
+
+#include "pf_condorcet.h"
+#include "pf_mc4.h"
 #include "polyfuse.h"
 
-struct topic_list {
-    int *ary;
-    size_t size;
-};
+/*
+ * Create a context with no fusion method set, and the usual RRF constant.
+ */
+struct pf_ctx *
+pf_ctx_create(void)
+{
+    struct pf_ctx *ctx = bmalloc(sizeof(struct pf_ctx));
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->fusion = TNONE;
+    ctx->rrf_k = 60;
+    ctx->run_weight = 1.0;
+    ctx->mc4_tol = PF_MC4_TOL;
+    ctx->mc4_iters = PF_MC4_ITERS;
+    ctx->nthreads = 1;
 
-static enum fusetype fusion = TNONE;
-static struct pf_topic *topic_tab = NULL;
-static struct topic_list qids = {NULL, 0};
+    return ctx;
+}
 
-long rrf_k = 0;
-long double *weights = NULL;
-size_t weight_sz = 0;
+void
+pf_ctx_destroy(struct pf_ctx *ctx)
+{
+    if (!ctx) {
+        return;
+    }
+
+    free(ctx->weights);
+    free(ctx->qids);
+    if (ctx->topic_tab) {
+        pf_topic_free(ctx->topic_tab);
+    }
+    free(ctx);
+}
 
 /*
- * Allocate RBC weight to the deepest topic seen in all run files.
+ * Allocate RBC weight to the deepest topic seen in all run files. `phi` is
+ * taken from the first allocation.
  */
 void
-pf_weight_alloc(const long double phi, const size_t depth)
+pf_weight_alloc(struct pf_ctx *ctx, const pf_score_t phi, const size_t depth)
 {
-    static bool first = true;
-    static long double w;
-    static long double _phi;
-    size_t prev = weight_sz;
+    size_t prev = ctx->weight_sz;
 
-    if (depth <= weight_sz) {
+    if (depth <= ctx->weight_sz) {
         return;
     }
 
-    weight_sz = depth;
-    if (first) {
-        weights = (long double *)bmalloc(sizeof(long double) * weight_sz);
-        w = 1.0 - phi;
-        _phi = phi;
-        first = false;
+    ctx->weight_sz = depth;
+    if (!ctx->weights) {
+        ctx->weights =
+            (pf_score_t *)bmalloc(sizeof(pf_score_t) * ctx->weight_sz);
+        ctx->next_weight = 1.0 - phi;
+        ctx->phi = phi;
     } else {
-        weights =
-            (long double *)brealloc(weights, sizeof(long double) * weight_sz);
+        ctx->weights = (pf_score_t *)brealloc(
+            ctx->weights, sizeof(pf_score_t) * ctx->weight_sz);
     }
 
-    for (size_t i = prev; i < weight_sz; i++) {
-        weights[i] = w;
-        w *= _phi;
+    for (size_t i = prev; i < ctx->weight_sz; i++) {
+        ctx->weights[i] = ctx->next_weight;
+        ctx->next_weight *= ctx->phi;
     }
 }
 
 void
-pf_init(const struct trec_topic *topics)
+pf_init(struct pf_ctx *ctx, const struct trec_topic *topics)
 {
-    qids.ary = bmalloc(sizeof(int) * topics->len);
-    qids.size = topics->len;
-    memcpy(qids.ary, topics->ary, sizeof(int) * topics->len);
+    enum accumtype type = ACCUM_DBL;
 
-    if (fusion == TCOMBMED) {
-        enable_list_accumulator();
+    if (TCOMBMED == ctx->fusion) {
+        type = ACCUM_LIST;
+    } else if (fusetype_is_pairwise(ctx->fusion)) {
+        type = ACCUM_RANK;
+    } else if (ctx->reproducible && fusetype_is_sum(ctx->fusion)) {
+        type = ACCUM_FIXED;
     }
 
+    ctx->qids = bmalloc(sizeof(int) * topics->len);
+    ctx->nqids = topics->len;
+    memcpy(ctx->qids, topics->ary, sizeof(int) * topics->len);
+
     // create an accumulator for each topic
-    topic_tab = pf_topic_create(topics->len);
+    ctx->topic_tab = pf_topic_create(topics->len, type);
     for (size_t i = 0; i < topics->len; i++) {
-        pf_topic_insert(&topic_tab, topics->ary[i]);
+        pf_topic_insert(&ctx->topic_tab, topics->ary[i]);
     }
 }
 
-void
-pf_destory()
+/*
+ * Scoring functions. `rank` is one based and `n` is the length of the run.
+ */
+static inline pf_score_t
+score_borda(const struct pf_ctx *ctx, size_t rank, size_t n,
+    const struct trec_entry *tentry)
 {
-    free(weights);
-    free(qids.ary);
-    pf_topic_free(topic_tab);
+    (void)ctx;
+    (void)tentry;
+    return pf_score_borda(rank, n);
 }
 
-void
-pf_accumulate(struct trec_run *r)
+static inline pf_score_t
+score_comb(const struct pf_ctx *ctx, size_t rank, size_t n,
+    const struct trec_entry *tentry)
+{
+    (void)ctx;
+    (void)rank;
+    (void)n;
+    return tentry->score;
+}
+
+static inline pf_score_t
+score_isr(const struct pf_ctx *ctx, size_t rank, size_t n,
+    const struct trec_entry *tentry)
+{
+    (void)ctx;
+    (void)n;
+    (void)tentry;
+    return pf_score_isr(rank);
+}
+
+static inline pf_score_t
+score_rbc(const struct pf_ctx *ctx, size_t rank, size_t n,
+    const struct trec_entry *tentry)
+{
+    (void)n;
+    (void)tentry;
+    return ctx->weights[rank - 1];
+}
+
+static inline pf_score_t
+score_rrf(const struct pf_ctx *ctx, size_t rank, size_t n,
+    const struct trec_entry *tentry)
 {
+    (void)n;
+    (void)tentry;
+    return pf_score_rrf(ctx->rrf_k, rank);
+}
+
+/*
+ * Expand an accumulation kernel for one fusion method. The scoring function,
+ * entry lookup and combine operator are inlined, and the topic accumulator
+ * is only looked up when the topic changes, since run files are grouped by
+ * topic.
+ */
+#define PF_KERNEL(name, score_fn, slot, combine)                            \
+    static void name(const struct pf_ctx *ctx, struct trec_run *r)         \
+    {                                                                       \
+        const pf_score_t run_weight = ctx->run_weight;                      \
+        struct accum **curr = NULL;                                         \
+        int qid = 0;                                                        \
+        size_t first = 0;                                                   \
+                                                                            \
+        for (size_t i = 0; i < r->len; i++) {                               \
+            struct trec_entry *tentry = &r->ary[i];                         \
+            size_t rank = tentry->rank - 1;                                 \
+            if (rank >= ctx->weight_sz) {                                   \
+                continue;                                                   \
+            }                                                               \
+            if (!curr || tentry->qid != qid) {                              \
+                if (curr) {                                                 \
+                    PF_TRACE2(accumulate_topic_end, qid, i - first);        \
+                }                                                           \
+                PF_TRACE1(accumulate_topic_start, tentry->qid);             \
+                curr = pf_topic_lookup(ctx->topic_tab, tentry->qid);        \
+                qid = tentry->qid;                                          \
+                first = i;                                                  \
+            }                                                               \
+            if (*curr) {                                                    \
+                pf_score_t score =                                          \
+                    run_weight * score_fn(ctx, rank + 1, r->len, tentry);   \
+                combine(slot(curr, tentry->docno), score);                  \
+            }                                                               \
+        }                                                                   \
+        if (curr) {                                                         \
+            PF_TRACE2(accumulate_topic_end, qid, r->len - first);           \
+        }                                                                   \
+    }
+
+PF_KERNEL(accumulate_borda, score_borda, accum_dbl_slot, accum_op_add)
+PF_KERNEL(accumulate_comb_sum, score_comb, accum_dbl_slot, accum_op_add)
+PF_KERNEL(accumulate_comb_min, score_comb, accum_dbl_slot, accum_op_less)
+PF_KERNEL(accumulate_comb_max, score_comb, accum_dbl_slot, accum_op_greater)
+PF_KERNEL(accumulate_isr, score_isr, accum_dbl_slot, accum_op_add)
+PF_KERNEL(accumulate_rbc, score_rbc, accum_dbl_slot, accum_op_add)
+PF_KERNEL(accumulate_rrf, score_rrf, accum_dbl_slot, accum_op_add)
+PF_KERNEL(accumulate_borda_fixed, score_borda, accum_fixed_slot,
+    accum_op_add_fixed)
+PF_KERNEL(accumulate_comb_sum_fixed, score_comb, accum_fixed_slot,
+    accum_op_add_fixed)
+PF_KERNEL(accumulate_isr_fixed, score_isr, accum_fixed_slot, accum_op_add_fixed)
+PF_KERNEL(accumulate_rbc_fixed, score_rbc, accum_fixed_slot, accum_op_add_fixed)
+PF_KERNEL(accumulate_rrf_fixed, score_rrf, accum_fixed_slot, accum_op_add_fixed)
+
+/*
+ * CombMED keeps every score of a document in a list accumulator.
+ */
+static void
+accumulate_comb_med(const struct pf_ctx *ctx, struct trec_run *r)
+{
+    struct accum **curr = NULL;
+    int qid = 0;
+    size_t first = 0;
+
     for (size_t i = 0; i < r->len; i++) {
-        size_t rank = r->ary[i].rank - 1;
-        if (rank < weight_sz) {
-            long double score = pf_score(rank + 1, r->len, &r->ary[i]);
-            struct accum **curr;
-            curr = pf_topic_lookup(topic_tab, r->ary[i].qid);
-            if (*curr) {
-                switch (fusion) {
-                case TCOMBMED:
-                    accum_list_append(curr, r->ary[i].docno, score);
-                    break;
-                case TCOMBMIN:
-                    accum_dbl_less(curr, r->ary[i].docno, score);
-                    break;
-                case TCOMBMAX:
-                    accum_dbl_greater(curr, r->ary[i].docno, score);
-                    break;
-                default:
-                    accum_dbl_update(curr, r->ary[i].docno, score);
-                    break;
-                }
+        struct trec_entry *tentry = &r->ary[i];
+        size_t rank = tentry->rank - 1;
+        if (rank >= ctx->weight_sz) {
+            continue;
+        }
+        if (!curr || tentry->qid != qid) {
+            if (curr) {
+                PF_TRACE2(accumulate_topic_end, qid, i - first);
+            }
+            PF_TRACE1(accumulate_topic_start, tentry->qid);
+            curr = pf_topic_lookup(ctx->topic_tab, tentry->qid);
+            qid = tentry->qid;
+            first = i;
+        }
+        if (*curr) {
+            accum_list_append(curr, tentry->docno, tentry->score);
+        }
+    }
+    if (curr) {
+        PF_TRACE2(accumulate_topic_end, qid, r->len - first);
+    }
+}
+
+/*
+ * Condorcet and MC4 keep the rank of a document by every run.
+ */
+static void
+accumulate_ranks(const struct pf_ctx *ctx, struct trec_run *r)
+{
+    struct accum **curr = NULL;
+    int qid = 0;
+    size_t first = 0;
+
+    for (size_t i = 0; i < r->len; i++) {
+        struct trec_entry *tentry = &r->ary[i];
+        size_t rank = tentry->rank - 1;
+        if (rank >= ctx->weight_sz) {
+            continue;
+        }
+        if (!curr || tentry->qid != qid) {
+            if (curr) {
+                PF_TRACE2(accumulate_topic_end, qid, i - first);
             }
+            PF_TRACE1(accumulate_topic_start, tentry->qid);
+            curr = pf_topic_lookup(ctx->topic_tab, tentry->qid);
+            qid = tentry->qid;
+            first = i;
         }
+        if (*curr) {
+            accum_rank_set(curr, tentry->docno, ctx->nvoters,
+                pf_condorcet_rank(rank + 1));
+        }
+    }
+    if (curr) {
+        PF_TRACE2(accumulate_topic_end, qid, r->len - first);
+    }
+}
+
+/*
+ * The fixed point kernels of reproducible sums, for the `ACCUM_FIXED` tables
+ * `pf_init` creates for summing methods.
+ */
+static void
+accumulate_fixed(const struct pf_ctx *ctx, struct trec_run *r)
+{
+    switch (ctx->fusion) {
+    case TBORDA:
+        accumulate_borda_fixed(ctx, r);
+        break;
+    case TCOMBANZ:
+    case TCOMBMNZ:
+    case TCOMBSUM:
+        accumulate_comb_sum_fixed(ctx, r);
+        break;
+    case TISR:
+    case TLOGISR:
+        accumulate_isr_fixed(ctx, r);
+        break;
+    case TRBC:
+        accumulate_rbc_fixed(ctx, r);
+        break;
+    case TRRF:
+        accumulate_rrf_fixed(ctx, r);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Dispatch to the accumulation kernel of the current fusion method.
+ */
+void
+pf_accumulate(struct pf_ctx *ctx, struct trec_run *r)
+{
+    if (ACCUM_FIXED == ctx->topic_tab->type) {
+        accumulate_fixed(ctx, r);
+        return;
+    }
+
+    switch (ctx->fusion) {
+    case TBORDA:
+        accumulate_borda(ctx, r);
+        break;
+    case TCOMBMED:
+        accumulate_comb_med(ctx, r);
+        break;
+    case TCOMBMIN:
+        accumulate_comb_min(ctx, r);
+        break;
+    case TCOMBMAX:
+        accumulate_comb_max(ctx, r);
+        break;
+    case TCOMBANZ:
+    case TCOMBMNZ:
+    case TCOMBSUM:
+        accumulate_comb_sum(ctx, r);
+        break;
+    case TISR:
+    case TLOGISR:
+        accumulate_isr(ctx, r);
+        break;
+    case TRBC:
+        accumulate_rbc(ctx, r);
+        break;
+    case TRRF:
+        accumulate_rrf(ctx, r);
+        break;
+    case TCONDORCET:
+    case TMC4:
+        accumulate_ranks(ctx, r);
+        break;
+    default:
+        break;
+    }
+    ctx->nvoters++;
+}
+
+void
+pf_set_fusion(struct pf_ctx *ctx, const enum fusetype type)
+{
+    ctx->fusion = type;
+}
+
+void
+pf_set_rrf_k(struct pf_ctx *ctx, const long k)
+{
+    ctx->rrf_k = k;
+}
+
+/*
+ * Scale the contributions of the runs accumulated next by `w`.
+ */
+void
+pf_set_run_weight(struct pf_ctx *ctx, const pf_score_t w)
+{
+    ctx->run_weight = w;
+}
+
+/*
+ * Evaluate the fused run in `pf_present`, or stop evaluating if `ev` is
+ * `NULL`.
+ */
+void
+pf_set_eval(struct pf_ctx *ctx, struct pf_eval *ev)
+{
+    ctx->eval = ev;
+}
+
+/*
+ * Sum the contributions of the runs accumulated next in fixed point, so the
+ * fused scores are the same bits in whatever order or grouping the runs are
+ * added. Set before `pf_init`, which lays out the accumulators to match.
+ */
+void
+pf_set_reproducible(struct pf_ctx *ctx, bool on)
+{
+    if (ctx->topic_tab) {
+        err_exit("reproducible sums must be set before pf_init");
     }
+    ctx->reproducible = on;
 }
 
+/*
+ * Stop the power iteration of MC4 once an iteration moves less than `tol`
+ * of the probability mass, or after `max_iter` iterations.
+ */
 void
-pf_set_fusion(const enum fusetype type)
+pf_set_mc4(struct pf_ctx *ctx, double tol, size_t max_iter)
 {
-    fusion = type;
+    ctx->mc4_tol = tol;
+    ctx->mc4_iters = max_iter;
 }
 
+/*
+ * Threads `pf_present` may share the topics of MC4 out to.
+ */
 void
-pf_set_rrf_k(const long k)
+pf_set_threads(struct pf_ctx *ctx, size_t n)
 {
-    rrf_k = k;
+    ctx->nthreads = n ? n : 1;
 }
 
-long double
-pf_score(size_t rank, size_t n, struct trec_entry *tentry)
+pf_score_t
+pf_score(const struct pf_ctx *ctx, size_t rank, size_t n,
+    struct trec_entry *tentry)
 {
-    long double s = 0.0;
+    pf_score_t s = 0.0;
 
-    switch (fusion) {
+    switch (ctx->fusion) {
     case TBORDA:
-        s = ((long double)n - rank + 1) / n;
+        s = score_borda(ctx, rank, n, tentry);
         break;
     case TCOMBANZ:
     case TCOMBMAX:
@@ -143,7 +443,7 @@ pf_score(size_t rank, size_t n, struct trec_entry *tentry)
          * multiplication for CombMNZ is applied when the entry is added to
          * the priority queue in `pf_present`.
          */
-        s = tentry->score;
+        s = score_comb(ctx, rank, n, tentry);
         break;
     case TISR:
     case TLOGISR:
@@ -154,13 +454,13 @@ pf_score(size_t rank, size_t n, struct trec_entry *tentry)
          * multiplication for ISR, logISR is applied when the entry is added to
          * the priority queue in `pf_present`.
          */
-        s = (long double)1 / pow(rank, 2);
+        s = score_isr(ctx, rank, n, tentry);
         break;
     case TRBC:
-        s = weights[rank - 1];
+        s = score_rbc(ctx, rank, n, tentry);
         break;
     case TRRF:
-        s = 1 / ((long double)rrf_k + rank);
+        s = score_rrf(ctx, rank, n, tentry);
         break;
     default:
         break;
@@ -169,78 +469,240 @@ pf_score(size_t rank, size_t n, struct trec_entry *tentry)
     return s;
 }
 
+/*
+ * Write the fused ranking of a topic from a finished selection. With
+ * `prevent_ties` each score is raised by the number of candidates ranked
+ * below it.
+ */
+void
+pf_present_topic(struct pf_writer *w, int qid, const struct pf_topk *tk,
+    size_t depth, const char *id, bool prevent_ties)
+{
+    for (size_t k = 0; k < depth && k < tk->size; k++) {
+        const struct pf_topk_entry *e = &tk->ent[tk->size - k - 1];
+        size_t tie_breaker = prevent_ties ? tk->nranked - k - 1 : 0;
+        pf_writer_line(w, qid, e->docno, k + 1, tie_breaker + e->score, id);
+    }
+}
+
+/*
+ * Select and write the top `depth` documents of every topic to `stream`, or
+ * only evaluate them if `stream` is `NULL`. For the main thread, as the last
+ * flush is timed as the write phase.
+ */
+void
+pf_present(struct pf_ctx *ctx, FILE *stream, const char *id, size_t depth,
+    bool prevent_ties)
+{
+    struct pf_writer w;
+
+    if (stream) {
+        pf_writer_init(&w, stream);
+    }
+    pf_present_writer(ctx, stream ? &w : NULL, id, depth, prevent_ties);
+    if (stream) {
+        PF_STATS_ENTER(prev, PF_PHASE_WRITE);
+        pf_writer_free(&w);
+        PF_STATS_LEAVE(prev);
+    }
+}
+
+/*
+ * Gather the ranks of the documents of a topic into one array, a row of
+ * `ctx->nvoters` per document, and their docnos into `docno`. Documents
+ * missing runs added after their last rank are padded as unranked.
+ */
+static uint16_t *
+gather_ranks(
+    const struct pf_ctx *ctx, const struct accum_rank *acc, char ***docno)
+{
+    const size_t m = ctx->nvoters;
+    uint16_t *ranks = bmalloc(sizeof(uint16_t) * (acc->size * m + 1));
+    size_t d = 0;
+
+    *docno = bmalloc(sizeof(char *) * (acc->size + 1));
+    for (size_t j = 0; j < acc->capacity; j++) {
+        const struct rank_entry *e = &acc->data[j];
+        if (!e->is_set) {
+            continue;
+        }
+        memcpy(ranks + d * m, e->ranks, sizeof(uint16_t) * e->nranks);
+        for (size_t v = e->nranks; v < m; v++) {
+            ranks[d * m + v] = PF_CONDORCET_UNRANKED;
+        }
+        (*docno)[d++] = e->docno;
+    }
+
+    return ranks;
+}
+
+/*
+ * Push the documents of a topic to `tk` in their Condorcet order, scored
+ * from the number of documents down to one.
+ */
+static void
+present_condorcet(
+    const struct pf_ctx *ctx, const struct accum_rank *acc, struct pf_topk *tk)
+{
+    const size_t n = acc->size;
+    char **docno;
+    uint16_t *ranks = gather_ranks(ctx, acc, &docno);
+    size_t *order = bmalloc(sizeof(size_t) * (n + 1));
+
+    pf_condorcet_sort(ranks, ctx->nvoters, docno, order, n);
+    for (size_t i = 0; i < n; i++) {
+        pf_topk_push(tk, n - i, docno[order[i]]);
+    }
+    free(ranks);
+    free(docno);
+    free(order);
+}
+
+/*
+ * The documents of a topic and their MC4 scores.
+ */
+struct mc4_topic {
+    char **docno;
+    pf_score_t *pi;
+    size_t n;
+};
+
+struct mc4_task {
+    const struct pf_ctx *ctx;
+    struct mc4_topic *res;
+    size_t tid;
+};
+
+static void *
+mc4_worker(void *arg)
+{
+    struct mc4_task *task = arg;
+    const struct pf_ctx *ctx = task->ctx;
+
+    for (size_t i = task->tid; i < ctx->nqids; i += ctx->nthreads) {
+        struct mc4_topic *t = &task->res[i];
+        struct accum *curr = *pf_topic_lookup(ctx->topic_tab, ctx->qids[i]);
+        const struct accum_rank *acc = (const struct accum_rank *)curr;
+        uint16_t *ranks = gather_ranks(ctx, acc, &t->docno);
+        t->n = acc->size;
+        t->pi = bmalloc(sizeof(pf_score_t) * (t->n + 1));
+        pf_mc4_stationary(ranks, ctx->nvoters, t->docno, t->n, ctx->mc4_tol,
+            ctx->mc4_iters, t->pi);
+        free(ranks);
+    }
+
+    return NULL;
+}
+
+/*
+ * Find the stationary distribution of MC4 for every topic. Topics are
+ * shared out between the threads.
+ */
+static struct mc4_topic *
+mc4_solve(const struct pf_ctx *ctx)
+{
+    const size_t nthreads = ctx->nthreads;
+    struct mc4_topic *res =
+        bmalloc(sizeof(struct mc4_topic) * (ctx->nqids + 1));
+    struct mc4_task *task = bmalloc(sizeof(struct mc4_task) * nthreads);
+    pthread_t *tid = bmalloc(sizeof(pthread_t) * nthreads);
+
+    for (size_t i = 0; i < nthreads; i++) {
+        task[i] = (struct mc4_task){ctx, res, i};
+    }
+    for (size_t i = 1; i < nthreads; i++) {
+        if (pthread_create(&tid[i], NULL, mc4_worker, &task[i])) {
+            err_exit("unable to create thread");
+        }
+    }
+    mc4_worker(&task[0]);
+    for (size_t i = 1; i < nthreads; i++) {
+        pthread_join(tid[i], NULL);
+    }
+
+    free(tid);
+    free(task);
+
+    return res;
+}
+
+/*
+ * Select and write the top `depth` documents of every topic with `w`. The
+ * selection buffer is shared by all topics, and nothing is written if `w`
+ * is `NULL`.
+ */
 void
-pf_present(FILE *stream, const char *id, size_t depth, bool prevent_ties)
+pf_present_writer(struct pf_ctx *ctx, struct pf_writer *w, const char *id,
+    size_t depth, bool prevent_ties)
 {
+    struct pf_topk tk = {0};
+    struct mc4_topic *mc4 = NULL;
+
     if (depth < 1) {
         err_exit("`depth` is 0");
     }
 
-    if (depth > weight_sz) {
-        depth = weight_sz;
+    if (depth > ctx->weight_sz) {
+        depth = ctx->weight_sz;
     }
 
-    for (size_t i = 0; i < qids.size; i++) {
+    if (TMC4 == ctx->fusion) {
+        mc4 = mc4_solve(ctx);
+    }
+    for (size_t i = 0; i < ctx->nqids; i++) {
+        int qid = ctx->qids[i];
         struct accum *curr;
-        curr = *pf_topic_lookup(topic_tab, qids.ary[i]);
-        struct pq *pq = pq_create(weight_sz);
+        PF_TRACE1(present_topic_start, qid);
+        curr = *pf_topic_lookup(ctx->topic_tab, qid);
+        pf_topk_reset(&tk, depth, ctx->weight_sz);
         // this is why we use linear probing
-        for (size_t j = 0; j < curr->capacity; j++) {
-            long double score = 0.0;
-            size_t count = 0;
-            char *docno = NULL;
-            size_t entry_sz = 0;
-
-            if (ACCUM_LIST == curr->type) {
-                entry_sz = sizeof(struct list_entry);
-            } else {
-                entry_sz = sizeof(struct dbl_entry);
+        if (mc4) {
+            for (size_t j = 0; j < mc4[i].n; j++) {
+                pf_topk_push(&tk, mc4[i].pi[j], mc4[i].docno[j]);
             }
-
-            uint8_t *dat = (uint8_t *)curr->data + entry_sz * j;
-            struct default_entry *fentry = (struct default_entry *)dat;
-            if (!fentry->is_set) {
-                continue;
+            free(mc4[i].docno);
+            free(mc4[i].pi);
+        } else if (ACCUM_RANK == curr->type) {
+            present_condorcet(ctx, (struct accum_rank *)curr, &tk);
+        } else if (ACCUM_LIST == curr->type) {
+            struct list_entry *data = ((struct accum_list *)curr)->data;
+            for (size_t j = 0; j < curr->capacity; j++) {
+                if (data[j].is_set) {
+                    pf_topk_push(&tk, accum_list_median(&data[j]),
+                        data[j].docno);
+                }
             }
-            docno = fentry->docno;
-            if (ACCUM_LIST == curr->type) {
-                struct list_entry *lentry = (struct list_entry *)dat;
-                score = accum_list_median(lentry);
-            } else {
-                struct dbl_entry *dentry = (struct dbl_entry *)dat;
-                score = dentry->val;
-                count = dentry->count;
+        } else if (ACCUM_FIXED == curr->type) {
+            struct fixed_entry *data = ((struct accum_fixed *)curr)->data;
+            for (size_t j = 0; j < curr->capacity; j++) {
+                if (data[j].is_set) {
+                    pf_score_t sum = pf_fixed_to(data[j].val);
+                    pf_topk_push(&tk,
+                        pf_score_final(ctx->fusion, sum, data[j].count),
+                        data[j].docno);
+                }
             }
-            if (TCOMBANZ == fusion) {
-                score /= count;
-            } else if (TCOMBMNZ == fusion || TISR == fusion) {
-                score *= count;
-            } else if (TLOGISR == fusion) {
-                /* +1 to `log` to avoid log(1) = 0 */
-                score *= log(count + 1);
+        } else {
+            struct dbl_entry *data = ((struct accum_dbl *)curr)->data;
+            for (size_t j = 0; j < curr->capacity; j++) {
+                if (data[j].is_set) {
+                    pf_topk_push(&tk,
+                        pf_score_final(ctx->fusion, data[j].val,
+                            data[j].count),
+                        data[j].docno);
+                }
             }
-            pq_insert(pq, docno, score, count);
         }
-        struct dbl_entry *res = bmalloc(sizeof(struct dbl_entry) * weight_sz);
-        size_t sz = 0;
-        while (sz < weight_sz && pq->size > 0) {
-            pq_remove(pq, res + sz++);
+        pf_topk_finish(&tk);
+        PF_STATS_TOPIC(qid, tk.seen);
+        if (ctx->eval) {
+            pf_eval_topic(ctx->eval, qid, &tk, depth, prevent_ties);
         }
-        long long c = depth - 1;
-        size_t tie_breaker = 0;
-        for (size_t j = sz - 1, k = 1; c >= 0; j--, c--) {
-            if (prevent_ties) {
-                tie_breaker = j;
-            }
-            if (res[j].is_set) {
-                fprintf(stream, "%d Q0 %s %lu %.9Lf %s\n", qids.ary[i],
-                    res[j].docno, k++, tie_breaker + res[j].val, id);
-            }
-            if (0 == j) {
-                break;
-            }
+        if (w) {
+            pf_present_topic(w, qid, &tk, depth, id, prevent_ties);
         }
-        free(res);
-        pq_destroy(pq);
+        PF_TRACE2(present_topic_end, qid, tk.seen);
     }
+    free(mc4);
+    pf_topk_free(&tk);
 }
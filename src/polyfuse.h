@@ -18,32 +18,95 @@
 #include <stdlib.h>
 
 #include "fusetype.h"
+#include "pf_eval.h"
+#include "pf_score.h"
+#include "pf_stats.h"
 #include "pf_topic.h"
+#include "pf_topk.h"
+#include "pf_trace.h"
+#include "pf_writer.h"
 #include "pq.h"
 #include "trec.h"
 
+/*
+ * A fusion in progress: the method and its parameters, the RBC weights and
+ * the accumulators of every topic. Nothing is shared between contexts, so
+ * fusions can run side by side in one process, each context used by one
+ * thread at a time.
+ *
+ * A context is set up with `pf_set_fusion` and friends, then `pf_init` with
+ * the topics, before runs are added with `pf_accumulate`.
+ */
+struct pf_ctx {
+    enum fusetype fusion;
+    long rrf_k;
+    pf_score_t run_weight;
+    pf_score_t phi;
+    pf_score_t *weights;
+    size_t weight_sz;
+    pf_score_t next_weight;
+    struct pf_topic *topic_tab;
+    int *qids;
+    size_t nqids;
+    struct pf_eval *eval;
+    bool reproducible;
+    /* runs accumulated, each a voter of Condorcet and MC4 */
+    size_t nvoters;
+    double mc4_tol;
+    size_t mc4_iters;
+    size_t nthreads;
+};
+
+struct pf_ctx *
+pf_ctx_create(void);
+
 void
-pf_weight_alloc(const long double phi, const size_t len);
+pf_ctx_destroy(struct pf_ctx *ctx);
 
 void
-pf_init(const struct trec_topic *topics);
+pf_weight_alloc(struct pf_ctx *ctx, const pf_score_t phi, const size_t len);
 
 void
-pf_destory();
+pf_init(struct pf_ctx *ctx, const struct trec_topic *topics);
 
 void
-pf_accumulate(struct trec_run *r);
+pf_accumulate(struct pf_ctx *ctx, struct trec_run *r);
 
 void
-pf_set_fusion(const enum fusetype type);
+pf_set_fusion(struct pf_ctx *ctx, const enum fusetype type);
 
 void
-pf_set_rrf_k(const long k);
+pf_set_rrf_k(struct pf_ctx *ctx, const long k);
 
-long double
-pf_score(size_t rank, size_t n, struct trec_entry *tentry);
+void
+pf_set_run_weight(struct pf_ctx *ctx, const pf_score_t w);
+
+void
+pf_set_eval(struct pf_ctx *ctx, struct pf_eval *ev);
+
+void
+pf_set_reproducible(struct pf_ctx *ctx, bool on);
+
+void
+pf_set_mc4(struct pf_ctx *ctx, double tol, size_t max_iter);
+
+void
+pf_set_threads(struct pf_ctx *ctx, size_t n);
+
+pf_score_t
+pf_score(const struct pf_ctx *ctx, size_t rank, size_t n,
+    struct trec_entry *tentry);
+
+void
+pf_present_topic(struct pf_writer *w, int qid, const struct pf_topk *tk,
+    size_t depth, const char *id, bool prevent_ties);
+
+void
+pf_present(struct pf_ctx *ctx, FILE *stream, const char *id, size_t depth,
+    bool prevent_ties);
 
 void
-pf_present(FILE *stream, const char *id, size_t depth, bool prevent_ties);
+pf_present_writer(struct pf_ctx *ctx, struct pf_writer *w, const char *id,
+    size_t depth, bool prevent_ties);
 
 #endif /* RBC_H */
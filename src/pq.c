@@ -7,6 +7,7 @@
  * that was distributed with this source code.
  */
 
+#include "pf_trace.h"
 #include "pq.h"
 
 #define HEAP_ROOT 1
@@ -122,7 +123,7 @@ pq_sift_down(struct pq *pq, size_t n)
  */
 int
 pq_insert(
-    struct pq *pq, char *const val, const long double prio, const size_t count)
+    struct pq *pq, char *const val, const pf_score_t prio, const size_t count)
 {
     struct dbl_entry new, top;
     int ret = 0;
@@ -138,6 +139,7 @@ pq_insert(
 
     // make room for the new item
     if (pq_full(pq)) {
+        PF_TRACE1(pq_evict, pq_size(pq));
         pq_delete(pq);
     }
 
@@ -30,7 +30,7 @@ void
 pq_destroy(struct pq *pq);
 
 int
-pq_insert(struct pq *pq, char *const val, const long double prio,
+pq_insert(struct pq *pq, char *const val, const pf_score_t prio,
     const size_t count);
 
 int
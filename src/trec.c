@@ -7,16 +7,81 @@
  * that was distributed with this source code.
  */
 
+#include <tgmath.h>
+
+#include "pf_kll.h"
 #include "trec.h"
 
 #define INIT_SZ 16
 
-const char *trec_norm_str[] = {
-    "none", "min-max", "sum", "min-sum", "standard (zmuv)"};
+/* quantiles a trimmed min-max maps to zero and one */
+#define TRIM_LO 0.05
+#define TRIM_HI 0.95
+
+const char *trec_norm_str[] = {"none", "min-max", "sum", "min-sum",
+    "standard (zmuv)", "cdf", "median-iqr", "trimmed min-max"};
+
+/*
+ * Map a normalization name given on the command line to its type. Returns
+ * `TNORM_NONE` if unknown.
+ */
+enum trec_norm
+trec_norm_parse(const char *s)
+{
+    const char *opts[] = {
+        "minmax", "minsum", "sum", "std", "cdf", "iqr", "trim"};
+    enum trec_norm norm = TNORM_NONE;
+
+    if (strncmp(opts[0], s, strlen(opts[0])) == 0) {
+        norm = TNORM_MINMAX;
+    } else if (strncmp(opts[1], s, strlen(opts[1])) == 0) {
+        norm = TNORM_MINSUM;
+    } else if (strncmp(opts[2], s, strlen(opts[2])) == 0) {
+        norm = TNORM_SUM;
+    } else if (strncmp(opts[3], s, strlen(opts[3])) == 0) {
+        norm = TNORM_ZMUV;
+    } else if (strncmp(opts[4], s, strlen(opts[4])) == 0) {
+        norm = TNORM_CDF;
+    } else if (strncmp(opts[5], s, strlen(opts[5])) == 0) {
+        norm = TNORM_IQR;
+    } else if (strncmp(opts[6], s, strlen(opts[6])) == 0) {
+        norm = TNORM_TRIM;
+    }
 
-static int prev_top = 0;
-static int top_count = 0;
-static int max_rank = 1;
+    return norm;
+}
+
+/*
+ * State of `trec_read` while parsing a run. It is kept per call so runs can
+ * be read on several threads. With `uqv` each query variant is a list of
+ * its own, ranked from one.
+ */
+struct trec_parse {
+    int prev_top;
+    int top_count;
+    int max_rank;
+    int rank;
+    bool uqv;
+    long prev_var;
+};
+
+/*
+ * Running statistics of the scores of a list, taken as it is parsed, so it
+ * can be normalized in one more pass once read. With `welford` the mean and
+ * variance are updated as by Welford. The normalizations by quantiles feed
+ * the scores to a sketch, `kll`, instead, which is `NULL` for the others.
+ */
+struct trec_norm_stats {
+    bool welford;
+    struct pf_kll *kll;
+    size_t n;
+    pf_score_t min;
+    pf_score_t max;
+    pf_score_t sum;
+    pf_score_t abs_sum;
+    pf_score_t mean;
+    pf_score_t m2;
+};
 
 /*
  * Allocate more memory if required.
@@ -78,14 +143,14 @@ trec_destroy(struct trec_run *run)
 }
 
 static struct trec_entry
-parse_line(char *line, int *topic)
+parse_line(struct trec_parse *ps, char *line, int *topic)
 {
-    static int rank = 1;
     const char *delim = "\t ";
     const int num_sep = 5; // 6 columns
     struct trec_entry tentry;
     char *dup = strndup(line, strlen(line));
-    char *tok, *p;
+    char *tok, *p, *end, *save;
+    long var = 0;
     int c = 0;
     int ch;
 
@@ -99,28 +164,38 @@ parse_line(char *line, int *topic)
         err_exit("found %d fields but should be %d", c, num_sep + 1);
     }
 
-    tok = strtok(dup, delim);
-    tentry.qid = strtol(tok, NULL, 10);
+    tok = strtok_r(dup, delim, &save);
+    tentry.qid = strtol(tok, &end, 10);
+    if (ps->uqv) {
+        p = end;
+        var = '-' == *p ? strtol(p + 1, &end, 10) : 0;
+        if ('-' != *p || end == p + 1) {
+            err_exit("topic '%s' is not a query variant, e.g. 301-1", tok);
+        }
+    }
 
-    if (prev_top != tentry.qid) {
-        if (rank > max_rank) {
-            max_rank = rank;
+    if (ps->prev_top != tentry.qid || ps->prev_var != var) {
+        if (ps->rank > ps->max_rank) {
+            ps->max_rank = ps->rank;
+        }
+        ps->rank = 1;
+        ps->top_count++;
+        if (ps->prev_top != tentry.qid) {
+            *topic = tentry.qid;
         }
-        rank = 1;
-        top_count++;
-        prev_top = tentry.qid;
-        *topic = tentry.qid;
+        ps->prev_top = tentry.qid;
+        ps->prev_var = var;
     }
 
-    tok = strtok(NULL, delim); // skip over column 2
-    tok = strtok(NULL, delim);
+    tok = strtok_r(NULL, delim, &save); // skip over column 2
+    tok = strtok_r(NULL, delim, &save);
     tentry.docno = strndup(tok, strlen(tok));
-    tok = strtok(NULL, delim); // skip rank column
-    tentry.rank = rank++;
+    tok = strtok_r(NULL, delim, &save); // skip rank column
+    tentry.rank = ps->rank++;
     strtol(tok, NULL, 10);
-    tok = strtok(NULL, delim);
+    tok = strtok_r(NULL, delim, &save);
     tentry.score = strtod(tok, NULL);
-    tok = strtok(NULL, delim);
+    tok = strtok_r(NULL, delim, &save);
     tentry.name = strndup(tok, strlen(tok));
 
     free(dup);
@@ -128,156 +203,259 @@ parse_line(char *line, int *topic)
     return tentry;
 }
 
-void
-trec_read(struct trec_run *r, FILE *fp)
+static bool
+norm_by_quantiles(enum trec_norm norm)
 {
-    char buf[BUFSIZ] = {0};
-    int curr_topic;
-
-    prev_top = 0;
-    top_count = 0;
+    return TNORM_CDF == norm || TNORM_IQR == norm || TNORM_TRIM == norm;
+}
 
-    while (fgets(buf, BUFSIZ, fp)) {
-        if (buf[strlen(buf) - 1] != '\n') {
-            err_exit("input line exceeds %d", BUFSIZ);
-        }
-        buf[strlen(buf) - 1] = '\0';
-        curr_topic = 0;
+static void
+stats_init(struct trec_norm_stats *st, enum trec_norm norm, bool welford)
+{
+    memset(st, 0, sizeof(*st));
+    st->welford = welford;
+    if (norm_by_quantiles(norm)) {
+        st->kll = bmalloc(sizeof(struct pf_kll));
+        pf_kll_init(st->kll, PF_KLL_K);
+    }
+}
 
-        trec_entry_alloc(r);
-        r->ary[r->len++] = parse_line(buf, &curr_topic);
+/*
+ * Clear the statistics for the next list, keeping the sketch's memory.
+ */
+static void
+stats_reset(struct trec_norm_stats *st)
+{
+    struct pf_kll *kll = st->kll;
+    bool welford = st->welford;
 
-        trec_topic_alloc(&r->topics);
-        if (curr_topic > 0) {
-            r->topics.ary[r->topics.len++] = curr_topic;
-        }
+    memset(st, 0, sizeof(*st));
+    st->welford = welford;
+    if ((st->kll = kll)) {
+        pf_kll_reset(kll);
     }
+}
 
-    if (1 == top_count) {
-        max_rank = r->len;
+static void
+stats_free(struct trec_norm_stats *st)
+{
+    if (st->kll) {
+        pf_kll_free(st->kll);
+        free(st->kll);
     }
-
-    r->max_rank = max_rank;
 }
 
 static void
-minmax_normalizer(struct trec_run *r)
+stats_add(struct trec_norm_stats *st, pf_score_t x)
 {
-    long double min = 0.0, max = 0.0;
-    bool first = true;
+    pf_score_t delta;
 
-    for (size_t i = 0; i < r->len; i++) {
-        if (first) {
-            min = max = r->ary[i].score;
-            first = false;
-        }
-
-        if (r->ary[i].score < min) {
-            min = r->ary[i].score;
-        }
-        if (r->ary[i].score > max) {
-            max = r->ary[i].score;
-        }
-    }
-
-    if ((max - min) == 0) {
-        DLOG("min - max is zero.");
+    if (st->kll) {
+        st->n++;
+        pf_kll_add(st->kll, x);
         return;
     }
-
-    for (size_t i = 0; i < r->len; i++) {
-        r->ary[i].score = (r->ary[i].score - min) / (max - min);
+    if (0 == st->n++) {
+        st->min = st->max = x;
+    }
+    st->min = x < st->min ? x : st->min;
+    st->max = x > st->max ? x : st->max;
+    st->sum += x;
+    st->abs_sum += fabs(x);
+    if (st->welford) {
+        delta = x - st->mean;
+        st->mean += delta / st->n;
+        st->m2 += delta * (x - st->mean);
     }
 }
 
+/*
+ * Normalize the `n` entries of `ary` by their statistics `st`. Without
+ * Welford's updates the variance is taken in a second pass, which is what a
+ * whole run has always used; the two round differently in the last bits.
+ */
 static void
-sum_normalizer(struct trec_run *r)
+stats_apply(const struct trec_norm_stats *st, enum trec_norm norm,
+    struct trec_entry *ary, size_t n)
 {
-    long double total = 0.0;
-
-    for (size_t i = 0; i < r->len; i++) {
-        r->ary[i].score = fabsl(r->ary[i].score);
-        total += r->ary[i].score;
+    pf_score_t min = st->min, range = st->max - st->min;
+    pf_score_t total = st->abs_sum, mean = st->mean, var = st->m2, std;
+    pf_score_t lo, hi;
+
+    if (TNORM_ZMUV == norm && !st->welford) {
+        mean = st->sum / n;
+        var = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            pf_score_t x = ary[i].score - mean;
+            var += x * x;
+        }
     }
+    std = sqrt(var / n);
 
-    for (size_t i = 0; i < r->len; i++) {
-        r->ary[i].score /= total;
+    switch (norm) {
+    case TNORM_MINMAX:
+        if (0 == range) {
+            DLOG("min - max is zero.");
+            break;
+        }
+        for (size_t i = 0; i < n; i++) {
+            ary[i].score = (ary[i].score - min) / range;
+        }
+        break;
+    case TNORM_SUM:
+        for (size_t i = 0; i < n; i++) {
+            ary[i].score = fabs(ary[i].score) / total;
+        }
+        break;
+    case TNORM_MINSUM:
+        for (size_t i = 0; i < n; i++) {
+            ary[i].score = (fabs(ary[i].score) - min) / (total - min);
+        }
+        break;
+    case TNORM_ZMUV:
+        if (0 == std) {
+            DLOG("std is zero.");
+            break;
+        }
+        for (size_t i = 0; i < n; i++) {
+            ary[i].score = (ary[i].score - mean) / std;
+        }
+        break;
+    case TNORM_CDF:
+        for (size_t i = 0; i < n; i++) {
+            ary[i].score = pf_kll_cdf(st->kll, ary[i].score);
+        }
+        break;
+    case TNORM_IQR:
+        mean = pf_kll_quantile(st->kll, 0.5);
+        range = pf_kll_quantile(st->kll, 0.75) - pf_kll_quantile(st->kll, 0.25);
+        if (0 == range) {
+            DLOG("iqr is zero.");
+            break;
+        }
+        for (size_t i = 0; i < n; i++) {
+            ary[i].score = (ary[i].score - mean) / range;
+        }
+        break;
+    case TNORM_TRIM:
+        lo = pf_kll_quantile(st->kll, TRIM_LO);
+        hi = pf_kll_quantile(st->kll, TRIM_HI);
+        if (hi == lo) {
+            DLOG("trimmed min - max is zero.");
+            break;
+        }
+        for (size_t i = 0; i < n; i++) {
+            pf_score_t x = (ary[i].score - lo) / (hi - lo);
+            ary[i].score = x < 0 ? 0 : x > 1 ? 1 : x;
+        }
+        break;
+    case TNORM_NONE:
+    default:
+        break;
     }
 }
 
+/*
+ * Parse a run, normalizing each list as soon as it is read for
+ * `TNORM_TOPIC`, or the run once read for `TNORM_RUN`.
+ */
 static void
-minsum_normalizer(struct trec_run *r)
+read_run(struct trec_run *r, FILE *fp, bool uqv, enum trec_norm norm,
+    enum trec_norm_scope scope)
 {
-    long double min = 0.0, total = 0.0;
-    bool first = true;
+    char buf[BUFSIZ] = {0};
+    struct trec_parse ps = {0, 0, 1, 1, uqv, 0};
+    const bool welford = TNORM_ZMUV == norm && TNORM_TOPIC == scope;
+    struct trec_norm_stats st;
+    size_t first = 0;
+    int curr_topic;
 
-    for (size_t i = 0; i < r->len; i++) {
-        if (first) {
-            min = r->ary[i].score;
-            first = false;
+    stats_init(&st, norm, welford);
+
+    while (fgets(buf, BUFSIZ, fp)) {
+        if (buf[strlen(buf) - 1] != '\n') {
+            err_exit("input line exceeds %d", BUFSIZ);
         }
+        buf[strlen(buf) - 1] = '\0';
+        curr_topic = 0;
 
-        if (r->ary[i].score < min) {
-            min = r->ary[i].score;
+        trec_entry_alloc(r);
+        r->ary[r->len] = parse_line(&ps, buf, &curr_topic);
+        if (TNORM_NONE != norm) {
+            if (TNORM_TOPIC == scope && 1 == r->ary[r->len].rank &&
+                r->len > first) {
+                stats_apply(&st, norm, r->ary + first, r->len - first);
+                stats_reset(&st);
+                first = r->len;
+            }
+            stats_add(&st, r->ary[r->len].score);
+        }
+        r->len++;
+
+        trec_topic_alloc(&r->topics);
+        if (curr_topic > 0) {
+            r->topics.ary[r->topics.len++] = curr_topic;
         }
     }
 
-    for (size_t i = 0; i < r->len; i++) {
-        r->ary[i].score = fabsl(r->ary[i].score);
-        total += r->ary[i].score;
+    if (st.n > 0) {
+        stats_apply(&st, norm, r->ary + first, r->len - first);
     }
+    stats_free(&st);
 
-    for (size_t i = 0; i < r->len; i++) {
-        r->ary[i].score -= min;
-        r->ary[i].score /= total - min;
+    if (1 == ps.top_count) {
+        ps.max_rank = r->len;
     }
+
+    r->max_rank = ps.max_rank;
 }
 
-static void
-zmuv_normalizer(struct trec_run *r)
+void
+trec_read(struct trec_run *r, FILE *fp)
 {
-    long double mean = 0.0, var = 0.0, std = 0.0;
-
-    for (size_t i = 0; i < r->len; i++) {
-        mean += r->ary[i].score;
-    }
-    mean /= r->len;
-
-    for (size_t i = 0; i < r->len; i++) {
-        long double x = r->ary[i].score - mean;
-        var += x * x;
-    }
-    var /= r->len;
-    std = sqrtl(var);
+    read_run(r, fp, false, TNORM_NONE, TNORM_RUN);
+}
 
-    if (std == 0) {
-        DLOG("std is zero.");
-        return;
-    }
+/*
+ * Read a run of query variants, whose topics are written `301-1` for the
+ * first variant of topic 301. Entries take the base topic, and `topics`
+ * lists each base topic once, but ranks start again at one on every
+ * variant, so each variant's list is a run of its own within `r`.
+ */
+void
+trec_read_uqv(struct trec_run *r, FILE *fp)
+{
+    read_run(r, fp, true, TNORM_NONE, TNORM_RUN);
+}
 
-    for (size_t i = 0; i < r->len; i++) {
-        r->ary[i].score = (r->ary[i].score - mean) / std;
-    }
+/*
+ * `trec_read` then `trec_normalize`, but with the statistics of the scores
+ * taken while parsing. With `TNORM_TOPIC` every topic is normalized on its
+ * own, as soon as its last entry is read.
+ */
+void
+trec_read_norm(struct trec_run *r, FILE *fp, enum trec_norm norm,
+    enum trec_norm_scope scope)
+{
+    read_run(r, fp, false, norm, scope);
 }
 
+/*
+ * Normalize the scores of a whole run, as `trec_read_norm` does while
+ * parsing it.
+ */
 void
 trec_normalize(struct trec_run *r, enum trec_norm norm)
 {
-    switch (norm) {
-    case TNORM_MINMAX:
-        minmax_normalizer(r);
-        break;
-    case TNORM_SUM:
-        sum_normalizer(r);
-        break;
-    case TNORM_MINSUM:
-        minsum_normalizer(r);
-        break;
-    case TNORM_ZMUV:
-        zmuv_normalizer(r);
-        break;
-    case TNORM_NONE:
-    default:
-        break;
+    struct trec_norm_stats st;
+
+    if (TNORM_NONE == norm || 0 == r->len) {
+        return;
+    }
+    stats_init(&st, norm, false);
+    for (size_t i = 0; i < r->len; i++) {
+        stats_add(&st, r->ary[i].score);
     }
+    stats_apply(&st, norm, r->ary, r->len);
+    stats_free(&st);
 }
@@ -25,15 +25,24 @@ enum trec_norm {
     TNORM_MINMAX,
     TNORM_SUM,
     TNORM_MINSUM,
-    TNORM_ZMUV
+    TNORM_ZMUV,
+    TNORM_CDF,
+    TNORM_IQR,
+    TNORM_TRIM
 };
 extern const char *trec_norm_str[];
 
+/* whether a normalization spans the whole run, or each topic on its own */
+enum trec_norm_scope { TNORM_RUN, TNORM_TOPIC };
+
+enum trec_norm
+trec_norm_parse(const char *s);
+
 struct trec_entry {
     int qid;
-    char *docno;
     int rank;
-    long double score;
+    char *docno;
+    pf_score_t score;
     char *name;
 };
 
@@ -60,6 +69,13 @@ trec_destroy(struct trec_run *run);
 void
 trec_read(struct trec_run *r, FILE *fp);
 
+void
+trec_read_uqv(struct trec_run *r, FILE *fp);
+
+void
+trec_read_norm(struct trec_run *r, FILE *fp, enum trec_norm norm,
+    enum trec_norm_scope scope);
+
 void
 trec_normalize(struct trec_run *r, enum trec_norm norm);
 
@@ -7,6 +7,7 @@
  * that was distributed with this source code.
  */
 
+#include "pf_stats.h"
 #include "util.h"
 
 /* Exit with failure if calloc fails */
@@ -15,6 +16,8 @@ bmalloc(size_t size)
 {
     void *ptr;
 
+    PF_STATS_ADD(PF_CNT_ALLOC_BYTES, size);
+    PF_STATS_ADD(PF_CNT_ALLOC_CALLS, 1);
     ptr = calloc(1, size);
     if (!ptr) {
         perror("calloc");
@@ -30,6 +33,8 @@ bmalloc(size_t size)
 void *
 brealloc(void *old_mem, size_t new_size)
 {
+    PF_STATS_ADD(PF_CNT_ALLOC_BYTES, new_size);
+    PF_STATS_ADD(PF_CNT_ALLOC_CALLS, 1);
     old_mem = realloc(old_mem, new_size);
     if (!old_mem) {
         perror("realloc");
@@ -55,3 +60,30 @@ err_exit(const char *s, ...)
 
     exit(EXIT_FAILURE);
 }
+
+/*
+ * Parse a comma separated list of numbers into a newly allocated `*out`.
+ * Returns the number of values.
+ */
+size_t
+parse_ldbl_list(const char *s, long double **out)
+{
+    size_t len = 0, alloc = 1;
+    const char *p = s;
+
+    for (const char *c = s; *c; c++) {
+        alloc += ',' == *c;
+    }
+    *out = bmalloc(sizeof(long double) * alloc);
+
+    while (*p) {
+        char *end;
+        (*out)[len++] = strtold(p, &end);
+        if (end == p || (*end && ',' != *end)) {
+            err_exit("malformed number list '%s'", s);
+        }
+        p = *end ? end + 1 : end;
+    }
+
+    return len;
+}
@@ -11,6 +11,7 @@
 #define UTIL_H
 
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -23,6 +24,45 @@
     } while (0)
 #endif /* DEBUG */
 
+/*
+ * The type of scores and their arithmetic, chosen when building with `make
+ * SCORE=double` (the default), `SCORE=float` or `SCORE=ldouble`.
+ */
+#if defined(PF_SCORE_FLOAT)
+typedef float pf_score_t;
+#elif defined(PF_SCORE_LDOUBLE)
+typedef long double pf_score_t;
+#else
+typedef double pf_score_t;
+#endif
+
+/*
+ * Map strings to unsigned integers.
+ */
+static inline unsigned long
+str_hash(const char *str)
+{
+    char c;
+    unsigned long hash = 2081;
+
+    while ((c = *str++)) {
+        hash = hash ^ (c + (hash << 6) + (hash >> 2));
+    }
+
+    return hash;
+}
+
+/*
+ * Knuth's multiplicative method.
+ */
+static inline uint32_t
+int_hash(const uint32_t val)
+{
+    const uint32_t k = 2654435761;
+
+    return val * k;
+}
+
 void *
 bmalloc(size_t size);
 
@@ -32,4 +72,7 @@ brealloc(void *old_mem, size_t new_size);
 void
 err_exit(const char *s, ...);
 
+size_t
+parse_ldbl_list(const char *s, long double **out);
+
 #endif /* UTIL_H */
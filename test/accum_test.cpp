@@ -0,0 +1,101 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <CppUTest/TestHarness.h>
+
+extern "C" {
+#include "pf_accum.h"
+}
+
+TEST_GROUP(accum)
+{
+  struct accum *acc;
+
+  void setup()
+  {
+    acc = NULL;
+  }
+
+  void teardown()
+  {
+    if (acc && ACCUM_LIST == acc->type) {
+      accum_list_free((struct accum_list *)acc);
+    } else if (acc) {
+      accum_dbl_free((struct accum_dbl *)acc);
+    }
+  }
+};
+
+/*
+ * A docno that is a prefix of another must not share its entry
+ */
+TEST(accum, prefix_docno_is_distinct)
+{
+  acc = accum_dbl_create(7);
+
+  accum_dbl_update(&acc, "DOC-1", 1.0);
+  accum_dbl_update(&acc, "DOC-10", 2.0);
+
+  CHECK_EQUAL(2, acc->size);
+}
+
+/*
+ * Combine operators track the update count
+ */
+TEST(accum, min_max_keep_count)
+{
+  acc = accum_dbl_create(7);
+
+  struct dbl_entry *entry = accum_dbl_slot(&acc, "DOC-1");
+  accum_op_less(entry, 3.0);
+  accum_op_less(entry, 1.0);
+  accum_op_less(entry, 2.0);
+
+  CHECK_EQUAL(3, entry->count);
+  DOUBLES_EQUAL(1.0, entry->val, 0.0001);
+}
+
+/*
+ * Counts survive a rehash of the table
+ */
+TEST(accum, rehash_keeps_count)
+{
+  char buf[16];
+
+  acc = accum_dbl_create(3);
+  for (int i = 0; i < 64; i++) {
+    snprintf(buf, sizeof(buf), "DOC-%d", i % 16);
+    accum_dbl_update(&acc, buf, 1.0);
+  }
+
+  CHECK_EQUAL(16, acc->size);
+  struct dbl_entry *entry = accum_dbl_slot(&acc, "DOC-3");
+  CHECK_EQUAL(4, entry->count);
+  DOUBLES_EQUAL(4.0, entry->val, 0.0001);
+}
+
+/*
+ * Median of odd and even length lists
+ */
+TEST(accum, list_median)
+{
+  const long double vals[] = {5.0, 1.0, 4.0, 2.0, 3.0, 6.0};
+
+  acc = accum_list_create(7);
+  unsigned long key = 0;
+  for (size_t i = 0; i < 5; i++) {
+    key = accum_list_append(&acc, "DOC-1", vals[i]);
+  }
+  struct accum_list *tab = (struct accum_list *)acc;
+  DOUBLES_EQUAL(3.0, accum_list_median(&tab->data[key]), 0.0001);
+
+  key = accum_list_append(&acc, "DOC-1", vals[5]);
+  tab = (struct accum_list *)acc;
+  DOUBLES_EQUAL(3.5, accum_list_median(&tab->data[key]), 0.0001);
+}
@@ -0,0 +1,167 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <CppUTest/TestHarness.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+extern "C" {
+#include "cmd.h"
+#include "pf_serve.h"
+}
+
+/*
+ * A run of 20 topics of 1000 documents each, long enough for reads of
+ * several runs to overlap.
+ */
+static std::string
+write_run(unsigned int seed)
+{
+  char path[] = "/tmp/pf_batch_testXXXXXX";
+  FILE *fp = fdopen(mkstemp(path), "w");
+
+  for (int qid = 1; qid <= 20; qid++) {
+    for (int i = 1; i <= 1000; i++) {
+      fprintf(fp, "%d Q0 d%u %d %d.0 r%u\n", qid, rand_r(&seed) % 5000, i,
+          1001 - i, seed % 10);
+    }
+  }
+  fclose(fp);
+
+  return path;
+}
+
+static std::string
+read_file(const std::string &path)
+{
+  std::ifstream in(path);
+  std::stringstream ss;
+
+  ss << in.rdbuf();
+
+  return ss.str();
+}
+
+static int
+batch(const char *threads, const std::string &manifest)
+{
+  char *argv[] = {(char *)"batch", (char *)"-j", (char *)threads,
+      (char *)manifest.c_str(), NULL};
+
+  optind = 1;
+
+  return cmd_batch(4, argv);
+}
+
+TEST_GROUP(batch){};
+
+/*
+ * Jobs reading distinct runs on several threads write what they do one at
+ * a time
+ */
+TEST(batch, threads)
+{
+  const char *methods[] = {"combsum", "rrf", "borda", "combmnz"};
+  const size_t njobs = 8;
+  std::vector<std::string> runs, out;
+  char manifest[] = "/tmp/pf_batch_jobsXXXXXX";
+  FILE *fp = fdopen(mkstemp(manifest), "w");
+
+  for (size_t i = 0; i < 3 * njobs; i++) {
+    runs.push_back(write_run(i + 1));
+  }
+  for (size_t i = 0; i < njobs; i++) {
+    out.push_back(std::string(manifest) + "." + std::to_string(i));
+    fprintf(fp, "%s\tdepth=100\t%s,%s,%s\t%s\n", methods[i % 4],
+        runs[3 * i].c_str(), runs[3 * i + 1].c_str(), runs[3 * i + 2].c_str(),
+        out[i].c_str());
+  }
+  fclose(fp);
+
+  std::vector<std::string> want;
+  CHECK_EQUAL(0, batch("1", manifest));
+  for (const std::string &p : out) {
+    want.push_back(read_file(p));
+    CHECK(want.back().size() > 0);
+    unlink(p.c_str());
+  }
+  CHECK_EQUAL(0, batch("8", manifest));
+  for (size_t i = 0; i < njobs; i++) {
+    STRCMP_EQUAL(want[i].c_str(), read_file(out[i]).c_str());
+    unlink(out[i].c_str());
+  }
+
+  for (const std::string &p : runs) {
+    unlink(p.c_str());
+  }
+  unlink(manifest);
+}
+
+/*
+ * Jobs sharing runs on several threads read each distinct run once
+ */
+TEST(batch, shared_runs)
+{
+  const char *methods[] = {"combsum", "rrf", "borda", "combmnz"};
+  const size_t njobs = 8, nruns = 3;
+  std::vector<std::string> runs, want(njobs), got(njobs);
+  std::vector<std::thread> threads;
+  std::vector<int> status(njobs);
+  struct pf_cache c;
+
+  for (size_t i = 0; i < nruns; i++) {
+    runs.push_back(write_run(i + 1));
+  }
+  for (size_t pass = 0; pass < 2; pass++) {
+    pf_cache_init(&c, SIZE_MAX);
+    for (size_t i = 0; i < njobs; i++) {
+      auto job = [&, i] {
+        std::string msg = std::string("fuse method=") + methods[i % 4] +
+                          " depth=100 runs=" + runs[i % nruns] + "," +
+                          runs[(i + 1) % nruns];
+        struct pf_serve_req req;
+        struct pf_writer out;
+        char jerr[512];
+        pf_serve_parse(&req, msg.data(), msg.size(), jerr, sizeof(jerr));
+        pf_writer_init_mem(&out);
+        status[i] = pf_cache_fuse(&c, &req, &out, jerr, sizeof(jerr));
+        (pass ? got : want)[i] = std::string(out.buf, out.len);
+        pf_writer_free(&out);
+        pf_serve_req_free(&req);
+      };
+      if (0 == pass) {
+        job();
+      } else {
+        threads.emplace_back(job);
+      }
+    }
+    for (std::thread &t : threads) {
+      t.join();
+    }
+    CHECK_EQUAL(nruns, c.misses);
+    CHECK_EQUAL(2 * njobs - nruns, c.hits);
+    pf_cache_free(&c);
+  }
+  for (size_t i = 0; i < njobs; i++) {
+    CHECK_EQUAL(0, status[i]);
+    CHECK(want[i].size() > 0);
+    STRCMP_EQUAL(want[i].c_str(), got[i].c_str());
+  }
+
+  for (const std::string &p : runs) {
+    unlink(p.c_str());
+  }
+}
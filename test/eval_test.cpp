@@ -0,0 +1,98 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <CppUTest/TestHarness.h>
+
+extern "C" {
+#include "pf_eval.h"
+}
+
+static const char qrels_str[] = "1 0 D1 1\n"
+                                "1 0 D3 2\n"
+                                "1 0 D9 1\n"
+                                "1 0 D4 0\n";
+
+TEST_GROUP(eval)
+{
+  struct pf_qrels *qrels;
+  struct pf_eval ev;
+  struct pf_topk tk;
+
+  void setup()
+  {
+    FILE *fp = fmemopen((void *)qrels_str, sizeof(qrels_str) - 1, "r");
+    qrels = pf_qrels_read(fp);
+    fclose(fp);
+    pf_eval_init(&ev, qrels, PF_EVAL_CUTOFF);
+    memset(&tk, 0, sizeof(tk));
+    pf_topk_reset(&tk, 10, 10);
+  }
+
+  void teardown()
+  {
+    pf_topk_free(&tk);
+    pf_qrels_destroy(qrels);
+  }
+};
+
+/*
+ * Relevance grades are kept and non-relevant judgments are not counted
+ */
+TEST(eval, qrels_read)
+{
+  const struct pf_qrels_topic *qt = pf_qrels_lookup(qrels, 1);
+
+  CHECK(qt);
+  CHECK_EQUAL(3, qt->num_rel);
+  DOUBLES_EQUAL(2.0, qt->ideal[0], 1e-9);
+  CHECK(!pf_qrels_lookup(qrels, 2));
+}
+
+/*
+ * Ranking D1 D2 D3 D4 with D1 and D3 relevant
+ */
+TEST(eval, metrics)
+{
+  struct pf_metrics m;
+
+  pf_topk_push(&tk, 1.0, (char *)"D4");
+  pf_topk_push(&tk, 2.0, (char *)"D3");
+  pf_topk_push(&tk, 3.0, (char *)"D2");
+  pf_topk_push(&tk, 4.0, (char *)"D1");
+  pf_topk_finish(&tk);
+
+  CHECK(pf_eval_topic(&ev, 1, &tk, 4, false));
+  CHECK(!pf_eval_topic(&ev, 2, &tk, 4, false));
+  pf_eval_mean(&ev, &m);
+
+  CHECK_EQUAL(1, ev.ntopics);
+  DOUBLES_EQUAL((1.0 + 2.0 / 3.0) / 3.0, m.map, 1e-9);
+  DOUBLES_EQUAL(0.2, m.p, 1e-9);
+  DOUBLES_EQUAL(1.0, m.rr, 1e-9);
+  DOUBLES_EQUAL(2.0 / 3.0, m.recall, 1e-9);
+  DOUBLES_EQUAL((1.0 + 2.0 / 2.0) / (2.0 + 1.0 / log2(3) + 1.0 / 2.0),
+      m.ndcg, 1e-9);
+}
+
+/*
+ * Tied scores are ordered by decreasing docno
+ */
+TEST(eval, ties_by_docno)
+{
+  struct pf_metrics m;
+
+  pf_topk_push(&tk, 1.0, (char *)"D3");
+  pf_topk_push(&tk, 1.0, (char *)"D7");
+  pf_topk_finish(&tk);
+
+  pf_eval_topic(&ev, 1, &tk, 2, false);
+  pf_eval_mean(&ev, &m);
+
+  DOUBLES_EQUAL(0.5, m.rr, 1e-9);
+}
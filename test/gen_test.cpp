@@ -0,0 +1,93 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <CppUTest/TestHarness.h>
+
+#include <set>
+#include <string>
+
+extern "C" {
+#include "pf_gen.h"
+#include "trec.h"
+}
+
+static struct trec_run *
+gen_run(const struct pf_gen_opts *opts, size_t run)
+{
+  struct pf_gen g;
+  struct pf_writer w;
+  struct trec_run *r = trec_create();
+  FILE *fp = tmpfile();
+
+  pf_gen_init(&g, opts);
+  pf_writer_init(&w, fp);
+  pf_gen_run(&g, run, &w);
+  pf_writer_free(&w);
+  pf_gen_free(&g);
+  rewind(fp);
+  trec_read(r, fp);
+  fclose(fp);
+
+  return r;
+}
+
+TEST_GROUP(gen){};
+
+/*
+ * Every topic holds `depth` distinct documents in decreasing score order
+ */
+TEST(gen, topics)
+{
+  struct pf_gen_opts opts = {2, 5, 50, 60, 1.5, PF_GEN_SCORE_NORMAL,
+      PF_GEN_DOCNO_NUMERIC, 8, true, 3};
+  struct trec_run *r = gen_run(&opts, 0);
+
+  CHECK_EQUAL(250, r->len);
+  CHECK_EQUAL(5, r->topics.len);
+  for (size_t t = 0; t < 5; t++) {
+    std::set<std::string> docs;
+    for (size_t i = 0; i < 50; i++) {
+      struct trec_entry *e = &r->ary[t * 50 + i];
+      CHECK_EQUAL(r->ary[t * 50].qid, e->qid);
+      CHECK_EQUAL(i + 1, (size_t)e->rank);
+      CHECK_EQUAL(8, strlen(e->docno));
+      if (i > 0) {
+        CHECK(e->score <= r->ary[t * 50 + i - 1].score);
+      }
+      docs.insert(e->docno);
+    }
+    CHECK_EQUAL(50, docs.size());
+  }
+  trec_destroy(r);
+}
+
+/*
+ * The same seed gives the same run, another seed or run does not
+ */
+TEST(gen, seeded)
+{
+  struct pf_gen_opts opts = {2, 3, 20, 40, 1.0, PF_GEN_SCORE_EXP,
+      PF_GEN_DOCNO_CLUEWEB, 0, false, 11};
+  struct trec_run *a = gen_run(&opts, 1);
+  struct trec_run *b = gen_run(&opts, 1);
+  struct trec_run *c = gen_run(&opts, 0);
+  bool same = true;
+
+  CHECK_EQUAL(a->len, b->len);
+  for (size_t i = 0; i < a->len; i++) {
+    STRCMP_EQUAL(a->ary[i].docno, b->ary[i].docno);
+    CHECK(a->ary[i].score == b->ary[i].score);
+    same &= 0 == strcmp(a->ary[i].docno, c->ary[i].docno);
+  }
+  CHECK_FALSE(same);
+  CHECK_EQUAL(0, strncmp(a->ary[0].docno, "clueweb09-en", 12));
+  trec_destroy(a);
+  trec_destroy(b);
+  trec_destroy(c);
+}
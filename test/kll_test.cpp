@@ -0,0 +1,157 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <CppUTest/TestHarness.h>
+
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+extern "C" {
+#include "pf_kll.h"
+#include "trec.h"
+}
+
+/*
+ * A few ulps of a score near 1, as normalized scores are computed in
+ * `pf_score_t`
+ */
+#if defined(PF_SCORE_FLOAT)
+static const double score_tol = 4 * FLT_EPSILON;
+#else
+static const double score_tol = 4 * DBL_EPSILON;
+#endif
+
+TEST_GROUP(kll){};
+
+/*
+ * A permutation of `0..n-1`
+ */
+static std::vector<pf_score_t>
+shuffled(size_t n)
+{
+  std::vector<pf_score_t> v(n);
+  unsigned long x = 12345;
+
+  for (size_t i = 0; i < n; i++) {
+    v[i] = i;
+  }
+  for (size_t i = n - 1; i > 0; i--) {
+    x = x * 6364136223846793005UL + 1442695040888963407UL;
+    std::swap(v[i], v[(x >> 33) % (i + 1)]);
+  }
+
+  return v;
+}
+
+TEST(kll, exact_when_small)
+{
+  struct pf_kll s;
+
+  pf_kll_init(&s, PF_KLL_K);
+  for (pf_score_t x : shuffled(100)) {
+    pf_kll_add(&s, x + 1);
+  }
+  DOUBLES_EQUAL(1.0, (double)pf_kll_quantile(&s, 0.0), 0);
+  DOUBLES_EQUAL(50.0, (double)pf_kll_quantile(&s, 0.5), 0);
+  DOUBLES_EQUAL(100.0, (double)pf_kll_quantile(&s, 1.0), 0);
+  DOUBLES_EQUAL(0.0, pf_kll_cdf(&s, 0.5), 0);
+  DOUBLES_EQUAL(0.25, pf_kll_cdf(&s, 25), 1e-12);
+  DOUBLES_EQUAL(1.0, pf_kll_cdf(&s, 100), 0);
+  pf_kll_free(&s);
+}
+
+/*
+ * Rank error within a few percent of a long stream, in bounded space, and
+ * the same sketch again after a reset
+ */
+TEST(kll, bounded_error)
+{
+  const size_t n = 200000;
+  std::vector<pf_score_t> v = shuffled(n);
+  struct pf_kll s;
+  pf_score_t first[99];
+
+  pf_kll_init(&s, PF_KLL_K);
+  for (int pass = 0; pass < 2; pass++) {
+    for (pf_score_t x : v) {
+      pf_kll_add(&s, x);
+    }
+    CHECK(s.size < 3 * PF_KLL_K);
+    CHECK_EQUAL(n, s.n);
+    for (int i = 1; i < 100; i++) {
+      pf_score_t q = pf_kll_quantile(&s, i / 100.0);
+      DOUBLES_EQUAL(i / 100.0, (double)q / n, 0.02);
+      DOUBLES_EQUAL(i / 100.0, pf_kll_cdf(&s, q), 0.02);
+      if (0 == pass) {
+        first[i - 1] = q;
+      } else {
+        CHECK(first[i - 1] == q);
+      }
+    }
+    pf_kll_reset(&s);
+  }
+  pf_kll_free(&s);
+}
+
+TEST(kll, merge)
+{
+  const size_t n = 100000;
+  std::vector<pf_score_t> v = shuffled(n);
+  struct pf_kll a, b;
+
+  pf_kll_init(&a, PF_KLL_K);
+  pf_kll_init(&b, PF_KLL_K);
+  for (size_t i = 0; i < n; i++) {
+    pf_kll_add(i < n / 3 ? &a : &b, v[i]);
+  }
+  pf_kll_merge(&a, &b);
+  CHECK_EQUAL(n, a.n);
+  CHECK(a.size < 3 * PF_KLL_K);
+  for (int i = 1; i < 100; i++) {
+    DOUBLES_EQUAL(
+        i / 100.0, (double)pf_kll_quantile(&a, i / 100.0) / n, 0.02);
+  }
+  pf_kll_free(&a);
+  pf_kll_free(&b);
+}
+
+/*
+ * Normalizations by quantiles of each topic
+ */
+TEST(kll, trec_norm)
+{
+  const char *text = "1 Q0 a 1 4.0 r\n1 Q0 b 2 3.0 r\n1 Q0 c 3 2.0 r\n"
+                     "1 Q0 e 4 1.0 r\n2 Q0 a 1 10.0 r\n2 Q0 d 2 6.0 r\n";
+  const double cdf[] = {1.0, 0.75, 0.5, 0.25, 1.0, 0.5};
+  const double iqr[] = {1.0, 0.5, 0.0, -0.5, 1.0, 0.0};
+  const double trim[] = {1.0, 2.0 / 3, 1.0 / 3, 0.0, 1.0, 0.0};
+  const enum trec_norm norms[] = {TNORM_CDF, TNORM_IQR, TNORM_TRIM};
+  const double *want[] = {cdf, iqr, trim};
+  struct trec_run *r;
+  FILE *fp;
+
+  for (size_t j = 0; j < 3; j++) {
+    r = trec_create();
+    fp = tmpfile();
+    fputs(text, fp);
+    rewind(fp);
+    trec_read_norm(r, fp, norms[j], TNORM_TOPIC);
+    fclose(fp);
+    CHECK_EQUAL(6, r->len);
+    for (size_t i = 0; i < r->len; i++) {
+      DOUBLES_EQUAL(want[j][i], (double)r->ary[i].score, score_tol);
+    }
+    trec_destroy(r);
+  }
+  CHECK_EQUAL(TNORM_CDF, trec_norm_parse("cdf"));
+  CHECK_EQUAL(TNORM_IQR, trec_norm_parse("iqr"));
+  CHECK_EQUAL(TNORM_TRIM, trec_norm_parse("trim"));
+}
@@ -0,0 +1,103 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <CppUTest/TestHarness.h>
+
+extern "C" {
+#include "pf_learn.h"
+}
+
+static const char run_a[] = "1 Q0 D2 1 3.0 a\n"
+                            "1 Q0 D3 2 2.0 a\n"
+                            "1 Q0 D4 3 1.0 a\n";
+static const char run_b[] = "1 Q0 D5 1 3.0 b\n"
+                            "1 Q0 D6 2 2.0 b\n"
+                            "1 Q0 D1 3 1.0 b\n";
+static const char qrels_str[] = "1 0 D1 1\n";
+
+static struct trec_run *
+read_run(const char *s, size_t len)
+{
+  FILE *fp = fmemopen((void *)s, len, "r");
+  struct trec_run *r = trec_create();
+
+  trec_read(r, fp);
+  fclose(fp);
+
+  return r;
+}
+
+TEST_GROUP(learn)
+{
+  struct pf_runset *rs;
+  struct pf_qrels *qrels;
+
+  void setup()
+  {
+    struct trec_run *a = read_run(run_a, sizeof(run_a) - 1);
+    struct trec_run *b = read_run(run_b, sizeof(run_b) - 1);
+    FILE *fp = fmemopen((void *)qrels_str, sizeof(qrels_str) - 1, "r");
+
+    qrels = pf_qrels_read(fp);
+    fclose(fp);
+    rs = pf_runset_create(&a->topics);
+    pf_runset_add(rs, a);
+    pf_runset_add(rs, b);
+    trec_destroy(a);
+    trec_destroy(b);
+  }
+
+  void teardown()
+  {
+    pf_runset_destroy(rs);
+    pf_qrels_destroy(qrels);
+  }
+};
+
+/*
+ * The relevant document is only retrieved by the second run, so its weight
+ * must grow
+ */
+TEST(learn, favours_better_run)
+{
+  struct pf_params params = {TRRF, 60, 0.8, NULL, false};
+  struct pf_learn l;
+  long double w[2] = {1.0, 1.0};
+  bool topics[1] = {true};
+
+  pf_learn_init(&l, rs, qrels, &params);
+  long double uniform = pf_learn_eval(&l, topics, w);
+  long double learned = pf_learn_fit(&l, topics, w);
+
+  CHECK(learned > uniform);
+  DOUBLES_EQUAL(1.0 / 3.0, learned, 1e-9);
+  CHECK(w[1] > w[0]);
+  DOUBLES_EQUAL(learned, pf_learn_eval(&l, topics, w), 1e-12);
+  pf_learn_free(&l);
+}
+
+/*
+ * Threads split the topics without changing the result
+ */
+TEST(learn, threads_agree)
+{
+  struct pf_params params = {TRRF, 60, 0.8, NULL, false};
+  struct pf_learn l;
+  long double w1[2] = {1.0, 1.0}, w4[2] = {1.0, 1.0};
+  bool topics[1] = {true};
+
+  pf_learn_init(&l, rs, qrels, &params);
+  pf_learn_fit(&l, topics, w1);
+  l.nthreads = 4;
+  pf_learn_fit(&l, topics, w4);
+
+  DOUBLES_EQUAL(w1[0], w4[0], 0);
+  DOUBLES_EQUAL(w1[1], w4[1], 0);
+  pf_learn_free(&l);
+}
@@ -9,21 +9,25 @@
 
 #include <CppUTest/TestHarness.h>
 
+#include <sstream>
+#include <string>
+
 extern "C" {
 #include "polyfuse.h"
-
-extern long double *weights;
-extern size_t weight_sz;
 }
 
 TEST_GROUP(pf)
 {
+    struct pf_ctx *ctx;
+
     void setup()
     {
+      ctx = pf_ctx_create();
     }
 
     void teardown()
     {
+      pf_ctx_destroy(ctx);
     }
 };
 
@@ -35,38 +39,265 @@ TEST(pf, pf_weight_zero)
   };
 
   /* initial state */
-  POINTERS_EQUAL(NULL, weights);
-  CHECK_EQUAL(0, weight_sz);
+  POINTERS_EQUAL(NULL, ctx->weights);
+  CHECK_EQUAL(0, ctx->weight_sz);
 
   /* try to allocate zero */
-  pf_weight_alloc(0.8, 0);
+  pf_weight_alloc(ctx, 0.8, 0);
 
-  POINTERS_EQUAL(NULL, weights);
-  CHECK_EQUAL(0, weight_sz);
+  POINTERS_EQUAL(NULL, ctx->weights);
+  CHECK_EQUAL(0, ctx->weight_sz);
 
   /* compute first 5 */
-  pf_weight_alloc(0.8, 5);
+  pf_weight_alloc(ctx, 0.8, 5);
 
-  CHECK_EQUAL(5, weight_sz);
-  DOUBLES_EQUAL(result[0], weights[0], 0.01);
-  DOUBLES_EQUAL(result[1], weights[1], 0.001);
-  DOUBLES_EQUAL(result[2], weights[2], 0.0001);
-  DOUBLES_EQUAL(result[3], weights[3], 0.00001);
-  DOUBLES_EQUAL(result[4], weights[4], 0.000001);
+  CHECK_EQUAL(5, ctx->weight_sz);
+  DOUBLES_EQUAL(result[0], ctx->weights[0], 0.01);
+  DOUBLES_EQUAL(result[1], ctx->weights[1], 0.001);
+  DOUBLES_EQUAL(result[2], ctx->weights[2], 0.0001);
+  DOUBLES_EQUAL(result[3], ctx->weights[3], 0.00001);
+  DOUBLES_EQUAL(result[4], ctx->weights[4], 0.000001);
 
   /* compute next 5 */
-  pf_weight_alloc(0.8, 10);
+  pf_weight_alloc(ctx, 0.8, 10);
 
-  CHECK_EQUAL(10, weight_sz);
-  DOUBLES_EQUAL(result[5], weights[5], 0.0000001);
-  DOUBLES_EQUAL(result[6], weights[6], 0.00000001);
-  DOUBLES_EQUAL(result[7], weights[7], 0.00000001);
-  DOUBLES_EQUAL(result[8], weights[8], 0.00000001);
-  DOUBLES_EQUAL(result[9], weights[9], 0.00000001);
+  CHECK_EQUAL(10, ctx->weight_sz);
+  DOUBLES_EQUAL(result[5], ctx->weights[5], 0.0000001);
+  DOUBLES_EQUAL(result[6], ctx->weights[6], 0.00000001);
+  DOUBLES_EQUAL(result[7], ctx->weights[7], 0.00000001);
+  DOUBLES_EQUAL(result[8], ctx->weights[8], 0.00000001);
+  DOUBLES_EQUAL(result[9], ctx->weights[9], 0.00000001);
 
   /* try to allocate less than the last allocation 5 */
-  pf_weight_alloc(0.8, 3);
+  pf_weight_alloc(ctx, 0.8, 3);
+
+  CHECK_FALSE(!ctx->weights);
+  CHECK_EQUAL(10, ctx->weight_sz);
+}
+
+static struct trec_run *
+read_run(const char *lines)
+{
+  struct trec_run *r = trec_create();
+  FILE *fp = tmpfile();
+
+  fputs(lines, fp);
+  rewind(fp);
+  trec_read(r, fp);
+  fclose(fp);
+
+  return r;
+}
+
+static std::string
+present(struct pf_ctx *ctx)
+{
+  FILE *fp = tmpfile();
+  char buf[4096];
+  size_t n;
+
+  pf_present(ctx, fp, "test", 10, false);
+  rewind(fp);
+  n = fread(buf, 1, sizeof(buf), fp);
+  fclose(fp);
+
+  return std::string(buf, n);
+}
+
+/*
+ * Contexts fused in lockstep do not see each other's state
+ */
+TEST(pf, pf_ctx_independent)
+{
+  struct trec_run *a = read_run("1 Q0 d1 1 3.0 a\n1 Q0 d2 2 2.0 a\n"
+                                "2 Q0 d3 1 1.0 a\n");
+  struct trec_run *b = read_run("1 Q0 d2 1 9.0 b\n1 Q0 d4 2 1.0 b\n"
+                                "2 Q0 d1 1 5.0 b\n2 Q0 d3 2 4.0 b\n");
+  struct pf_ctx *rrf = pf_ctx_create();
+  struct pf_ctx *sum = pf_ctx_create();
+  std::string alone;
+
+  pf_set_fusion(ctx, TRRF);
+  pf_set_rrf_k(ctx, 60);
+  pf_init(ctx, &a->topics);
+  pf_weight_alloc(ctx, 0.8, a->max_rank);
+  pf_accumulate(ctx, a);
+  pf_weight_alloc(ctx, 0.8, b->max_rank);
+  pf_accumulate(ctx, b);
+  alone = present(ctx);
+
+  pf_set_fusion(rrf, TRRF);
+  pf_set_rrf_k(rrf, 60);
+  pf_set_fusion(sum, TCOMBSUM);
+  pf_init(rrf, &a->topics);
+  pf_init(sum, &a->topics);
+  pf_weight_alloc(rrf, 0.8, a->max_rank);
+  pf_weight_alloc(sum, 0.5, a->max_rank);
+  pf_accumulate(rrf, a);
+  pf_accumulate(sum, a);
+  pf_weight_alloc(rrf, 0.8, b->max_rank);
+  pf_weight_alloc(sum, 0.5, b->max_rank);
+  pf_set_run_weight(sum, 2.0);
+  pf_accumulate(rrf, b);
+  pf_accumulate(sum, b);
+
+  STRCMP_EQUAL(alone.c_str(), present(rrf).c_str());
+  STRCMP_EQUAL("1 Q0 d2 1 20.000000000 test\n"
+               "1 Q0 d1 2 3.000000000 test\n"
+               "1 Q0 d4 3 2.000000000 test\n"
+               "2 Q0 d1 1 10.000000000 test\n"
+               "2 Q0 d3 2 9.000000000 test\n",
+      present(sum).c_str());
+
+  pf_ctx_destroy(rrf);
+  pf_ctx_destroy(sum);
+  trec_destroy(a);
+  trec_destroy(b);
+}
+
+/*
+ * A cycle of majorities lands as the sort meets it from docno order, and a
+ * document only one run retrieved goes below those all runs did
+ */
+TEST(pf, condorcet)
+{
+  const char *lines[] = {"1 Q0 d1 1 3.0 a\n1 Q0 d2 2 2.0 a\n1 Q0 d3 3 1.0 a\n",
+      "1 Q0 d2 1 4.0 b\n1 Q0 d3 2 3.0 b\n1 Q0 d1 3 2.0 b\n"
+      "1 Q0 d4 4 1.0 b\n",
+      "1 Q0 d3 1 3.0 c\n1 Q0 d1 2 2.0 c\n1 Q0 d2 3 1.0 c\n"};
+  struct trec_run *r;
+
+  pf_set_fusion(ctx, TCONDORCET);
+  for (size_t i = 0; i < 3; i++) {
+    r = read_run(lines[i]);
+    if (0 == i) {
+      pf_init(ctx, &r->topics);
+    }
+    pf_weight_alloc(ctx, 0.8, r->max_rank);
+    pf_accumulate(ctx, r);
+    trec_destroy(r);
+  }
+
+  STRCMP_EQUAL("1 Q0 d3 1 4.000000000 test\n"
+               "1 Q0 d1 2 3.000000000 test\n"
+               "1 Q0 d2 3 2.000000000 test\n"
+               "1 Q0 d4 4 1.000000000 test\n",
+      present(ctx).c_str());
+}
+
+/*
+ * d1 beats every other document, d4 is only ranked by one run and beaten in
+ * it, so only the jump reaches it
+ */
+TEST(pf, mc4)
+{
+  const char *lines[] = {"1 Q0 d1 1 3.0 a\n1 Q0 d2 2 2.0 a\n1 Q0 d3 3 1.0 a\n",
+      "1 Q0 d1 1 4.0 b\n1 Q0 d3 2 3.0 b\n1 Q0 d2 3 2.0 b\n"
+      "1 Q0 d4 4 1.0 b\n",
+      "1 Q0 d2 1 3.0 c\n1 Q0 d1 2 2.0 c\n1 Q0 d3 3 1.0 c\n"};
+  struct trec_run *r;
+
+  pf_set_fusion(ctx, TMC4);
+  for (size_t i = 0; i < 3; i++) {
+    r = read_run(lines[i]);
+    if (0 == i) {
+      pf_init(ctx, &r->topics);
+    }
+    pf_weight_alloc(ctx, 0.8, r->max_rank);
+    pf_accumulate(ctx, r);
+    trec_destroy(r);
+  }
+
+  /* the stationary distribution is only as precise as `pf_score_t` */
+  const char *docnos[] = {"d1", "d2", "d3", "d4"};
+  const double scores[] = {2.961538459, 0.619856890, 0.268604651, 0.15};
+  std::istringstream in(present(ctx));
+  std::string qid, q0, docno, runid;
+  size_t rank;
+  double score;
+
+  for (size_t i = 0; i < 4; i++) {
+    CHECK(in >> qid >> q0 >> docno >> rank >> score >> runid);
+    STRCMP_EQUAL(docnos[i], docno.c_str());
+    CHECK_EQUAL(i + 1, rank);
+    DOUBLES_EQUAL(scores[i], score, 1e-5);
+  }
+  CHECK_FALSE(in >> qid);
+}
+
+/*
+ * Query variants take their base topic, and ranks start again with each
+ * variant
+ */
+TEST(pf, trec_read_uqv)
+{
+  struct trec_run *r = trec_create();
+  FILE *fp = tmpfile();
+  const int ranks[] = {1, 2, 1, 2, 3, 1};
+  const int qids[] = {301, 301, 301, 301, 301, 302};
+
+  fputs("301-1 Q0 d1 1 3.0 a\n301-1 Q0 d2 2 2.0 a\n"
+        "301-2 Q0 d2 1 5.0 a\n301-2 Q0 d3 2 4.0 a\n301-2 Q0 d1 3 1.0 a\n"
+        "302-1 Q0 d4 1 1.0 a\n",
+      fp);
+  rewind(fp);
+  trec_read_uqv(r, fp);
+  fclose(fp);
+
+  CHECK_EQUAL(6, r->len);
+  for (size_t i = 0; i < r->len; i++) {
+    CHECK_EQUAL(qids[i], r->ary[i].qid);
+    CHECK_EQUAL(ranks[i], r->ary[i].rank);
+  }
+  CHECK_EQUAL(2, r->topics.len);
+  CHECK_EQUAL(301, r->topics.ary[0]);
+  CHECK_EQUAL(302, r->topics.ary[1]);
+
+  trec_destroy(r);
+}
+
+/*
+ * Normalizing while reading matches `trec_normalize` for a whole run, and
+ * scales each topic by its own scores with `TNORM_TOPIC`
+ */
+TEST(pf, trec_read_norm)
+{
+  const char *text = "1 Q0 a 1 4.0 r\n1 Q0 b 2 3.0 r\n1 Q0 c 3 2.0 r\n"
+                     "2 Q0 a 1 10.0 r\n2 Q0 d 2 6.0 r\n";
+  const enum trec_norm norms[] = {TNORM_MINMAX, TNORM_SUM, TNORM_MINSUM,
+      TNORM_ZMUV, TNORM_CDF, TNORM_IQR, TNORM_TRIM};
+  const double minmax[] = {1.0, 0.5, 0.0, 1.0, 0.0};
+  struct trec_run *a, *b;
+  FILE *fp;
+
+  for (enum trec_norm norm : norms) {
+    a = trec_create();
+    b = trec_create();
+    fp = tmpfile();
+    fputs(text, fp);
+    rewind(fp);
+    trec_read(a, fp);
+    rewind(fp);
+    trec_read_norm(b, fp, norm, TNORM_RUN);
+    fclose(fp);
+    trec_normalize(a, norm);
+    CHECK_EQUAL(a->len, b->len);
+    for (size_t i = 0; i < a->len; i++) {
+      CHECK(a->ary[i].score == b->ary[i].score);
+    }
+    trec_destroy(a);
+    trec_destroy(b);
+  }
 
-  CHECK_FALSE(!weights);
-  CHECK_EQUAL(10, weight_sz);
+  a = trec_create();
+  fp = tmpfile();
+  fputs(text, fp);
+  rewind(fp);
+  trec_read_norm(a, fp, TNORM_MINMAX, TNORM_TOPIC);
+  fclose(fp);
+  CHECK_EQUAL(5, a->len);
+  for (size_t i = 0; i < a->len; i++) {
+    DOUBLES_EQUAL(minmax[i], a->ary[i].score, 1e-12);
+  }
+  trec_destroy(a);
 }
@@ -0,0 +1,80 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <CppUTest/TestHarness.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+extern "C" {
+#include "pf_prefetch.h"
+}
+
+TEST_GROUP(prefetch){};
+
+/*
+ * Files of any size, around chunk boundaries, read back as written, also
+ * after a file is closed before its end
+ */
+TEST(prefetch, reads_in_order)
+{
+  const size_t sizes[] = {0, 10, PF_PREFETCH_CHUNK, 2 * PF_PREFETCH_CHUNK + 7,
+      PF_PREFETCH_CHUNK - 1, 100};
+  std::vector<std::string> text, paths;
+  std::vector<char *> argv;
+  struct pf_prefetch *pf;
+  FILE *fp;
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    char path[] = "/tmp/pf_prefetch_XXXXXX";
+    int fd = mkstemp(path);
+    std::string s;
+    for (size_t j = 0; j < sizes[i]; j++) {
+      s += (char)('a' + (i * 7 + j) % 26);
+    }
+    CHECK(write(fd, s.data(), s.size()) == (ssize_t)s.size());
+    close(fd);
+    text.push_back(s);
+    paths.push_back(path);
+  }
+  for (std::string &p : paths) {
+    argv.push_back(&p[0]);
+  }
+
+  pf = pf_prefetch_create(argv.data(), argv.size());
+  for (size_t i = 0; i < text.size(); i++) {
+    std::string got;
+    char buf[4096];
+    size_t n;
+    fp = pf_prefetch_next(pf);
+    CHECK(fp);
+    if (3 == i) {
+      /* leave most of the file unread */
+      n = fread(buf, 1, sizeof(buf), fp);
+      CHECK_EQUAL(sizeof(buf), n);
+      CHECK(0 == text[i].compare(0, n, buf, n));
+      fclose(fp);
+      continue;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+      got.append(buf, n);
+    }
+    fclose(fp);
+    CHECK(text[i] == got);
+  }
+  POINTERS_EQUAL(NULL, pf_prefetch_next(pf));
+  pf_prefetch_destroy(pf);
+
+  for (const std::string &p : paths) {
+    unlink(p.c_str());
+  }
+}
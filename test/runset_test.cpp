@@ -0,0 +1,207 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <CppUTest/TestHarness.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+extern "C" {
+#include "pf_runset.h"
+#include "polyfuse.h"
+}
+
+/*
+ * A run of two topics of `n` documents drawn from a pool of 64.
+ */
+static struct trec_run *
+make_run(size_t n, unsigned int seed)
+{
+  struct trec_run *r = trec_create();
+  std::string text;
+  char line[128];
+
+  for (int qid = 1; qid <= 2; qid++) {
+    bool used[64] = {false};
+    for (size_t i = 0; i < n; i++) {
+      unsigned int d;
+      do {
+        d = rand_r(&seed) % 64;
+      } while (used[d]);
+      used[d] = true;
+      snprintf(line, sizeof(line), "%d Q0 D%u %zu %zu.0 r\n", qid, d, i + 1,
+          n - i);
+      text += line;
+    }
+  }
+  FILE *fp = fmemopen((void *)text.data(), text.size(), "r");
+  trec_read(r, fp);
+  fclose(fp);
+
+  return r;
+}
+
+TEST_GROUP(runset)
+{
+  struct pf_runset *rs;
+  struct pf_topk full;
+  struct pf_topk ta;
+
+  void setup()
+  {
+    const size_t len[] = {40, 25, 50, 10, 30};
+
+    rs = NULL;
+    for (size_t i = 0; i < 5; i++) {
+      struct trec_run *r = make_run(len[i], i + 1);
+      if (!rs) {
+        rs = pf_runset_create(&r->topics);
+      }
+      pf_runset_add(rs, r);
+      trec_destroy(r);
+    }
+    pf_runset_index(rs);
+    memset(&full, 0, sizeof(full));
+    memset(&ta, 0, sizeof(ta));
+  }
+
+  void teardown()
+  {
+    pf_topk_free(&full);
+    pf_topk_free(&ta);
+    pf_runset_destroy(rs);
+  }
+};
+
+/*
+ * The threshold algorithm selects the same documents, with the same scores,
+ * as fusing every posting
+ */
+TEST(runset, ta_matches_full)
+{
+  const enum fusetype types[] = {TBORDA, TISR, TLOGISR, TRBC, TRRF};
+  const long double weights[] = {1.0, 0.5, 2.0, 0.0, 1.5};
+  pf_score_t bound;
+
+  for (enum fusetype type : types) {
+    for (size_t k : {1, 5, 20, 64}) {
+      struct pf_params params = {type, 10, 0.7, NULL, false};
+      for (int w = 0; w < 2; w++) {
+        params.weights = w ? weights : NULL;
+        CHECK(pf_runset_ta_applies(rs, &params));
+        for (size_t t = 0; t < rs->ntopics; t++) {
+          size_t n = pf_runset_rank(rs, t, &params, k, &full);
+          CHECK_EQUAL(n, pf_runset_rank_ta(rs, t, &params, k, NULL, &ta,
+                             &bound));
+          CHECK_EQUAL(0.0, (double)bound);
+          CHECK_EQUAL(full.nranked, ta.nranked);
+          for (size_t i = 0; i < n; i++) {
+            STRCMP_EQUAL(full.ent[i].docno, ta.ent[i].docno);
+            CHECK(full.ent[i].score == ta.ent[i].score);
+          }
+        }
+      }
+    }
+  }
+}
+
+/*
+ * A deadline already past stops after the first depth, with a bound on
+ * what was missed
+ */
+TEST(runset, ta_deadline)
+{
+  struct pf_params params = {TRRF, 60, 0.8, NULL, false};
+  struct timespec past = {0, 0};
+  pf_score_t bound;
+
+  pf_runset_rank(rs, 0, &params, 10, &full);
+  pf_runset_rank_ta(rs, 0, &params, 10, &past, &ta, &bound);
+  CHECK(bound > 0.0);
+  CHECK(ta.size <= 5);
+  for (size_t i = 0; i + 1 < ta.size; i++) {
+    CHECK(ta.ent[i].score <= ta.ent[i + 1].score);
+  }
+
+  params.type = TCOMBSUM;
+  CHECK_FALSE(pf_runset_ta_applies(rs, &params));
+}
+
+static std::string
+read_all(FILE *fp)
+{
+  std::string s;
+  char buf[4096];
+  size_t n;
+
+  rewind(fp);
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+    s.append(buf, n);
+  }
+  fclose(fp);
+
+  return s;
+}
+
+/*
+ * Condorcet over the postings of a run set ranks as over the accumulators
+ * of a context
+ */
+TEST(runset, condorcet_matches_ctx)
+{
+  const size_t len[] = {40, 25, 50, 10, 30};
+  const struct pf_params params = {TCONDORCET, 60, 0.8, NULL, false};
+  struct pf_ctx *ctx = pf_ctx_create();
+  FILE *a = tmpfile(), *b = tmpfile();
+
+  pf_set_fusion(ctx, TCONDORCET);
+  for (size_t i = 0; i < 5; i++) {
+    struct trec_run *r = make_run(len[i], i + 1);
+    if (0 == i) {
+      pf_init(ctx, &r->topics);
+    }
+    pf_weight_alloc(ctx, 0.8, r->max_rank);
+    pf_accumulate(ctx, r);
+    trec_destroy(r);
+  }
+  pf_present(ctx, a, "test", 50, false);
+  pf_runset_present(b, rs, &params, "test", 50, false, NULL);
+
+  STRCMP_EQUAL(read_all(a).c_str(), read_all(b).c_str());
+  pf_ctx_destroy(ctx);
+}
+
+/*
+ * The topics shared out between threads come out as from one
+ */
+TEST(runset, mc4_matches_ctx)
+{
+  const size_t len[] = {40, 25, 50, 10, 30};
+  const struct pf_params params = {TMC4, 60, 0.8, NULL, false};
+  struct pf_ctx *ctx = pf_ctx_create();
+  FILE *a = tmpfile(), *b = tmpfile();
+
+  pf_set_fusion(ctx, TMC4);
+  pf_set_threads(ctx, 2);
+  for (size_t i = 0; i < 5; i++) {
+    struct trec_run *r = make_run(len[i], i + 1);
+    if (0 == i) {
+      pf_init(ctx, &r->topics);
+    }
+    pf_weight_alloc(ctx, 0.8, r->max_rank);
+    pf_accumulate(ctx, r);
+    trec_destroy(r);
+  }
+  pf_present(ctx, a, "test", 50, false);
+  pf_runset_present(b, rs, &params, "test", 50, false, NULL);
+
+  STRCMP_EQUAL(read_all(a).c_str(), read_all(b).c_str());
+  pf_ctx_destroy(ctx);
+}
@@ -0,0 +1,269 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <CppUTest/TestHarness.h>
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+extern "C" {
+#include "pf_serve.h"
+#include "polyfuse.h"
+}
+
+static const char *run_a = "1 Q0 d1 1 3.0 a\n"
+                           "1 Q0 d2 2 2.0 a\n"
+                           "2 Q0 d3 1 1.0 a\n";
+static const char *run_b = "1 Q0 d2 1 5.0 b\n"
+                           "1 Q0 d4 2 1.0 b\n"
+                           "2 Q0 d3 1 4.0 b\n";
+
+static std::string
+write_run(const char *text)
+{
+  char path[] = "/tmp/pf_serve_testXXXXXX";
+  FILE *fp = fdopen(mkstemp(path), "w");
+
+  fputs(text, fp);
+  fclose(fp);
+
+  return path;
+}
+
+/*
+ * A run of 20 topics of 1000 documents each, long enough for reads of
+ * several runs to overlap.
+ */
+static std::string
+long_run(unsigned int seed)
+{
+  std::string text;
+  char line[128];
+
+  for (int qid = 1; qid <= 20; qid++) {
+    for (int i = 1; i <= 1000; i++) {
+      snprintf(line, sizeof(line), "%d Q0 d%u %d %d.0 r%u\n", qid,
+          rand_r(&seed) % 5000, i, 1001 - i, seed % 10);
+      text += line;
+    }
+  }
+
+  return text;
+}
+
+static std::string
+request(struct pf_server *srv, const std::string &msg, int *status)
+{
+  struct pf_writer out;
+
+  pf_writer_init_mem(&out);
+  *status = pf_server_request(srv, msg.data(), msg.size(), &out);
+  std::string res(out.buf, out.len);
+  pf_writer_free(&out);
+
+  return res;
+}
+
+TEST_GROUP(serve)
+{
+  std::string a, b;
+
+  void setup()
+  {
+    a = write_run(run_a);
+    b = write_run(run_b);
+  }
+
+  void teardown()
+  {
+    unlink(a.c_str());
+    unlink(b.c_str());
+  }
+};
+
+TEST(serve, parse)
+{
+  struct pf_serve_req req;
+  char err[128];
+  const char *msg = "fuse method=rrf k=10 depth=5 topics=3,1 ties=1 "
+                    "runs=x.run,y.run weights=1,0.5";
+
+  CHECK_EQUAL(0, pf_serve_parse(&req, msg, strlen(msg), err, sizeof(err)));
+  CHECK_EQUAL(PF_SERVE_FUSE, req.cmd);
+  CHECK_EQUAL(TRRF, req.type);
+  CHECK_EQUAL(10, req.rrf_k);
+  CHECK_EQUAL(5, req.depth);
+  CHECK(req.prevent_ties);
+  CHECK_EQUAL(2, req.ntopics);
+  CHECK_EQUAL(3, req.topics[0]);
+  CHECK_EQUAL(2, req.nruns);
+  STRCMP_EQUAL("y.run", req.runs[1]);
+  CHECK_EQUAL(0.5, (double)req.weights[1]);
+  pf_serve_req_free(&req);
+
+  const char *bad[] = {"", "fuse runs=x.run", "fuse method=nope runs=x",
+      "fuse method=rrf", "fuse method=rrf depth=0 runs=x",
+      "fuse method=rrf k=ten runs=x", "fuse method=rrf runs=x weights=1,2",
+      "fuse method=rrf topics=1,1 runs=x", "fuse method=rrf runs", "fetch"};
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    CHECK_EQUAL(-1, pf_serve_parse(&req, bad[i], strlen(bad[i]), err,
+                        sizeof(err)));
+    CHECK(strlen(err) > 0);
+    pf_serve_req_free(&req);
+  }
+}
+
+/*
+ * A fuse request answers with the run the command line would write
+ */
+TEST(serve, fuse)
+{
+  struct pf_server srv;
+  struct pf_writer w;
+  char want[64];
+  int status;
+
+  pf_server_init(&srv, 1 << 20);
+  std::string res =
+      request(&srv, "fuse method=combsum runs=" + a + "," + b, &status);
+  CHECK_EQUAL(0, status);
+
+  struct trec_run *ra = trec_create(), *rb = trec_create();
+  FILE *fp = fopen(a.c_str(), "r");
+  trec_read(ra, fp);
+  fclose(fp);
+  fp = fopen(b.c_str(), "r");
+  trec_read(rb, fp);
+  fclose(fp);
+  struct pf_ctx *ctx = pf_ctx_create();
+  pf_set_fusion(ctx, TCOMBSUM);
+  pf_init(ctx, &ra->topics);
+  pf_weight_alloc(ctx, 0.8, ra->max_rank);
+  pf_accumulate(ctx, ra);
+  pf_weight_alloc(ctx, 0.8, rb->max_rank);
+  pf_accumulate(ctx, rb);
+  pf_writer_init_mem(&w);
+  pf_present_writer(ctx, &w, "polyfuse-combsum", PF_SERVE_DEPTH, false);
+  STRCMP_EQUAL(std::string(w.buf, w.len).c_str(), res.c_str());
+  pf_writer_free(&w);
+  pf_ctx_destroy(ctx);
+  trec_destroy(ra);
+  trec_destroy(rb);
+
+  res = request(&srv, "fuse method=rrf topics=2 id=x runs=" + a, &status);
+  CHECK_EQUAL(0, status);
+  snprintf(want, sizeof(want), "2 Q0 d3 1 %.9Lf x\n",
+      (long double)pf_score_rrf(60, 1));
+  STRCMP_EQUAL(want, res.c_str());
+
+  res = request(&srv, "fuse method=rrf runs=/nonexistent.run", &status);
+  CHECK_EQUAL(-1, status);
+  CHECK(std::string::npos != res.find("/nonexistent.run"));
+
+  CHECK_EQUAL(2, srv.cache.len);
+  CHECK_EQUAL(1, srv.cache.hits);
+  CHECK_EQUAL(3, srv.requests);
+  CHECK_EQUAL(1, srv.errors);
+  pf_server_free(&srv);
+}
+
+/*
+ * Runs not in use are evicted least recently used first
+ */
+TEST(serve, evict)
+{
+  struct pf_cache c;
+  struct pf_cache_entry *ea, *eb;
+  char err[128];
+
+  pf_cache_init(&c, 0);
+  ea = pf_cache_get(&c, a.c_str(), TNORM_NONE, err, sizeof(err));
+  eb = pf_cache_get(&c, b.c_str(), TNORM_NONE, err, sizeof(err));
+  CHECK_EQUAL(2, c.len);
+  CHECK_EQUAL(3, ea->run->len);
+  pf_cache_put(&c, ea);
+  CHECK_EQUAL(1, c.len);
+  CHECK_EQUAL(1, c.evictions);
+  pf_cache_put(&c, eb);
+  CHECK_EQUAL(0, c.len);
+  CHECK_EQUAL(0, c.bytes);
+  pf_cache_free(&c);
+
+  pf_cache_init(&c, 1 << 20);
+  ea = pf_cache_get(&c, a.c_str(), TNORM_NONE, err, sizeof(err));
+  pf_cache_put(&c, ea);
+  c.budget = c.bytes;
+  eb = pf_cache_get(&c, b.c_str(), TNORM_NONE, err, sizeof(err));
+  pf_cache_put(&c, eb);
+  CHECK_EQUAL(1, c.len);
+  STRCMP_EQUAL(b.c_str(), c.ent[0]->path);
+  pf_cache_free(&c);
+}
+
+TEST(serve, stats)
+{
+  struct pf_server srv;
+  int status;
+
+  pf_server_init(&srv, 1 << 20);
+  request(&srv, "ping", &status);
+  pf_server_queue(&srv, 3);
+  pf_server_queue(&srv, -2);
+  std::string res = request(&srv, "stats", &status);
+  CHECK_EQUAL(0, status);
+  CHECK(std::string::npos != res.find("requests             1\n"));
+  CHECK(std::string::npos != res.find("queue_depth          1\n"));
+  CHECK(std::string::npos != res.find("queue_depth_max      3\n"));
+  CHECK(std::string::npos != res.find("latency_p99_ms"));
+  pf_server_free(&srv);
+}
+
+/*
+ * Requests reading uncached runs at once answer as they do one at a time
+ */
+TEST(serve, concurrent_misses)
+{
+  const size_t nreq = 8;
+  std::vector<std::string> paths, want(nreq), got(nreq);
+  std::vector<std::thread> threads;
+  std::vector<int> status(nreq);
+  struct pf_server srv;
+
+  for (size_t i = 0; i < 2 * nreq; i++) {
+    paths.push_back(write_run(long_run(i + 1).c_str()));
+  }
+  for (int pass = 0; pass < 2; pass++) {
+    pf_server_init(&srv, 1 << 24);
+    for (size_t i = 0; i < nreq; i++) {
+      std::string msg = "fuse method=combsum runs=" + paths[2 * i] + "," +
+                        paths[2 * i + 1];
+      if (0 == pass) {
+        want[i] = request(&srv, msg, &status[i]);
+        CHECK_EQUAL(0, status[i]);
+      } else {
+        threads.emplace_back(
+            [&, i, msg] { got[i] = request(&srv, msg, &status[i]); });
+      }
+    }
+    for (std::thread &t : threads) {
+      t.join();
+    }
+    pf_server_free(&srv);
+  }
+  for (size_t i = 0; i < nreq; i++) {
+    CHECK_EQUAL(0, status[i]);
+    STRCMP_EQUAL(want[i].c_str(), got[i].c_str());
+  }
+  for (const std::string &p : paths) {
+    unlink(p.c_str());
+  }
+}
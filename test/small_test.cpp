@@ -0,0 +1,159 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <CppUTest/TestHarness.h>
+
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "pf_small.h"
+#include "polyfuse.h"
+}
+
+static const enum fusetype all_types[] = {TBORDA, TCOMBANZ, TCOMBMAX,
+    TCOMBMED, TCOMBMIN, TCOMBMNZ, TCOMBSUM, TISR, TLOGISR, TRBC, TRRF};
+
+/*
+ * `nlists` lists of `nhits` distinct documents out of a pool of `pool`, a
+ * power of two.
+ */
+static std::vector<std::vector<struct pf_small_hit>>
+make_lists(size_t nlists, size_t nhits, uint64_t pool, unsigned int seed)
+{
+  std::vector<std::vector<struct pf_small_hit>> lists(nlists);
+
+  for (size_t i = 0; i < nlists; i++) {
+    uint64_t a = rand_r(&seed) | 1, b = rand_r(&seed);
+    long double score = 100.0;
+    for (size_t j = 0; j < nhits; j++) {
+      score -= 0.001 * (1 + rand_r(&seed) % 997);
+      lists[i].push_back({(a * j + b) % pool, (uint32_t)(j + 1), score});
+    }
+  }
+
+  return lists;
+}
+
+/*
+ * Scores of the fused run written by the full pipeline for the same lists,
+ * each list being a run of one topic.
+ */
+static std::vector<double>
+fuse_full(enum fusetype type,
+    const std::vector<std::vector<struct pf_small_hit>> &lists, size_t depth)
+{
+  struct pf_ctx *ctx = pf_ctx_create();
+  std::vector<double> scores;
+  struct trec_run *first = NULL;
+  struct pf_writer w;
+
+  pf_set_fusion(ctx, type);
+  for (size_t i = 0; i < lists.size(); i++) {
+    FILE *fp = tmpfile();
+    for (const struct pf_small_hit &h : lists[i]) {
+      fprintf(fp, "1 Q0 %llu %u %.12Lf r\n", (unsigned long long)h.doc,
+          h.rank, (long double)h.score);
+    }
+    rewind(fp);
+    struct trec_run *r = trec_create();
+    trec_read(r, fp);
+    fclose(fp);
+    if (0 == i) {
+      pf_init(ctx, &r->topics);
+      first = r;
+    }
+    pf_weight_alloc(ctx, 0.8, r->max_rank);
+    pf_accumulate(ctx, r);
+    if (r != first) {
+      trec_destroy(r);
+    }
+  }
+  pf_writer_init_mem(&w);
+  pf_present_writer(ctx, &w, "x", depth, false);
+  std::istringstream in(std::string(w.buf, w.len));
+  std::string qid, q0, docno, rank, id;
+  double score;
+  while (in >> qid >> q0 >> docno >> rank >> score >> id) {
+    scores.push_back(score);
+  }
+  pf_writer_free(&w);
+  pf_ctx_destroy(ctx);
+  trec_destroy(first);
+
+  return scores;
+}
+
+static void
+check_method(enum fusetype type, size_t nlists, size_t nhits, size_t k)
+{
+  uint64_t pool = 1;
+  while (pool < 2 * nhits) {
+    pool <<= 1;
+  }
+  std::vector<std::vector<struct pf_small_hit>> lists =
+      make_lists(nlists, nhits, pool, nlists * nhits + type);
+  std::vector<struct pf_small_list> in;
+  std::vector<struct pf_small_result> out(k);
+  struct pf_small_params p = {type, 60, 0.8};
+
+  for (const auto &l : lists) {
+    in.push_back({l.data(), l.size(), 1.0});
+  }
+  size_t n = pf_small_fuse(&p, in.data(), in.size(), out.data(), k);
+  std::vector<double> want = fuse_full(type, lists, k);
+
+  CHECK_EQUAL(want.size(), n);
+  for (size_t i = 0; i < n; i++) {
+    DOUBLES_EQUAL(want[i], (double)out[i].score, 1e-8);
+    if (i > 0) {
+      CHECK(out[i].score <= out[i - 1].score);
+    }
+  }
+}
+
+TEST_GROUP(small){};
+
+/*
+ * Scores match those of `pf_accumulate` and `pf_present` on the linear
+ * scan, the table and inputs larger than the stack buffers
+ */
+TEST(small, matches_pipeline)
+{
+  for (enum fusetype type : all_types) {
+    check_method(type, 3, 10, 10);
+    check_method(type, 8, 100, 20);
+    check_method(type, 6, 300, 50);
+  }
+}
+
+TEST(small, ties_and_weights)
+{
+  const struct pf_small_hit a[] = {{7, 1, 1.0}, {3, 2, 0.5}};
+  const struct pf_small_hit b[] = {{3, 1, 1.0}, {7, 2, 0.5}, {9, 3, 0.2}};
+  struct pf_small_list lists[] = {{a, 2, 1.0}, {b, 3, 1.0}};
+  struct pf_small_params p = {TRRF, 60, 0.8};
+  struct pf_small_result out[4];
+
+  CHECK_EQUAL(3, pf_small_fuse(&p, lists, 2, out, 4));
+  CHECK_EQUAL(7, out[0].doc);
+  CHECK_EQUAL(3, out[1].doc);
+  CHECK_EQUAL(out[0].score, out[1].score);
+  CHECK_EQUAL(9, out[2].doc);
+
+  lists[1].weight = 2.0;
+  p.type = TCOMBSUM;
+  CHECK_EQUAL(1, pf_small_fuse(&p, lists, 2, out, 1));
+  CHECK_EQUAL(3, out[0].doc);
+  DOUBLES_EQUAL(2.5, (double)out[0].score, 1e-12);
+
+  CHECK_EQUAL(0, pf_small_fuse(&p, lists, 0, out, 4));
+}
@@ -0,0 +1,168 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <CppUTest/TestHarness.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "pf_spill.h"
+#include "polyfuse.h"
+}
+
+static std::vector<struct trec_run *> runs;
+static bool reproducible;
+
+static struct pf_ctx *
+new_ctx(enum fusetype type)
+{
+  struct pf_ctx *ctx = pf_ctx_create();
+
+  pf_set_fusion(ctx, type);
+  pf_set_reproducible(ctx, reproducible);
+  pf_init(ctx, &runs[0]->topics);
+  pf_weight_alloc(ctx, 0.8, 8);
+
+  return ctx;
+}
+
+static std::string
+read_back(FILE *fp)
+{
+  std::string out;
+  char buf[4096];
+  size_t n;
+
+  rewind(fp);
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+    out.append(buf, n);
+  }
+  fclose(fp);
+
+  return out;
+}
+
+/*
+ * Fused run of all runs in one context.
+ */
+static std::string
+fuse_whole(enum fusetype type)
+{
+  struct pf_ctx *ctx = new_ctx(type);
+  FILE *fp = tmpfile();
+
+  for (struct trec_run *r : runs) {
+    pf_accumulate(ctx, r);
+  }
+  pf_present(ctx, fp, "t", 10, false);
+  pf_ctx_destroy(ctx);
+
+  return read_back(fp);
+}
+
+/*
+ * Fused run of the runs spilled one or two at a time.
+ */
+static std::string
+fuse_spilled(enum fusetype type, size_t group)
+{
+  struct pf_ctx *ctx = NULL;
+  struct pf_spill spill;
+  struct pf_writer w;
+  FILE *fp = tmpfile();
+
+  pf_spill_init(&spill, type);
+  for (size_t i = 0; i < runs.size(); i++) {
+    if (!ctx) {
+      ctx = new_ctx(type);
+    }
+    pf_accumulate(ctx, runs[i]);
+    if (0 == (i + 1) % group || i + 1 == runs.size()) {
+      pf_spill_add(&spill, ctx);
+      pf_ctx_destroy(ctx);
+      ctx = NULL;
+    }
+  }
+  ctx = new_ctx(type);
+  pf_writer_init(&w, fp);
+  pf_spill_present(&spill, ctx, &w, "t", 10, false);
+  pf_writer_free(&w);
+  pf_ctx_destroy(ctx);
+  pf_spill_free(&spill);
+
+  return read_back(fp);
+}
+
+TEST_GROUP(spill)
+{
+  void setup()
+  {
+    const char *text[] = {
+        "1 Q0 a 1 4.0 r\n1 Q0 b 2 3.0 r\n1 Q0 c 3 1.0 r\n2 Q0 a 1 2.0 r\n",
+        "1 Q0 c 1 5.0 r\n1 Q0 a 2 2.0 r\n2 Q0 d 1 7.0 r\n2 Q0 a 2 1.0 r\n",
+        "1 Q0 b 1 6.0 r\n1 Q0 d 2 0.5 r\n",
+        "1 Q0 a 1 3.0 r\n2 Q0 b 1 4.0 r\n2 Q0 a 2 3.0 r\n",
+        "1 Q0 e 1 9.0 r\n1 Q0 c 2 2.0 r\n2 Q0 d 1 1.0 r\n",
+    };
+    for (const char *t : text) {
+      struct trec_run *r = trec_create();
+      FILE *fp = tmpfile();
+      fputs(t, fp);
+      rewind(fp);
+      trec_read(r, fp);
+      fclose(fp);
+      runs.push_back(r);
+    }
+  }
+
+  void teardown()
+  {
+    for (struct trec_run *r : runs) {
+      trec_destroy(r);
+    }
+    runs.clear();
+    reproducible = false;
+  }
+};
+
+/*
+ * Merged states give the same fused run as one context
+ */
+TEST(spill, matches_single_context)
+{
+  const enum fusetype types[] = {TCOMBSUM, TCOMBMNZ, TCOMBANZ, TCOMBMIN,
+      TCOMBMAX, TCOMBMED, TRRF};
+
+  for (enum fusetype type : types) {
+    std::string whole = fuse_whole(type);
+    STRCMP_EQUAL(whole.c_str(), fuse_spilled(type, 1).c_str());
+    STRCMP_EQUAL(whole.c_str(), fuse_spilled(type, 2).c_str());
+  }
+}
+
+/*
+ * Fixed point sums are the same in any order of runs, spilled or not
+ */
+TEST(spill, reproducible_in_any_order)
+{
+  const enum fusetype types[] = {TBORDA, TCOMBSUM, TISR, TRBC, TRRF};
+
+  reproducible = true;
+  for (enum fusetype type : types) {
+    std::string whole = fuse_whole(type);
+    std::reverse(runs.begin(), runs.end());
+    STRCMP_EQUAL(whole.c_str(), fuse_whole(type).c_str());
+    STRCMP_EQUAL(whole.c_str(), fuse_spilled(type, 2).c_str());
+    std::reverse(runs.begin(), runs.end());
+    STRCMP_EQUAL(whole.c_str(), fuse_spilled(type, 3).c_str());
+  }
+}
@@ -0,0 +1,89 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <CppUTest/TestHarness.h>
+
+extern "C" {
+#include "pf_topk.h"
+}
+
+static char docs[][8] = {"D0", "D1", "D2", "D3", "D4", "D5", "D6", "D7"};
+
+TEST_GROUP(topk)
+{
+  struct pf_topk tk;
+
+  void setup()
+  {
+    memset(&tk, 0, sizeof(tk));
+  }
+
+  void teardown()
+  {
+    pf_topk_free(&tk);
+  }
+};
+
+/*
+ * Fewer candidates than `k` are sorted without a heap
+ */
+TEST(topk, short_topic)
+{
+  pf_topk_reset(&tk, 10, 100);
+  pf_topk_push(&tk, 2.0, docs[0]);
+  pf_topk_push(&tk, 1.0, docs[1]);
+  pf_topk_push(&tk, 3.0, docs[2]);
+
+  CHECK_EQUAL(3, pf_topk_finish(&tk));
+  CHECK(!tk.heap);
+  CHECK_EQUAL(3, tk.nranked);
+  STRCMP_EQUAL("D1", tk.ent[0].docno);
+  STRCMP_EQUAL("D2", tk.ent[2].docno);
+}
+
+/*
+ * Only the best `k` are kept, in ascending order
+ */
+TEST(topk, keeps_best)
+{
+  const double scores[] = {5.0, 1.0, 7.0, 3.0, 6.0, 0.5, 2.0, 4.0};
+
+  pf_topk_reset(&tk, 3, 5);
+  for (size_t i = 0; i < 8; i++) {
+    pf_topk_push(&tk, scores[i], docs[i]);
+  }
+
+  CHECK_EQUAL(3, pf_topk_finish(&tk));
+  CHECK_EQUAL(5, tk.nranked);
+  DOUBLES_EQUAL(5.0, tk.ent[0].score, 0);
+  DOUBLES_EQUAL(6.0, tk.ent[1].score, 0);
+  DOUBLES_EQUAL(7.0, tk.ent[2].score, 0);
+}
+
+/*
+ * Ties are ordered by docno, whatever the input order
+ */
+TEST(topk, ties_by_docno)
+{
+  pf_topk_reset(&tk, 2, 8);
+  pf_topk_push(&tk, 1.0, docs[3]);
+  pf_topk_push(&tk, 1.0, docs[6]);
+  pf_topk_push(&tk, 1.0, docs[1]);
+  pf_topk_push(&tk, 1.0, docs[7]);
+  pf_topk_finish(&tk);
+
+  STRCMP_EQUAL("D6", tk.ent[0].docno);
+  STRCMP_EQUAL("D7", tk.ent[1].docno);
+
+  /* the buffer is reused by the next topic */
+  pf_topk_reset(&tk, 1, 8);
+  pf_topk_push(&tk, 0.5, docs[2]);
+  CHECK_EQUAL(1, pf_topk_finish(&tk));
+  STRCMP_EQUAL("D2", tk.ent[0].docno);
+}
@@ -0,0 +1,98 @@
+/*
+ * This file is a part of Polyfuse.
+ *
+ * Copyright (c) 2018 Luke Gallagher <luke.gallagher@rmit.edu.au>
+ *
+ * For the full copyright and license information, please view the LICENSE file
+ * that was distributed with this source code.
+ */
+
+#include <CppUTest/TestHarness.h>
+
+#include <float.h>
+#include <math.h>
+
+extern "C" {
+#include "pf_writer.h"
+}
+
+static void
+check_score(long double score)
+{
+  char want[8192], got[8192];
+  int n = snprintf(want, sizeof(want), "%.9Lf", score);
+  size_t len = pf_fmt_score(got, sizeof(got), score);
+
+  got[len] = '\0';
+  CHECK_EQUAL((size_t)n, len);
+  STRCMP_EQUAL(want, got);
+}
+
+TEST_GROUP(writer){};
+
+/*
+ * Values on and near a rounding boundary of the ninth decimal
+ */
+TEST(writer, score_boundaries)
+{
+  check_score(0.0);
+  check_score(-0.0);
+  check_score(1.0 / 1024);
+  check_score(3.0 / 1024);
+  check_score(-1.0 / 1024);
+  check_score(0.0000000005L);
+  check_score(0.0000000015L);
+  check_score(-1e-12L);
+  check_score(0.9999999995L);
+  check_score(0.99999999949999L);
+  check_score(8999999999.9999999995L);
+  check_score(9e9L);
+  check_score(1e30L);
+  check_score(-1e300L);
+  check_score(LDBL_MAX);
+  check_score(INFINITY);
+  check_score(-INFINITY);
+  check_score(NAN);
+}
+
+/*
+ * Scores of every magnitude a run file holds
+ */
+TEST(writer, score_random)
+{
+  unsigned long long x = 88172645463325252ULL;
+
+  for (int i = 0; i < 200000; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    long double m = (long double)(x >> 11) / (1ULL << 53);
+    int e = (int)(x % 48) - 36;
+    check_score((x & 1 ? -1 : 1) * ldexpl(m, e));
+    check_score((long double)(x % 100000000000ULL) / 1e9L);
+  }
+}
+
+/*
+ * Lines match those of `fprintf`
+ */
+TEST(writer, line)
+{
+  FILE *fp = tmpfile();
+  struct pf_writer w;
+  char got[256], want[256];
+
+  pf_writer_init(&w, fp);
+  pf_writer_line(&w, 401, "DOC-7", 12, 0.123456789012L, "polyfuse-rrf");
+  pf_writer_line(&w, -3, "x", 1, -2.5L, "r");
+  pf_writer_free(&w);
+  rewind(fp);
+
+  CHECK(fgets(got, sizeof(got), fp));
+  snprintf(want, sizeof(want), "%d Q0 %s %lu %.9Lf %s\n", 401, "DOC-7",
+      12UL, 0.123456789012L, "polyfuse-rrf");
+  STRCMP_EQUAL(want, got);
+  CHECK(fgets(got, sizeof(got), fp));
+  STRCMP_EQUAL("-3 Q0 x 1 -2.500000000 r\n", got);
+  fclose(fp);
+}
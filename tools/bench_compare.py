@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+import argparse
+import csv
+import sys
+from typing import Dict, Tuple
+
+Key = Tuple[str, ...]
+KEY_FIELDS = ["subsystem", "variant", "runs", "topics", "depth"]
+
+
+def read_bench(path: str) -> Dict[Key, float]:
+    """Map each benchmark row of a `pf_bench` report to its ns/entry."""
+    res = {}
+    with open(path) as f:
+        lines = [l for l in f if "\t" in l]
+    for row in csv.DictReader(lines, delimiter="\t"):
+        res[tuple(row[k] for k in KEY_FIELDS)] = float(row["ns_per_entry"])
+    return res
+
+
+def parse_args() -> argparse.Namespace:
+    parser = argparse.ArgumentParser(
+        description="Compare two `make bench` reports."
+    )
+    parser.add_argument("old", help="baseline report")
+    parser.add_argument("new", help="report to compare")
+    parser.add_argument(
+        "-t",
+        "--threshold",
+        type=float,
+        default=10.0,
+        help="percent slowdown reported as a regression, default: 10",
+    )
+    return parser.parse_args()
+
+
+def main() -> None:
+    args = parse_args()
+    old = read_bench(args.old)
+    new = read_bench(args.new)
+    regressions = 0
+
+    print("\t".join(KEY_FIELDS + ["old_ns", "new_ns", "change"]))
+    for key, ns in new.items():
+        if key not in old:
+            continue
+        change = 100.0 * (ns - old[key]) / old[key] if old[key] else 0.0
+        flag = ""
+        if change > args.threshold:
+            flag = "\tREGRESSION"
+            regressions += 1
+        print(
+            "\t".join(key)
+            + "\t{:.1f}\t{:.1f}\t{:+.1f}%{}".format(old[key], ns, change, flag)
+        )
+
+    sys.exit(1 if regressions else 0)
+
+
+if __name__ == "__main__":
+    main()
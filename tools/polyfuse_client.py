@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+import argparse
+import socket
+import struct
+import sys
+
+
+def recv_exact(sock: socket.socket, n: int) -> bytes:
+    buf = b""
+    while len(buf) < n:
+        chunk = sock.recv(n - len(buf))
+        if not chunk:
+            raise ConnectionError("server closed the connection")
+        buf += chunk
+    return buf
+
+
+def request(sock: socket.socket, msg: str) -> bytes:
+    """Send one request to `polyfuse serve`, raising on an error status."""
+    data = msg.encode()
+    sock.sendall(struct.pack(">I", len(data)) + data)
+    status, n = struct.unpack(">II", recv_exact(sock, 8))
+    body = recv_exact(sock, n)
+    if status:
+        raise RuntimeError(body.decode())
+    return body
+
+
+def parse_args() -> argparse.Namespace:
+    parser = argparse.ArgumentParser(
+        description="Send requests to `polyfuse serve`."
+    )
+    parser.add_argument(
+        "-s",
+        "--socket",
+        default="polyfuse.sock",
+        help="socket path, default: polyfuse.sock",
+    )
+    parser.add_argument(
+        "request",
+        nargs="+",
+        help="request, e.g. 'fuse method=rrf runs=a.run,b.run' or 'stats'",
+    )
+    return parser.parse_args()
+
+
+def main() -> None:
+    args = parse_args()
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(args.socket)
+    try:
+        for msg in args.request:
+            sys.stdout.buffer.write(request(sock, msg))
+    except RuntimeError as e:
+        print("polyfuse serve: {}".format(e), file=sys.stderr)
+        sys.exit(1)
+    finally:
+        sock.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+import argparse
+import sys
+from typing import Dict, List, Tuple
+
+Ranking = List[Tuple[str, float]]
+
+
+def read_run(path: str) -> Dict[str, Ranking]:
+    """Map each topic of a fused run to its documents and scores in order."""
+    res: Dict[str, Ranking] = {}
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) != 6:
+                continue
+            res.setdefault(fields[0], []).append((fields[2], float(fields[4])))
+    return res
+
+
+def kendall_tau(a: List[str], b: List[str]) -> float:
+    """Kendall's tau of the documents ranked by both `a` and `b`."""
+    pos = {d: i for i, d in enumerate(b)}
+    common = [pos[d] for d in a if d in pos]
+    n = len(common)
+    if n < 2:
+        return 1.0
+    discordant = sum(
+        1 for i in range(n) for j in range(i + 1, n) if common[i] > common[j]
+    )
+    return 1.0 - 4.0 * discordant / (n * (n - 1))
+
+
+def parse_args() -> argparse.Namespace:
+    parser = argparse.ArgumentParser(
+        description="Report how far two fused runs of the same input differ, "
+        "e.g. from builds with another `SCORE` type."
+    )
+    parser.add_argument("old", help="baseline fused run")
+    parser.add_argument("new", help="fused run to compare")
+    parser.add_argument(
+        "-k", type=int, default=10, help="depth of the overlap, default: 10"
+    )
+    return parser.parse_args()
+
+
+def main() -> None:
+    args = parse_args()
+    old = read_run(args.old)
+    new = read_run(args.new)
+    topics = sorted(set(old) | set(new))
+    same = moved = total = 0
+    overlap = tau = max_diff = 0.0
+
+    for qid in topics:
+        a, b = old.get(qid, []), new.get(qid, [])
+        da, db = [d for d, _ in a], [d for d, _ in b]
+        same += da == db
+        moved += sum(1 for x, y in zip(da, db) if x != y) + abs(len(a) - len(b))
+        total += max(len(a), len(b))
+        overlap += len(set(da[: args.k]) & set(db[: args.k])) / max(
+            1, min(args.k, len(da), len(db))
+        )
+        tau += kendall_tau(da, db)
+        scores = dict(a)
+        for d, s in b:
+            if d in scores:
+                max_diff = max(max_diff, abs(s - scores[d]))
+
+    n = max(1, len(topics))
+    print("topics\tidentical\tmoved\toverlap@{}\ttau\tmax_score_diff".format(args.k))
+    print(
+        "{}\t{:.4f}\t{:.6f}\t{:.6f}\t{:.6f}\t{:.3g}".format(
+            len(topics),
+            same / n,
+            moved / max(1, total),
+            overlap / n,
+            tau / n,
+            max_diff,
+        )
+    )
+    sys.exit(0 if same == len(topics) else 1)
+
+
+if __name__ == "__main__":
+    main()
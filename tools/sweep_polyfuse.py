@@ -1,70 +1,36 @@
 #!/usr/bin/env python3
 import argparse
-import itertools
 import os
 import subprocess
 import sys
 from pathlib import Path
-from typing import Any, List, Sequence
+from typing import Any, List
 
 
 def eprint(*args: Any, **kwargs: Any) -> None:
     print(*args, **kwargs, file=sys.stderr, flush=True)  # type: ignore
 
 
-def run_polyfuse(poly_args: Sequence[str]) -> str:
+def run_sweep(args: argparse.Namespace) -> None:
+    """Fuse the whole grid with a single `polyfuse sweep` process."""
+    poly_args = [
+        args.prog,
+        "sweep",
+        "-o",
+        args.output_dir,
+        "-m",
+        ",".join(args.fusion),
+        "-d",
+        ",".join(args.depth),
+        "-n",
+        ",".join(args.score_norm),
+        "-p",
+        ",".join(args.rbc_p),
+        "-k",
+        ",".join(args.rrf_k),
+    ] + args.run
     eprint(" ".join(poly_args))
-    proc = subprocess.run(poly_args, stdout=subprocess.PIPE)
-    output: str = proc.stdout.decode("utf-8")
-    return output
-
-
-def write_output(directory: str, filename: str, content: str) -> None:
-    path = Path(directory) / Path(filename)
-    with open(path, "w") as f:
-        f.write(content)
-
-
-def sweep_rrf(args: argparse.Namespace) -> None:
-    for d, k in itertools.product(args.depth, args.rrf_k):
-        output = run_polyfuse([args.prog, "rrf", "-d", d, "-k", k] + args.run)
-        write_output(
-            args.output_dir,
-            "{fusion}_depth:{depth}_k:{k}.run".format(fusion="rrf", depth=d, k=k),
-            output,
-        )
-
-
-def sweep_rbc(args: argparse.Namespace) -> None:
-    for d, p in itertools.product(args.depth, args.rbc_p):
-        output = run_polyfuse([args.prog, "rbc", "-d", d, "-p", p] + args.run)
-        write_output(
-            args.output_dir,
-            "{fusion}_depth:{depth}_p:{p}.run".format(fusion="rbc", depth=d, p=p),
-            output,
-        )
-
-
-def sweep_comb(fusion: str, args: argparse.Namespace) -> None:
-    for d, norm in itertools.product(args.depth, args.score_norm):
-        output = run_polyfuse([args.prog, fusion, "-d", d, "-n", norm] + args.run)
-        write_output(
-            args.output_dir,
-            "{fusion}_depth:{depth}_norm:{norm}.run".format(
-                fusion=fusion, depth=d, norm=norm
-            ),
-            output,
-        )
-
-
-def sweep_default(fusion: str, args: argparse.Namespace) -> None:
-    for d in args.depth:
-        output = run_polyfuse([args.prog, fusion, "-d", d] + args.run)
-        write_output(
-            args.output_dir,
-            "{fusion}_depth:{depth}.run".format(fusion=fusion, depth=d),
-            output,
-        )
+    subprocess.run(poly_args, check=True)
 
 
 def float_list(input_: str) -> List[str]:
@@ -196,15 +162,7 @@ def main() -> None:
     if not os.path.exists(args.output_dir):
         os.makedirs(args.output_dir)
 
-    for fusion in args.fusion:
-        if fusion == "rrf":
-            sweep_rrf(args)
-        elif fusion == "rbc":
-            sweep_rbc(args)
-        elif fusion.startswith("comb"):
-            sweep_comb(fusion, args)
-        else:
-            sweep_default(fusion, args)
+    run_sweep(args)
 
     eprint("Check {} for output files.".format(args.output_dir))
 